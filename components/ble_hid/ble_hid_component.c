@@ -1,4 +1,5 @@
 #include "ble_hid_component.h"
+#include "boot.h"
 #include "gap_handler.h"
 #include "gatt_handler.h"
 #include "hid_service.h"
@@ -15,16 +16,22 @@
 
 #define BLE_HID_TAG "BLE_HID"
 
+// NimBLE's NVS backed bond store; it has no header of its own.
+void ble_store_config_init(void);
+
 
 static void callback_on_reset(int reason) {
     MODLOG_DFLT(ERROR, "Resetting state; reason=%d\n", reason);
 }
 
-static bool sync_done = false;
+// Advertised for once the host syncs.
+static hid_control_t *synced_control;
 
 /**
  * @brief Startup or reset of host controller
  *
+ * Runs on the NimBLE host task, so advertising starts as soon as the
+ * controller is ready instead of when app_main next looks.
  */
 static void callback_on_sync(void) {
     int rc;
@@ -46,7 +53,10 @@ static void callback_on_sync(void) {
     MODLOG_DFLT(INFO, "Device Address: ");
     print_addr(addr_val);
     MODLOG_DFLT(INFO, "\n");
-    sync_done = true;
+    boot_done(BOOT_BLE_SYNCED);
+
+    /* Begin advertising. */
+    begin_advertise(synced_control);
 }
 
 void bleprph_host_task(void *param) {
@@ -67,6 +77,7 @@ void init_ble_hid(hid_control_t *hid_control) {
         ret = nvs_flash_init();
     }
     ESP_ERROR_CHECK(ret);
+    boot_done(BOOT_NVS);
 
     ESP_ERROR_CHECK(esp_nimble_hci_and_controller_init());
     nimble_port_init();
@@ -81,27 +92,22 @@ void init_ble_hid(hid_control_t *hid_control) {
     // If using security
     // ble_hs_cfg.sm_sc = 1;
 
+    // Bond and keep the keys across reboots, so a host reconnects without
+    // pairing again and gets directed advertising when its link drops.
+    ble_hs_cfg.sm_bonding = 1;
+    ble_hs_cfg.sm_our_key_dist =
+        BLE_SM_PAIR_KEY_DIST_ENC | BLE_SM_PAIR_KEY_DIST_ID;
+    ble_hs_cfg.sm_their_key_dist =
+        BLE_SM_PAIR_KEY_DIST_ENC | BLE_SM_PAIR_KEY_DIST_ID;
+    ble_store_config_init();
+
     ESP_LOGD(BLE_HID_TAG, "Start gatt server");
     ret = init_gatts_server();
     ESP_ERROR_CHECK(ret);
 
+    // Ready before the host task can sync and advertise with it.
+    init_hid_control(hid_control);
+    synced_control = hid_control;
     nimble_port_freertos_init(bleprph_host_task);
-
-    init_hid_control();
-    while (sync_done == false) {
-        vTaskDelay(100);
-        ESP_LOGD(BLE_HID_TAG, "Waiting for sync.");
-    }
-
-    /* Begin advertising. */
-    begin_advertise(hid_control);
     // ble_gap_deinit();
 }
-
-void init_hid_control() { init_hid_control_internal(); }
-
-int send_mouse_event(hid_control_t *hid_control, uint8_t mouse_button,
-                     int8_t mickeys_x, int8_t mickeys_y, int8_t wheel) {
-    return send_mouse_event_internal(hid_control, mouse_button, mickeys_x,
-                                     mickeys_y, wheel);
-}
\ No newline at end of file
@@ -0,0 +1,73 @@
+#include "conn_params.h"
+#include "esp_log.h"
+#include "host/ble_gap.h"
+#include "host/ble_hs.h"
+#include <string.h>
+
+#define CONN_PARAMS_TAG "conn_params"
+
+typedef struct {
+    const char *name;
+    struct ble_gap_upd_params params;
+} conn_profile_def_t;
+
+// Intervals in 1.25ms units, supervision timeout in 10ms units.
+static const conn_profile_def_t profiles[CONN_PROFILE_COUNT] = {
+    [CONN_PROFILE_LOW_LATENCY] = {.name = "low_latency",
+                                  .params = {.itvl_min = 6,
+                                             .itvl_max = 9,
+                                             .latency = 0,
+                                             .supervision_timeout = 300}},
+    [CONN_PROFILE_BALANCED] = {.name = "balanced",
+                               .params = {.itvl_min = 12,
+                                          .itvl_max = 24,
+                                          .latency = 0,
+                                          .supervision_timeout = 400}},
+    [CONN_PROFILE_LOW_POWER] = {.name = "low_power",
+                                .params = {.itvl_min = 24,
+                                           .itvl_max = 40,
+                                           .latency = 4,
+                                           .supervision_timeout = 600}},
+};
+
+void conn_params_request(hid_control_t *hid_control, hid_conn_t *conn) {
+    if (!conn->in_use) {
+        return;
+    }
+    const conn_profile_def_t *profile = &profiles[hid_control->conn_profile];
+    int rc = ble_gap_update_params(conn->conn, &profile->params);
+    // EALREADY: an update is in progress and will report on CONN_UPDATE.
+    if (rc != 0 && rc != BLE_HS_EALREADY) {
+        ESP_LOGW(CONN_PARAMS_TAG, "update of %d to %s failed; rc=%d",
+                 conn->conn, profile->name, rc);
+    }
+}
+
+esp_err_t conn_params_set_profile(hid_control_t *hid_control,
+                                  conn_profile_t profile) {
+    if (profile >= CONN_PROFILE_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    hid_control->conn_profile = profile;
+    for (int i = 0; i < HID_MAX_CONNECTIONS; i++) {
+        conn_params_request(hid_control, &hid_control->conns[i]);
+    }
+    return ESP_OK;
+}
+
+esp_err_t conn_params_set_profile_by_name(hid_control_t *hid_control,
+                                          const char *name) {
+    for (int i = 0; i < CONN_PROFILE_COUNT; i++) {
+        if (strcmp(profiles[i].name, name) == 0) {
+            return conn_params_set_profile(hid_control, i);
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+const char *conn_params_profile_name(conn_profile_t profile) {
+    if (profile >= CONN_PROFILE_COUNT) {
+        return "unknown";
+    }
+    return profiles[profile].name;
+}
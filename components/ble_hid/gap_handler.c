@@ -1,5 +1,10 @@
+#include "boot.h"
+#include "conn_params.h"
 #include "gap_handler.h"
+#include "gatt_handler.h"
+#include "hid_service.h"
 #include "misc.h"
+#include "reconnect.h"
 
 #include "services/gap/ble_svc_gap.h"
 
@@ -9,32 +14,39 @@
 
 #define BLE_GAP_TAG "BLE_GAP"
 
+// Intervals in 0.625ms units. HOGP asks for 20-30ms in the first 30 s a
+// host may be looking, then 1-2.5 s.
+#define FAST_ADV_ITVL_MIN BLE_GAP_ADV_ITVL_MS(20)
+#define FAST_ADV_ITVL_MAX BLE_GAP_ADV_ITVL_MS(30)
+#define FAST_ADV_MS (30 * 1000)
+#define SLOW_ADV_ITVL_MIN BLE_GAP_ADV_ITVL_MS(1000)
+#define SLOW_ADV_ITVL_MAX BLE_GAP_ADV_ITVL_MS(2500)
+// The longest high duty cycle directed advertising may run.
+#define DIRECTED_ADV_MS 1280
+
+// Phase advertising now, or last.
+static reconnect_phase_t adv_phase = RECONNECT_DIRECTED;
+// A host connected through the current advertising run.
+static bool adv_connected = false;
+
 /**
- * Enables advertising with the following parameters:
- *     o Limited discoverable mode.
- *     o Undirected connectable mode.
+ * Set the advertisement data included in our advertisements:
+ *     o Flags (indicates advertisement type and other general info).
+ *     o Advertising tx power.
+ *     o Device name.
+ *     o 16-bit service UUIDs (alert notifications).
  */
-void begin_advertise(hid_control_t *hid_control) {
-    struct ble_gap_adv_params adv_params;
+static int set_adv_fields(uint8_t disc_flag) {
     struct ble_hs_adv_fields fields;
     const char *name;
-    int rc;
-
-    /**
-     *  Set the advertisement data included in our advertisements:
-     *     o Flags (indicates advertisement type and other general info).
-     *     o Advertising tx power.
-     *     o Device name.
-     *     o 16-bit service UUIDs (alert notifications).
-     */
 
     memset(&fields, 0, sizeof fields);
 
     /* Advertise two flags:
-     *     o Limited discovery mode
+     *     o Limited or general discovery mode
      *     o BLE-only (BR/EDR unsupported).
      */
-    fields.flags = BLE_HS_ADV_F_DISC_LTD | BLE_HS_ADV_F_BREDR_UNSUP;
+    fields.flags = disc_flag | BLE_HS_ADV_F_BREDR_UNSUP;
 
     /* Indicate that the TX power level field should be included; have the
      * stack fill this value automatically.  This is done by assigning the
@@ -62,30 +74,128 @@ void begin_advertise(hid_control_t *hid_control) {
     fields.num_uuids16 = 1;
     fields.uuids16_is_complete = 1;
 
-    rc = ble_gap_adv_set_fields(&fields);
-    if (rc != 0) {
-        MODLOG_DFLT(ERROR, "error setting advertisement data; rc=%d\n", rc);
-        return;
-    }
+    return ble_gap_adv_set_fields(&fields);
+}
+
+/**
+ * Start advertising in phase. BLE_HS_ENOENT if it does not apply, i.e.
+ * directed advertising with no bonded host to direct it to.
+ */
+static int advertise_phase(hid_control_t *hid_control,
+                           reconnect_phase_t phase) {
+    struct ble_gap_adv_params adv_params;
+    ble_addr_t peer;
+    int32_t duration_ms;
+    int rc;
 
-    /* Begin advertising. */
-    ESP_LOGI(BLE_GAP_TAG, "Start advertising");
     memset(&adv_params, 0, sizeof adv_params);
-    // Undirected, limited discovery mode actually set here matching flags of
-    // the advertising packet. Other params from HOGP Connection Establishment
-    // section
-    adv_params.conn_mode = BLE_GAP_CONN_MODE_UND;
-    adv_params.disc_mode = BLE_GAP_DISC_MODE_LTD;
-    adv_params.itvl_min = BLE_GAP_INITIAL_CONN_ITVL_MIN;
-    adv_params.itvl_max = BLE_GAP_INITIAL_CONN_ITVL_MAX;
-
-    int32_t duration_ms = 3 * 60 * 1000; // 3 min
-    rc = ble_gap_adv_start(own_addr_type, NULL, duration_ms, &adv_params,
-                           gap_handler, hid_control);
-    if (rc != 0) {
-        MODLOG_DFLT(ERROR, "error enabling advertisement; rc=%d\n", rc);
+    switch (phase) {
+    case RECONNECT_DIRECTED:
+        if (!reconnect_directed_peer(hid_control, &peer)) {
+            return BLE_HS_ENOENT;
+        }
+        // Carries no advertising data, only the host's address.
+        adv_params.conn_mode = BLE_GAP_CONN_MODE_DIR;
+        adv_params.disc_mode = BLE_GAP_DISC_MODE_NON;
+        adv_params.high_duty_cycle = 1;
+        duration_ms = DIRECTED_ADV_MS;
+        break;
+    case RECONNECT_FAST:
+        rc = set_adv_fields(BLE_HS_ADV_F_DISC_LTD);
+        if (rc != 0) {
+            return rc;
+        }
+        // Undirected, limited discovery mode actually set here matching
+        // flags of the advertising packet.
+        adv_params.conn_mode = BLE_GAP_CONN_MODE_UND;
+        adv_params.disc_mode = BLE_GAP_DISC_MODE_LTD;
+        adv_params.itvl_min = FAST_ADV_ITVL_MIN;
+        adv_params.itvl_max = FAST_ADV_ITVL_MAX;
+        duration_ms = FAST_ADV_MS;
+        break;
+    default:
+        // Limited discovery may not last longer than 3 min, general may.
+        rc = set_adv_fields(BLE_HS_ADV_F_DISC_GEN);
+        if (rc != 0) {
+            return rc;
+        }
+        adv_params.conn_mode = BLE_GAP_CONN_MODE_UND;
+        adv_params.disc_mode = BLE_GAP_DISC_MODE_GEN;
+        adv_params.itvl_min = SLOW_ADV_ITVL_MIN;
+        adv_params.itvl_max = SLOW_ADV_ITVL_MAX;
+        duration_ms = BLE_HS_FOREVER;
+        break;
+    }
+
+    rc = ble_gap_adv_start(own_addr_type,
+                           phase == RECONNECT_DIRECTED ? &peer : NULL,
+                           duration_ms, &adv_params, gap_handler, hid_control);
+    if (rc == 0) {
+        ESP_LOGI(BLE_GAP_TAG, "Start %s advertising",
+                 reconnect_phase_name(phase));
+        adv_phase = phase;
+        adv_connected = false;
+        reconnect_advertising(phase);
+    }
+    return rc;
+}
+
+/**
+ * Advertise in phase, or the first one after it that starts.
+ */
+static void advertise_from(hid_control_t *hid_control,
+                           reconnect_phase_t phase) {
+    for (; phase < RECONNECT_PHASE_COUNT; phase++) {
+        int rc = advertise_phase(hid_control, phase);
+        if (rc == 0) {
+            return;
+        }
+        if (rc != BLE_HS_ENOENT) {
+            MODLOG_DFLT(ERROR, "error enabling %s advertising; rc=%d\n",
+                        reconnect_phase_name(phase), rc);
+        }
+    }
+}
+
+/**
+ * Enables advertising, unless it is on already, going through the
+ * reconnect_phase_t phases from the first: directed to a bonded host, then
+ * fast and slow undirected connectable advertising.
+ */
+void begin_advertise(hid_control_t *hid_control) {
+    // Already advertising for another free connection slot.
+    if (ble_gap_adv_active()) {
         return;
     }
+    advertise_from(hid_control, RECONNECT_DIRECTED);
+}
+
+static void record_conn_params(hid_conn_t *conn,
+                               const struct ble_gap_conn_desc *desc) {
+    conn->conn_itvl = desc->conn_itvl;
+    conn->conn_latency = desc->conn_latency;
+    conn->supervision_timeout = desc->supervision_timeout;
+}
+
+static hid_conn_t *claim_conn(hid_control_t *hid_control,
+                              uint16_t conn_handle) {
+    for (int i = 0; i < HID_MAX_CONNECTIONS; i++) {
+        hid_conn_t *conn = &hid_control->conns[i];
+        if (!conn->in_use) {
+            hid_report_init_conn(conn, conn_handle);
+            return conn;
+        }
+    }
+    return NULL;
+}
+
+static bool has_free_conn(const hid_control_t *hid_control) {
+    for (int i = 0; i < HID_MAX_CONNECTIONS; i++) {
+        if (!hid_control->conns[i].in_use) {
+            return true;
+        }
+    }
+    return false;
 }
 
 /**
@@ -113,6 +223,7 @@ int gap_handler(struct ble_gap_event *event, void *arg) {
     struct ble_gap_conn_desc desc;
     int rc;
     hid_control_t *hid_control = (hid_control_t *)arg;
+    hid_conn_t *conn;
 
     switch (event->type) {
     case BLE_GAP_EVENT_CONNECT:
@@ -123,10 +234,24 @@ int gap_handler(struct ble_gap_event *event, void *arg) {
         if (event->connect.status == 0) {
             rc = ble_gap_conn_find(event->connect.conn_handle, &desc);
             assert(rc == 0);
-            hid_control->conn = desc.conn_handle;
             bleprph_print_conn_desc(&desc);
+            conn = claim_conn(hid_control, desc.conn_handle);
+            if (conn == NULL) {
+                // Table matches the NimBLE limit, so this should not happen.
+                ble_gap_terminate(desc.conn_handle, BLE_ERR_CONN_LIMIT);
+            } else {
+                adv_connected = true;
+                record_conn_params(conn, &desc);
+                conn_params_request(hid_control, conn);
+                reconnect_link_up(adv_phase);
+                boot_done(BOOT_HOST_CONNECTED);
+            }
         }
         MODLOG_DFLT(INFO, "\n");
+        // Keep accepting further hosts while there is room.
+        if (has_free_conn(hid_control)) {
+            begin_advertise(hid_control);
+        }
 
         return 0;
 
@@ -135,11 +260,23 @@ int gap_handler(struct ble_gap_event *event, void *arg) {
         MODLOG_DFLT(INFO, "disconnect; reason=%04X ", event->disconnect.reason);
         bleprph_print_conn_desc(&event->disconnect.conn);
         MODLOG_DFLT(INFO, "\n");
-        // Subscribe event also should happen on unsubscribing so not required
-        // to reset flags here?
-        hid_control->is_indicatable = false;
-        hid_control->is_notifiable = false;
-        hid_control->conn = 0;
+        // Only this host's entry goes away; the others stay connected.
+        conn = hid_control_find_conn(hid_control,
+                                     event->disconnect.conn.conn_handle);
+        if (conn != NULL) {
+            conn->in_use = false;
+            conn->is_indicatable = false;
+            conn->is_notifiable = false;
+            conn->abs_is_indicatable = false;
+            conn->abs_is_notifiable = false;
+            conn->key_is_indicatable = false;
+            conn->key_is_notifiable = false;
+            hid_report_reset_credits(hid_control, conn);
+            reconnect_link_lost(&event->disconnect.conn.peer_id_addr);
+            // Start over, so this host gets directed advertising first
+            // even while another slot is advertised for slowly.
+            ble_gap_adv_stop();
+        }
         /* Connection terminated; resume advertising. */
         begin_advertise(hid_control);
         return 0;
@@ -150,18 +287,28 @@ int gap_handler(struct ble_gap_event *event, void *arg) {
                     event->conn_update.status);
         rc = ble_gap_conn_find(event->conn_update.conn_handle, &desc);
         assert(rc == 0);
-        hid_control->conn = event->conn_update.conn_handle;
+        conn = hid_control_find_conn(hid_control, desc.conn_handle);
+        if (conn != NULL) {
+            record_conn_params(conn, &desc);
+        }
         bleprph_print_conn_desc(&desc);
         MODLOG_DFLT(INFO, "\n");
         return 0;
 
     case BLE_GAP_EVENT_ADV_COMPLETE:
-        MODLOG_DFLT(INFO, "advertise complete; reason=%d",
+        MODLOG_DFLT(INFO, "advertise complete; reason=%d\n",
                     event->adv_complete.reason);
-        // Not restarting automatically by commenting out next line, but we may
-        // start advertising again after this state.
-        // begin_advertise();
-        ble_gap_adv_stop();
+        // Unless it ended in a connection, whose handler advertises again
+        // itself, the phase is over: go on with the next one. Some stacks
+        // report a timeout as reason 0, so the reason is not looked at.
+        // Slow advertising never times out, but is restarted if something
+        // else ended it, so a free slot is always advertised for.
+        if (!adv_connected && !ble_gap_adv_active() &&
+            has_free_conn(hid_control)) {
+            advertise_from(hid_control, adv_phase == RECONNECT_SLOW
+                                            ? RECONNECT_SLOW
+                                            : adv_phase + 1);
+        }
         return 0;
 
     case BLE_GAP_EVENT_ENC_CHANGE:
@@ -172,11 +319,28 @@ int gap_handler(struct ble_gap_event *event, void *arg) {
         assert(rc == 0);
         bleprph_print_conn_desc(&desc);
         MODLOG_DFLT(INFO, "\n");
+        // Some hosts only accept parameter updates on an encrypted link.
+        conn = hid_control_find_conn(hid_control, desc.conn_handle);
+        if (event->enc_change.status == 0 && conn != NULL) {
+            conn_params_request(hid_control, conn);
+        }
         return 0;
 
     case BLE_GAP_EVENT_SUBSCRIBE:
-        hid_control->is_notifiable = event->subscribe.cur_notify;
-        hid_control->is_indicatable = event->subscribe.cur_indicate;
+        conn = hid_control_find_conn(hid_control, event->subscribe.conn_handle);
+        if (conn != NULL &&
+            event->subscribe.attr_handle == report_handle) {
+            conn->is_notifiable = event->subscribe.cur_notify;
+            conn->is_indicatable = event->subscribe.cur_indicate;
+        } else if (conn != NULL &&
+                   event->subscribe.attr_handle == abs_report_handle) {
+            conn->abs_is_notifiable = event->subscribe.cur_notify;
+            conn->abs_is_indicatable = event->subscribe.cur_indicate;
+        } else if (conn != NULL &&
+                   event->subscribe.attr_handle == key_report_handle) {
+            conn->key_is_notifiable = event->subscribe.cur_notify;
+            conn->key_is_indicatable = event->subscribe.cur_indicate;
+        }
         rc = ble_gap_conn_find(event->subscribe.conn_handle, &desc);
         bleprph_print_conn_desc(&desc);
         MODLOG_DFLT(INFO, "\n");
@@ -190,7 +354,17 @@ int gap_handler(struct ble_gap_event *event, void *arg) {
         return 0;
 
     case BLE_GAP_EVENT_NOTIFY_TX:
-        MODLOG_DFLT(INFO, "notify event; detail omit");
+        // Service Changed and other indications hold no report credit.
+        if (event->notify_tx.attr_handle != report_handle &&
+            event->notify_tx.attr_handle != abs_report_handle &&
+            event->notify_tx.attr_handle != key_report_handle) {
+            return 0;
+        }
+        conn = hid_control_find_conn(hid_control, event->notify_tx.conn_handle);
+        if (conn != NULL) {
+            hid_report_tx_done(hid_control, conn, event->notify_tx.status,
+                               event->notify_tx.indication);
+        }
         return 0;
     case BLE_GAP_EVENT_MTU:
         MODLOG_DFLT(INFO, "mtu update event; conn_handle=%d cid=%d mtu=%d\n",
@@ -121,12 +121,75 @@ static const struct ble_gatt_svc_def gatt_svr_svcs[] = {
                              .uuid = &gatt_characteristic_report_descriptor.u,
                              .att_flags = BLE_ATT_F_READ,
                              .access_cb = report_descriptor_cb,
+                             .arg = HID_REPORT_REFERENCE(
+                                 MOUSE_REPORT_ID, HID_REPORT_TYPE_INPUT),
                              .min_key_size = 0,
                          },
                          {
                              0 /* No more descriptors */
                          }}
                 },
+                {/* Characteristic: Report, absolute pointer */
+                 .uuid = &gatt_characteristic_report.u,
+                 .access_cb = abs_report_cb,
+                 .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_READ_ENC |
+                          BLE_GATT_CHR_F_NOTIFY | BLE_GATT_CHR_F_INDICATE,
+                 .val_handle = &abs_report_handle,
+                 .descriptors =
+                     (struct ble_gatt_dsc_def[]){
+                         {
+                             .uuid = &gatt_characteristic_report_descriptor.u,
+                             .att_flags = BLE_ATT_F_READ,
+                             .access_cb = report_descriptor_cb,
+                             .arg = HID_REPORT_REFERENCE(
+                                 ABS_REPORT_ID, HID_REPORT_TYPE_INPUT),
+                             .min_key_size = 0,
+                         },
+                         {
+                             0 /* No more descriptors */
+                         }}
+                },
+                {/* Characteristic: Report, keyboard */
+                 .uuid = &gatt_characteristic_report.u,
+                 .access_cb = key_report_cb,
+                 .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_READ_ENC |
+                          BLE_GATT_CHR_F_NOTIFY | BLE_GATT_CHR_F_INDICATE,
+                 .val_handle = &key_report_handle,
+                 .descriptors =
+                     (struct ble_gatt_dsc_def[]){
+                         {
+                             .uuid = &gatt_characteristic_report_descriptor.u,
+                             .att_flags = BLE_ATT_F_READ,
+                             .access_cb = report_descriptor_cb,
+                             .arg = HID_REPORT_REFERENCE(
+                                 KEYBOARD_REPORT_ID, HID_REPORT_TYPE_INPUT),
+                             .min_key_size = 0,
+                         },
+                         {
+                             0 /* No more descriptors */
+                         }}
+                },
+#ifdef CONFIG_BLE_HID_HIGH_RES_REPORT
+                {/* Characteristic: Report, mouse feature */
+                 .uuid = &gatt_characteristic_report.u,
+                 .access_cb = wheel_multiplier_cb,
+                 .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_READ_ENC |
+                          BLE_GATT_CHR_F_WRITE | BLE_GATT_CHR_F_WRITE_ENC,
+                 .descriptors =
+                     (struct ble_gatt_dsc_def[]){
+                         {
+                             .uuid = &gatt_characteristic_report_descriptor.u,
+                             .att_flags = BLE_ATT_F_READ,
+                             .access_cb = report_descriptor_cb,
+                             .arg = HID_REPORT_REFERENCE(
+                                 MOUSE_REPORT_ID, HID_REPORT_TYPE_FEATURE),
+                             .min_key_size = 0,
+                         },
+                         {
+                             0 /* No more descriptors */
+                         }}
+                },
+#endif
                 {
                     /* Characteristic: Boot Mouse Report */
                     .uuid = &gatt_characteristic_boot_mouse_report.u,
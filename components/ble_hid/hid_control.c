@@ -0,0 +1,25 @@
+#include "ble_hid_component.h"
+#include "hid_service.h"
+
+void init_hid_control(hid_control_t *control) {
+    init_hid_control_internal(control);
+}
+
+hid_conn_t *hid_control_find_conn(hid_control_t *control,
+                                  uint16_t conn_handle) {
+    for (int i = 0; i < HID_MAX_CONNECTIONS; i++) {
+        hid_conn_t *conn = &control->conns[i];
+        if (conn->in_use && conn->conn == conn_handle) {
+            return conn;
+        }
+    }
+    return NULL;
+}
+
+bool hid_conn_is_subscribed(const hid_conn_t *conn) {
+    return conn->in_use && (conn->is_notifiable || conn->is_indicatable ||
+                            conn->abs_is_notifiable ||
+                            conn->abs_is_indicatable ||
+                            conn->key_is_notifiable ||
+                            conn->key_is_indicatable);
+}
@@ -0,0 +1,730 @@
+#include "hid_dispatcher.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+#include "hid_latency.h"
+#include "hid_service.h"
+#include "key_packer.h"
+#include "keyboard_input.h"
+#include "mouse_buttons.h"
+#include "sdkconfig.h"
+#include "trace.h"
+
+// Flush period used until the link reports its connection interval.
+#define DEFAULT_FLUSH_PERIOD_MS 15
+
+// Delivery acks waiting for their event to be sent.
+#define PENDING_ACKS_LEN 8
+
+typedef struct {
+    // Bit per hid_control_t.conns entry the event still has to be sent on.
+    uint32_t waiting;
+    // Sequence number of the event in each entry's coalescer.
+    uint32_t input_seq[HID_MAX_CONNECTIONS];
+    // Latest send time over the entries done so far, 0 while none succeeded.
+    int64_t delivered_us;
+    int fd;
+    uint32_t session;
+    uint16_t frame_id;
+} pending_ack_t;
+
+// Pending motion for one entry of hid_control_t.conns.
+typedef struct {
+    mouse_coalescer_t coalescer;
+    // Buttons held by commands, merged into every report.
+    mouse_buttons_t buttons;
+    // Connection the motion is for.
+    uint16_t conn;
+    bool active;
+    // Every credit of the connection is in use; nothing is sent until one
+    // returns.
+    bool stalled;
+    TickType_t last_flush;
+    // When the oldest unsent input reached the coalescer, 0 when empty.
+    int64_t pending_since_us;
+    // When a producer received the oldest unsent input, 0 when unknown.
+    int64_t pending_received_us;
+    // Text being typed, paced like the motion but on its own report.
+    key_packer_t keys;
+    bool keys_stalled;
+    TickType_t last_key_flush;
+} dispatch_slot_t;
+
+typedef struct {
+    hid_control_t *hid_control;
+    hid_ack_handler_t ack_handler;
+    hid_input_tap_t input_tap;
+    SemaphoreHandle_t input_ready;
+    SemaphoreHandle_t keys_ready;
+    SemaphoreHandle_t credit_returned;
+    // Wakes the task on new input, new key strokes or a returned credit,
+    // whichever is first.
+    QueueSetHandle_t wake_set;
+    // Taken from keyboard_input, waiting for room in a packer it targets.
+    key_stroke_t held_key;
+    bool holding_key;
+    dispatch_slot_t slots[HID_MAX_CONNECTIONS];
+    pending_ack_t pending_acks[PENDING_ACKS_LEN];
+    uint8_t pending_acks_head;
+    uint8_t pending_acks_count;
+    hid_dispatcher_stats_t stats;
+} hid_dispatcher_t;
+
+static hid_dispatcher_t dispatcher;
+
+static void send_ack(const pending_ack_t *ack) {
+    if (dispatcher.ack_handler != NULL) {
+        dispatcher.ack_handler(ack->fd, ack->session, ack->frame_id,
+                               ack->delivered_us);
+    }
+}
+
+static pending_ack_t *pending_ack_at(uint8_t index) {
+    return &dispatcher.pending_acks[(dispatcher.pending_acks_head + index) %
+                                    PENDING_ACKS_LEN];
+}
+
+static void pop_pending_ack(void) {
+    send_ack(pending_ack_at(0));
+    dispatcher.pending_acks_head =
+        (dispatcher.pending_acks_head + 1) % PENDING_ACKS_LEN;
+    dispatcher.pending_acks_count--;
+}
+
+/**
+ * Report acks in order once their event is out on every targeted host.
+ */
+static void release_acks(void) {
+    while (dispatcher.pending_acks_count > 0 &&
+           pending_ack_at(0)->waiting == 0) {
+        pop_pending_ack();
+    }
+}
+
+/**
+ * One report is flushed per BLE connection event. Sending faster only piles up
+ * behind the link, so inputs arriving in between are summed instead.
+ */
+static TickType_t flush_period_ticks(const hid_conn_t *conn) {
+    uint32_t period_ms = DEFAULT_FLUSH_PERIOD_MS;
+    if (conn->conn_itvl != 0) {
+        // Interval is in 1.25ms units.
+        period_ms = (conn->conn_itvl * 5 + 3) / 4;
+    }
+    TickType_t ticks = pdMS_TO_TICKS(period_ms);
+    return ticks > 0 ? ticks : 1;
+}
+
+static TickType_t shortest_flush_period(void) {
+    TickType_t shortest = pdMS_TO_TICKS(DEFAULT_FLUSH_PERIOD_MS);
+    for (int i = 0; i < HID_MAX_CONNECTIONS; i++) {
+        if (dispatcher.slots[i].active) {
+            TickType_t period =
+                flush_period_ticks(&dispatcher.hid_control->conns[i]);
+            if (period < shortest) {
+                shortest = period;
+            }
+        }
+    }
+    return shortest > 0 ? shortest : 1;
+}
+
+static TickType_t ticks_until(int64_t at_us) {
+    int64_t wait_us = at_us - esp_timer_get_time();
+    if (wait_us <= 0) {
+        return 0;
+    }
+    // Rounded up, so the time has come once the wait is over.
+    TickType_t ticks = pdMS_TO_TICKS((wait_us + 999) / 1000);
+    return ticks > 0 ? ticks : 1;
+}
+
+/**
+ * Ticks left of period since last, 0 once it is over.
+ */
+static TickType_t period_left(TickType_t now, TickType_t last,
+                              TickType_t period) {
+    TickType_t elapsed = now - last;
+    return elapsed < period ? period - elapsed : 0;
+}
+
+/**
+ * Ticks until a stalled sender may try again: when the oldest notification
+ * in flight has had its connection event. A confirmed indication wakes the
+ * task through credit_returned instead.
+ */
+static TickType_t stalled_wait(hid_conn_t *conn) {
+    int64_t due_us = hid_report_credit_due_us(conn);
+    return due_us == INT64_MAX ? portMAX_DELAY : ticks_until(due_us);
+}
+
+static TickType_t next_flush_wait(void) {
+    TickType_t wait = portMAX_DELAY;
+    TickType_t now = xTaskGetTickCount();
+    for (int i = 0; i < HID_MAX_CONNECTIONS; i++) {
+        dispatch_slot_t *slot = &dispatcher.slots[i];
+        hid_conn_t *conn = &dispatcher.hid_control->conns[i];
+        TickType_t period = flush_period_ticks(conn);
+        if (slot->active && !key_packer_is_idle(&slot->keys)) {
+            TickType_t key_wait =
+                slot->keys_stalled
+                    ? stalled_wait(conn)
+                    : period_left(now, slot->last_key_flush, period);
+            if (key_wait < wait) {
+                wait = key_wait;
+            }
+        }
+        // A button change due while motion is pending goes in at its flush.
+        int64_t button_us = mouse_buttons_next_us(&slot->buttons);
+        if (slot->active && button_us != INT64_MAX &&
+            mouse_coalescer_is_empty(&slot->coalescer)) {
+            TickType_t button_wait = ticks_until(button_us);
+            if (button_wait < wait) {
+                wait = button_wait;
+            }
+        }
+        if (!slot->active || mouse_coalescer_is_empty(&slot->coalescer)) {
+            continue;
+        }
+        TickType_t slot_wait = slot->stalled
+                                   ? stalled_wait(conn)
+                                   : period_left(now, slot->last_flush, period);
+        if (slot_wait < wait) {
+            wait = slot_wait;
+        }
+    }
+    return wait;
+}
+
+static bool any_stalled(void) {
+    for (int i = 0; i < HID_MAX_CONNECTIONS; i++) {
+        const dispatch_slot_t *slot = &dispatcher.slots[i];
+        if (slot->active && (slot->stalled || slot->keys_stalled)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Follow connects and disconnects. Motion pending for a host that went away
+ * is thrown away rather than sent to whoever gets its entry next.
+ */
+static void sync_slots(void) {
+    for (int i = 0; i < HID_MAX_CONNECTIONS; i++) {
+        hid_conn_t *conn = &dispatcher.hid_control->conns[i];
+        dispatch_slot_t *slot = &dispatcher.slots[i];
+        bool active = hid_conn_is_subscribed(conn);
+        if (slot->active && (!active || conn->conn != slot->conn)) {
+            mouse_coalescer_discard(&slot->coalescer);
+            // The next host starts with every button up.
+            mouse_buttons_init(&slot->buttons, CONFIG_BLE_HID_CLICK_HOLD_MS,
+                               CONFIG_BLE_HID_DOUBLE_CLICK_GAP_MS);
+            slot->pending_since_us = 0;
+            slot->pending_received_us = 0;
+            slot->stalled = false;
+            // Keys held down are released by the disconnect itself.
+            key_packer_init(&slot->keys);
+            slot->keys_stalled = false;
+            for (uint8_t k = 0; k < dispatcher.pending_acks_count; k++) {
+                pending_ack_at(k)->waiting &= ~(1u << i);
+            }
+        }
+        slot->active = active;
+        slot->conn = conn->conn;
+    }
+    release_acks();
+}
+
+typedef enum {
+    WAKE_INPUT,
+    WAKE_KEYS,
+    WAKE_CREDIT,
+    WAKE_TIMEOUT,
+    // Woken for input that an earlier drain already took.
+    WAKE_SPURIOUS,
+} wake_reason_t;
+
+/**
+ * Take queued input, or block until input, key strokes or a returned
+ * credit, or until wait runs out. On WAKE_INPUT the event has been read
+ * into mouse_ev.
+ */
+static wake_reason_t wait_for_input(TickType_t wait,
+                                    mouse_notification_t *mouse_ev) {
+    // Credits first, or input that never pauses keeps a stalled slot
+    // waiting.
+    if (xSemaphoreTake(dispatcher.credit_returned, 0) == pdTRUE) {
+        return WAKE_CREDIT;
+    }
+    if (mouse_input_take(mouse_ev)) {
+        return WAKE_INPUT;
+    }
+    QueueSetMemberHandle_t member =
+        xQueueSelectFromSet(dispatcher.wake_set, wait);
+    if (member == dispatcher.input_ready) {
+        xSemaphoreTake(dispatcher.input_ready, 0);
+        return mouse_input_take(mouse_ev) ? WAKE_INPUT : WAKE_SPURIOUS;
+    }
+    if (member == dispatcher.keys_ready) {
+        xSemaphoreTake(dispatcher.keys_ready, 0);
+        return WAKE_KEYS;
+    }
+    if (member == dispatcher.credit_returned) {
+        xSemaphoreTake(dispatcher.credit_returned, 0);
+        return WAKE_CREDIT;
+    }
+    return WAKE_TIMEOUT;
+}
+
+static uint32_t target_mask(uint8_t target) {
+    uint32_t mask = 0;
+    for (int i = 0; i < HID_MAX_CONNECTIONS; i++) {
+        if (dispatcher.slots[i].active &&
+            (target == MOUSE_TARGET_ALL || target == i + 1)) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+}
+
+static void add_pending_ack(const mouse_notification_t *mouse_ev,
+                            uint32_t mask) {
+    if (dispatcher.pending_acks_count == PENDING_ACKS_LEN) {
+        // Acks are best effort; report the oldest as dropped.
+        pending_ack_at(0)->delivered_us = 0;
+        pop_pending_ack();
+    }
+    pending_ack_t *ack = pending_ack_at(dispatcher.pending_acks_count);
+    ack->waiting = mask;
+    ack->delivered_us = 0;
+    ack->fd = mouse_ev->ack_fd;
+    ack->session = mouse_ev->ack_session;
+    ack->frame_id = mouse_ev->ack_id;
+    for (int i = 0; i < HID_MAX_CONNECTIONS; i++) {
+        ack->input_seq[i] = dispatcher.slots[i].coalescer.stats.inputs;
+    }
+    dispatcher.pending_acks_count++;
+    // Without a target the event is already done, as dropped.
+    release_acks();
+}
+
+/**
+ * Hand queued key strokes to the packer of every host they target, in the
+ * order typed. A stroke waits in held_key while one of them is full.
+ */
+static void take_keys(void) {
+    while (dispatcher.holding_key ||
+           keyboard_input_take(&dispatcher.held_key)) {
+        const key_stroke_t *stroke = &dispatcher.held_key;
+        uint32_t mask = target_mask(stroke->target);
+        dispatcher.holding_key = true;
+        for (int i = 0; i < HID_MAX_CONNECTIONS; i++) {
+            if ((mask & (1u << i)) != 0 &&
+                !key_packer_has_room(&dispatcher.slots[i].keys)) {
+                return;
+            }
+        }
+        for (int i = 0; i < HID_MAX_CONNECTIONS; i++) {
+            if ((mask & (1u << i)) != 0) {
+                key_packer_add(&dispatcher.slots[i].keys, stroke->usage,
+                               stroke->modifiers);
+            }
+        }
+        if (mask == 0) {
+            dispatcher.stats.keys_no_target++;
+        }
+        dispatcher.holding_key = false;
+    }
+}
+
+/**
+ * Hand the button changes due by now_us to the coalescer, each as an input
+ * without motion so that it starts a report of its own. Returns false while
+ * one is due but the coalescer has no room for it.
+ */
+static bool apply_due_buttons(dispatch_slot_t *slot, int64_t now_us) {
+    uint8_t state;
+    while (mouse_buttons_due(&slot->buttons, now_us, &state)) {
+        if (!mouse_coalescer_has_room(&slot->coalescer, state, false)) {
+            return false;
+        }
+        mouse_coalescer_add(&slot->coalescer, state, 0, 0, 0);
+        mouse_buttons_pop(&slot->buttons);
+        if (slot->pending_since_us == 0) {
+            slot->pending_since_us = now_us;
+        }
+    }
+    return true;
+}
+
+static void apply_all_due_buttons(void) {
+    int64_t now_us = esp_timer_get_time();
+    for (int i = 0; i < HID_MAX_CONNECTIONS; i++) {
+        if (dispatcher.slots[i].active) {
+            apply_due_buttons(&dispatcher.slots[i], now_us);
+        }
+    }
+}
+
+/**
+ * Buttons the report carrying mouse_ev has on slot: those held by commands,
+ * with the event's own for one without a command.
+ */
+static uint8_t event_buttons(const dispatch_slot_t *slot,
+                             const mouse_notification_t *mouse_ev) {
+    if (mouse_ev->button_action == MOUSE_BUTTON_MOMENTARY) {
+        return slot->buttons.state | mouse_ev->button;
+    }
+    return mouse_buttons_preview(&slot->buttons, mouse_ev->button_action,
+                                 mouse_ev->button);
+}
+
+/**
+ * Hand mouse_ev to the coalescer of every host it targets.
+ * Returns false without taking it when one of them has no room.
+ */
+static bool coalesce_event(const mouse_notification_t *mouse_ev) {
+    uint32_t mask = target_mask(mouse_ev->target);
+    int64_t now_us = esp_timer_get_time();
+    for (int i = 0; i < HID_MAX_CONNECTIONS; i++) {
+        dispatch_slot_t *slot = &dispatcher.slots[i];
+        if ((mask & (1u << i)) == 0) {
+            continue;
+        }
+        // Changes that fell due come before the event.
+        if (!apply_due_buttons(slot, now_us) ||
+            !mouse_buttons_has_room(&slot->buttons,
+                                    mouse_ev->button_action) ||
+            !mouse_coalescer_has_room(&slot->coalescer,
+                                      event_buttons(slot, mouse_ev),
+                                      mouse_ev->absolute)) {
+            return false;
+        }
+    }
+
+    for (int i = 0; i < HID_MAX_CONNECTIONS; i++) {
+        dispatch_slot_t *slot = &dispatcher.slots[i];
+        if ((mask & (1u << i)) == 0) {
+            continue;
+        }
+        uint8_t button = event_buttons(slot, mouse_ev);
+        if (mouse_ev->button_action != MOUSE_BUTTON_MOMENTARY) {
+            uint8_t state;
+            mouse_buttons_command(&slot->buttons, mouse_ev->button_action,
+                                  mouse_ev->button, mouse_ev->hold_ms,
+                                  mouse_ev->gap_ms, now_us);
+            // A change due right away goes out with the event's motion.
+            if (mouse_buttons_due(&slot->buttons, now_us, &state)) {
+                mouse_buttons_pop(&slot->buttons);
+            }
+        }
+        if (mouse_ev->absolute) {
+            mouse_coalescer_add_absolute(&slot->coalescer, button,
+                                         mouse_ev->abs_x, mouse_ev->abs_y);
+        } else {
+            mouse_coalescer_add(&slot->coalescer, button, mouse_ev->x,
+                                mouse_ev->y, mouse_ev->wheel);
+        }
+        if (slot->pending_since_us == 0) {
+            slot->pending_since_us = now_us;
+        }
+        if (slot->pending_received_us == 0 ||
+            mouse_ev->received_us < slot->pending_received_us) {
+            slot->pending_received_us = mouse_ev->received_us;
+        }
+    }
+    if (mouse_ev->received_us != 0) {
+        hid_latency_record(HID_STAGE_QUEUE, now_us - mouse_ev->received_us);
+    }
+    if (mask == 0) {
+        dispatcher.stats.dropped_no_target++;
+    }
+    if (dispatcher.input_tap != NULL) {
+        dispatcher.input_tap(mouse_ev, now_us);
+    }
+    if (mouse_ev->ack_fd != 0) {
+        add_pending_ack(mouse_ev, mask);
+    }
+    return true;
+}
+
+/**
+ * Mark acks done on slot_index up to what its coalescer has delivered, sent
+ * at delivered_us.
+ */
+static void note_delivered(int slot_index, int64_t delivered_us) {
+    const mouse_coalescer_t *coalescer =
+        &dispatcher.slots[slot_index].coalescer;
+    uint32_t bit = 1u << slot_index;
+    for (uint8_t k = 0; k < dispatcher.pending_acks_count; k++) {
+        pending_ack_t *ack = pending_ack_at(k);
+        if ((ack->waiting & bit) == 0 ||
+            (int32_t)(coalescer->delivered - ack->input_seq[slot_index]) < 0) {
+            continue;
+        }
+        ack->waiting &= ~bit;
+        if (delivered_us > ack->delivered_us) {
+            ack->delivered_us = delivered_us;
+        }
+    }
+    release_acks();
+}
+
+/**
+ * Merge mouse_ev and everything already queued behind it.
+ * Returns false if an event has to wait for the coalescer to make room,
+ * leaving it in mouse_ev.
+ */
+static bool coalesce_queued(mouse_notification_t *mouse_ev) {
+    do {
+        if (!coalesce_event(mouse_ev)) {
+            return false;
+        }
+        // Straight from the lanes: going through the wake set here would
+        // swallow a returned credit a stalled slot is waiting for.
+    } while (mouse_input_take(mouse_ev));
+    return true;
+}
+
+static void record_latency(dispatch_slot_t *slot, int64_t now_us) {
+    hid_dispatcher_stats_t *stats = &dispatcher.stats;
+    uint32_t latency_us = now_us - slot->pending_since_us;
+    stats->latency_count++;
+    stats->latency_total_us += latency_us;
+    if (latency_us > stats->latency_max_us) {
+        stats->latency_max_us = latency_us;
+    }
+    hid_latency_record(HID_STAGE_COALESCE, latency_us);
+    // A remainder left in the coalescer waits from now on, but its inputs
+    // were still received back then.
+    if (mouse_coalescer_is_empty(&slot->coalescer)) {
+        slot->pending_since_us = 0;
+        slot->pending_received_us = 0;
+    } else {
+        slot->pending_since_us = now_us;
+    }
+}
+
+/**
+ * Send the next report to every host whose connection event is due. Each
+ * host has its own credits, so one waiting for an indication confirmation
+ * does not hold back the others. A report the link refuses stays in the
+ * coalescer and goes out, merged with whatever follows, next time.
+ */
+static void flush_due_slots(void) {
+    TickType_t now = xTaskGetTickCount();
+    mouse_coalescer_report_t report;
+
+    for (int i = 0; i < HID_MAX_CONNECTIONS; i++) {
+        dispatch_slot_t *slot = &dispatcher.slots[i];
+        hid_conn_t *conn = &dispatcher.hid_control->conns[i];
+        if (!slot->active || mouse_coalescer_is_empty(&slot->coalescer)) {
+            continue;
+        }
+        if (!slot->stalled &&
+            now - slot->last_flush < flush_period_ticks(conn)) {
+            continue;
+        }
+        // The host may have switched its wheel resolution since the last
+        // report.
+        int32_t axis_max, wheel_per_unit;
+        hid_report_resolution(conn, &axis_max, &wheel_per_unit);
+        mouse_coalescer_set_resolution(&slot->coalescer, axis_max,
+                                       wheel_per_unit);
+        if (!mouse_coalescer_peek(&slot->coalescer, &report)) {
+            // Only wheel short of a report unit was pending; it waits in
+            // the carry without costing the host a report.
+            mouse_coalescer_pop(&slot->coalescer, &report);
+            slot->stalled = false;
+            slot->pending_since_us = 0;
+            slot->pending_received_us = 0;
+            note_delivered(i, esp_timer_get_time());
+            continue;
+        }
+        slot->stalled = !hid_report_can_send_internal(
+            conn, report.absolute ? ABS_REPORT_ID : MOUSE_REPORT_ID);
+        if (slot->stalled) {
+            // Link is backed up; keep merging until a report completes.
+            continue;
+        }
+        int rc;
+        if (report.absolute) {
+            TRACE_D(TRACE_DISPATCH_PLACE, i + 1, report.abs_x, report.abs_y,
+                    0);
+            rc = send_absolute_event_internal(conn, report.button,
+                                              report.abs_x, report.abs_y,
+                                              slot->pending_received_us);
+        } else {
+            TRACE_D(TRACE_DISPATCH_MOVE, i + 1, report.x, report.y,
+                    slot->coalescer.stats.last_merged);
+            rc = send_mouse_event_internal(conn, report.button, report.x,
+                                           report.y, report.wheel,
+                                           slot->pending_received_us);
+        }
+        slot->last_flush = now;
+        if (rc != 0) {
+            continue;
+        }
+        mouse_coalescer_pop(&slot->coalescer, &report);
+        int64_t now_us = esp_timer_get_time();
+        record_latency(slot, now_us);
+        note_delivered(i, now_us);
+    }
+}
+
+/**
+ * Send the next keyboard report to every host typing text whose connection
+ * event is due. A report the link refuses is built again next time, so no
+ * key is lost or typed twice.
+ */
+static void flush_due_keys(void) {
+    TickType_t now = xTaskGetTickCount();
+    key_packer_report_t report;
+
+    for (int i = 0; i < HID_MAX_CONNECTIONS; i++) {
+        dispatch_slot_t *slot = &dispatcher.slots[i];
+        hid_conn_t *conn = &dispatcher.hid_control->conns[i];
+        if (!slot->active || key_packer_is_idle(&slot->keys)) {
+            continue;
+        }
+        if (!slot->keys_stalled &&
+            now - slot->last_key_flush < flush_period_ticks(conn)) {
+            continue;
+        }
+        slot->keys_stalled =
+            !hid_report_can_send_internal(conn, KEYBOARD_REPORT_ID);
+        if (slot->keys_stalled) {
+            continue;
+        }
+        key_packer_next(&slot->keys, &report);
+        TRACE_D(TRACE_DISPATCH_KEYS, i + 1, report.modifiers, report.keys[0],
+                report.strokes);
+        if (send_keyboard_event_internal(conn, report.modifiers,
+                                         report.keys) == 0) {
+            key_packer_sent(&slot->keys, &report);
+            dispatcher.stats.key_reports++;
+        }
+        slot->last_key_flush = now;
+    }
+}
+
+static void hid_dispatcher_task(void *pvParameters) {
+    hid_dispatcher_stats_t *stats = &dispatcher.stats;
+    mouse_notification_t mouse_ev;
+    // mouse_ev is waiting for a coalescer to make room. Delays never get
+    // here: producers hand events that must wait to mouse_scheduler.
+    bool holding = false;
+
+    while (1) {
+        sync_slots();
+        take_keys();
+        if (holding && coalesce_event(&mouse_ev)) {
+            holding = false;
+            continue;
+        }
+
+        TickType_t wait = next_flush_wait();
+        if (!holding) {
+            wake_reason_t reason = wait_for_input(wait, &mouse_ev);
+            if (reason == WAKE_INPUT) {
+                stats->wakes_input++;
+                // A host may have subscribed while the task slept; its
+                // first event must not go to the slots as they were.
+                sync_slots();
+                holding = !coalesce_queued(&mouse_ev);
+                // Input that never pauses must not hold back a due report.
+                if (holding || next_flush_wait() > 0) {
+                    continue;
+                }
+            } else if (reason == WAKE_KEYS) {
+                stats->wakes_input++;
+            } else if (reason == WAKE_SPURIOUS) {
+                continue;
+            } else if (reason == WAKE_CREDIT) {
+                stats->wakes_credit++;
+                if (!any_stalled()) {
+                    // Not waiting for it; keep pacing by the interval.
+                    continue;
+                }
+            } else {
+                stats->wakes_timer++;
+            }
+        } else {
+            // Input stays in the lanes behind the held event, but key
+            // strokes and credits still wake the task, so other hosts and
+            // typing go on meanwhile.
+            if (wait == portMAX_DELAY) {
+                // Waiting for room that a button change due later makes.
+                wait = shortest_flush_period();
+            }
+            QueueSetMemberHandle_t member =
+                xQueueSelectFromSet(dispatcher.wake_set, wait);
+            if (member == NULL) {
+                stats->wakes_timer++;
+            } else {
+                // For input only a wake up; the events are taken from the
+                // lanes once the held one is in.
+                xSemaphoreTake(member, 0);
+                if (member == dispatcher.credit_returned) {
+                    stats->wakes_credit++;
+                } else {
+                    stats->wakes_input++;
+                }
+            }
+        }
+
+        sync_slots();
+        take_keys();
+        apply_all_due_buttons();
+        flush_due_slots();
+        flush_due_keys();
+    }
+}
+
+void hid_dispatcher_register_ack_handler(hid_ack_handler_t handler) {
+    dispatcher.ack_handler = handler;
+}
+
+void hid_dispatcher_register_input_tap(hid_input_tap_t tap) {
+    dispatcher.input_tap = tap;
+}
+
+void start_hid_dispatcher(hid_control_t *hid_control) {
+    dispatcher.hid_control = hid_control;
+    dispatcher.input_ready = mouse_input_wake_semaphore();
+    dispatcher.keys_ready = keyboard_input_wake_semaphore();
+    dispatcher.credit_returned = xSemaphoreCreateBinary();
+    for (int i = 0; i < HID_MAX_CONNECTIONS; i++) {
+        mouse_coalescer_init(&dispatcher.slots[i].coalescer);
+        mouse_buttons_init(&dispatcher.slots[i].buttons,
+                           CONFIG_BLE_HID_CLICK_HOLD_MS,
+                           CONFIG_BLE_HID_DOUBLE_CLICK_GAP_MS);
+        key_packer_init(&dispatcher.slots[i].keys);
+    }
+
+    // Every member is a binary semaphore.
+    dispatcher.wake_set = xQueueCreateSet(3);
+    xQueueAddToSet(dispatcher.input_ready, dispatcher.wake_set);
+    xQueueAddToSet(dispatcher.keys_ready, dispatcher.wake_set);
+    xQueueAddToSet(dispatcher.credit_returned, dispatcher.wake_set);
+    hid_control->credit_returned = dispatcher.credit_returned;
+
+    BaseType_t core = CONFIG_HID_DISPATCHER_CORE < 0
+                          ? tskNO_AFFINITY
+                          : CONFIG_HID_DISPATCHER_CORE;
+    xTaskCreatePinnedToCore(&hid_dispatcher_task, "hid_dispatcher", 5000,
+                            NULL, CONFIG_HID_DISPATCHER_PRIORITY, NULL,
+                            core);
+}
+
+const hid_dispatcher_stats_t *hid_dispatcher_get_stats(void) {
+    return &dispatcher.stats;
+}
+
+const mouse_coalescer_stats_t *
+hid_dispatcher_get_coalescer_stats(uint8_t target) {
+    if (target < 1 || target > HID_MAX_CONNECTIONS) {
+        return NULL;
+    }
+    return &dispatcher.slots[target - 1].coalescer.stats;
+}
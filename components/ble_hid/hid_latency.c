@@ -0,0 +1,38 @@
+#include "hid_latency.h"
+
+static latency_histogram_t stages[HID_STAGE_COUNT];
+
+void hid_latency_record(hid_stage_t stage, int64_t latency_us) {
+    // Clocks are the same esp_timer, but stay safe against odd stamps.
+    if (latency_us < 0) {
+        latency_us = 0;
+    } else if (latency_us > UINT32_MAX) {
+        latency_us = UINT32_MAX;
+    }
+    latency_histogram_record(&stages[stage], latency_us);
+}
+
+const latency_histogram_t *hid_latency_get(hid_stage_t stage) {
+    return &stages[stage];
+}
+
+const char *hid_latency_stage_name(hid_stage_t stage) {
+    switch (stage) {
+    case HID_STAGE_QUEUE:
+        return "queue";
+    case HID_STAGE_COALESCE:
+        return "coalesce";
+    case HID_STAGE_LINK:
+        return "link";
+    case HID_STAGE_TOTAL:
+        return "total";
+    default:
+        return "unknown";
+    }
+}
+
+void hid_latency_reset(void) {
+    for (int i = 0; i < HID_STAGE_COUNT; i++) {
+        latency_histogram_reset(&stages[i]);
+    }
+}
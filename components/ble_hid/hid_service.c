@@ -1,14 +1,18 @@
 #include "hid_service.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
 #include "gatt_handler.h"
+#include "hid_latency.h"
 #include "host/ble_att.h"
 #include "host/ble_hs.h"
+#include "trace.h"
+#include <stdatomic.h>
 #include <stdint.h>
+#include <string.h>
 
 #define HID_TAG "hidservice"
 
-#define MOUSE_REPORT_ID 0x01
-
 // HID service and some HOGP requested services' impl
 
 // static struct mouse_report_t {
@@ -18,10 +22,85 @@
 //     int8_t wheel;
 // } mouse_report;
 
-uint8_t mouse_report_buffer[4];
+// Set by init_hid_control_internal so GATT callbacks can find the entry of
+// the connection they serve.
+static hid_control_t *hid_control_ref = NULL;
+
+// Only the dispatcher task writes reports, but report_cb reads the last one
+// from the NimBLE host task. The writer fills the buffer not being published
+// and then bumps the generation, so a reader never sees a half-written
+// report.
+static void publish_report(hid_report_buffer_t *buffer, const uint8_t *report,
+                           size_t len) {
+    unsigned int generation =
+        atomic_load_explicit(&buffer->generation, memory_order_relaxed);
+    unsigned int next = generation + 1;
+    memcpy(buffer->data[next & 1], report, len);
+    atomic_store_explicit(&buffer->generation, next, memory_order_release);
+}
+
+static void read_report(hid_report_buffer_t *buffer, uint8_t *report,
+                        size_t len) {
+    unsigned int generation;
+    do {
+        generation =
+            atomic_load_explicit(&buffer->generation, memory_order_acquire);
+        memcpy(report, buffer->data[generation & 1], len);
+        // Retry if the writer came round to this buffer during the copy.
+    } while (atomic_load_explicit(&buffer->generation, memory_order_acquire) !=
+             generation);
+}
 
 // HID Report Map characteristic value
 static const uint8_t hidReportMap[] = {
+#ifdef CONFIG_BLE_HID_HIGH_RES_REPORT
+    0x05, 0x01,            // Usage Page (Generic Desktop)
+    0x09, 0x02,            // Usage (Mouse)
+    0xA1, 0x01,            // Collection (Application)
+    0x85, MOUSE_REPORT_ID,  // Report Id (1)
+    0x09, 0x01,            //   Usage (Pointer)
+    0xA1, 0x00,            //   Collection (Physical)
+    0x05, 0x09,            //     Usage Page (Buttons)
+    0x19, 0x01,            //     Usage Minimum (01) - Button 1
+    0x29, 0x03,            //     Usage Maximum (03) - Button 3
+    0x15, 0x00,            //     Logical Minimum (0)
+    0x25, 0x01,            //     Logical Maximum (1)
+    0x75, 0x01,            //     Report Size (1)
+    0x95, 0x03,            //     Report Count (3)
+    0x81, 0x02,            //     Input (Data, Variable, Absolute)
+    0x75, 0x05,            //     Report Size (5)
+    0x95, 0x01,            //     Report Count (1)
+    0x81, 0x01,            //     Input (Constant) - Padding
+    0x05, 0x01,            //     Usage Page (Generic Desktop)
+    0x09, 0x30,            //     Usage (X)
+    0x09, 0x31,            //     Usage (Y)
+    0x16, 0x01, 0x80,      //     Logical Minimum (-32767)
+    0x26, 0xFF, 0x7F,      //     Logical Maximum (32767)
+    0x75, 0x10,            //     Report Size (16)
+    0x95, 0x02,            //     Report Count (2)
+    0x81, 0x06,            //     Input (Data, Variable, Relative)
+    0xA1, 0x02,            //     Collection (Logical)
+    0x09, 0x48,            //       Usage (Resolution Multiplier)
+    0x15, 0x00,            //       Logical Minimum (0)
+    0x25, 0x01,            //       Logical Maximum (1)
+    0x35, 0x01,            //       Physical Minimum (1)
+    0x45, 0x78,            //       Physical Maximum (120)
+    0x75, 0x02,            //       Report Size (2)
+    0x95, 0x01,            //       Report Count (1)
+    0xB1, 0x02,            //       Feature (Data, Variable, Absolute)
+    0x75, 0x06,            //       Report Size (6)
+    0xB1, 0x01,            //       Feature (Constant) - Padding
+    0x09, 0x38,            //       Usage (Wheel)
+    0x35, 0x00,            //       Physical Minimum (0)
+    0x45, 0x00,            //       Physical Maximum (0)
+    0x16, 0x01, 0x80,      //       Logical Minimum (-32767)
+    0x26, 0xFF, 0x7F,      //       Logical Maximum (32767)
+    0x75, 0x10,            //       Report Size (16)
+    0x81, 0x06,            //       Input (Data, Variable, Relative)
+    0xC0,                  //     End Collection
+    0xC0,                  //   End Collection
+    0xC0,                  // End Collection
+#else
     0x05, 0x01,            // Usage Page (Generic Desktop)
     0x09, 0x02,            // Usage (Mouse)
     0xA1, 0x01,            // Collection (Application)
@@ -50,6 +129,60 @@ static const uint8_t hidReportMap[] = {
     0x81, 0x06,            //     Input (Data, Variable, Relative)
     0xC0,                  //   End Collection
     0xC0,                  // End Collection
+#endif
+    // Absolute pointer, placing the cursor at a fraction of the screen
+    // regardless of host pointer acceleration.
+    0x05, 0x01,            // Usage Page (Generic Desktop)
+    0x09, 0x02,            // Usage (Mouse)
+    0xA1, 0x01,            // Collection (Application)
+    0x85, ABS_REPORT_ID,   // Report Id (2)
+    0x09, 0x01,            //   Usage (Pointer)
+    0xA1, 0x00,            //   Collection (Physical)
+    0x05, 0x09,            //     Usage Page (Buttons)
+    0x19, 0x01,            //     Usage Minimum (01) - Button 1
+    0x29, 0x03,            //     Usage Maximum (03) - Button 3
+    0x15, 0x00,            //     Logical Minimum (0)
+    0x25, 0x01,            //     Logical Maximum (1)
+    0x75, 0x01,            //     Report Size (1)
+    0x95, 0x03,            //     Report Count (3)
+    0x81, 0x02,            //     Input (Data, Variable, Absolute)
+    0x75, 0x05,            //     Report Size (5)
+    0x95, 0x01,            //     Report Count (1)
+    0x81, 0x01,            //     Input (Constant) - Padding
+    0x05, 0x01,            //     Usage Page (Generic Desktop)
+    0x09, 0x30,            //     Usage (X)
+    0x09, 0x31,            //     Usage (Y)
+    0x16, 0x00, 0x00,      //     Logical Minimum (0)
+    0x26, 0xFF, 0x7F,      //     Logical Maximum (32767)
+    0x75, 0x10,            //     Report Size (16)
+    0x95, 0x02,            //     Report Count (2)
+    0x81, 0x02,            //     Input (Data, Variable, Absolute)
+    0xC0,                  //   End Collection
+    0xC0,                  // End Collection
+    // Keyboard, typing the text of /keyboard/type on the same host.
+    0x05, 0x01,            // Usage Page (Generic Desktop)
+    0x09, 0x06,            // Usage (Keyboard)
+    0xA1, 0x01,            // Collection (Application)
+    0x85, KEYBOARD_REPORT_ID, // Report Id (3)
+    0x05, 0x07,            //   Usage Page (Keyboard/Keypad)
+    0x19, 0xE0,            //   Usage Minimum (Left Control)
+    0x29, 0xE7,            //   Usage Maximum (Right GUI)
+    0x15, 0x00,            //   Logical Minimum (0)
+    0x25, 0x01,            //   Logical Maximum (1)
+    0x75, 0x01,            //   Report Size (1)
+    0x95, 0x08,            //   Report Count (8)
+    0x81, 0x02,            //   Input (Data, Variable, Absolute) - Modifiers
+    0x75, 0x08,            //   Report Size (8)
+    0x95, 0x01,            //   Report Count (1)
+    0x81, 0x01,            //   Input (Constant) - Reserved
+    0x19, 0x00,            //   Usage Minimum (0)
+    0x29, 0x65,            //   Usage Maximum (101)
+    0x15, 0x00,            //   Logical Minimum (0)
+    0x25, 0x65,            //   Logical Maximum (101)
+    0x75, 0x08,            //   Report Size (8)
+    0x95, HID_KEYBOARD_KEYS, //   Report Count (6)
+    0x81, 0x00,            //   Input (Data, Array) - Keys
+    0xC0,                  // End Collection
 };
 
 /**
@@ -68,36 +201,98 @@ int report_map_cb(uint16_t conn_handle, uint16_t attr_handle,
     return rc == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
 }
 
+static hid_conn_t *find_conn(uint16_t conn_handle) {
+    if (hid_control_ref == NULL) {
+        return NULL;
+    }
+    return hid_control_find_conn(hid_control_ref, conn_handle);
+}
+
 int report_cb(uint16_t conn_handle, uint16_t attr_handle,
               struct ble_gatt_access_ctxt *ctxt, void *arg) {
     // This is also used for boot mouse report.
     // Somehow in the HIDS spec, it has to support WRITE property.
     // But doing same as read seems to work.
-    uint16_t uuid16 = ble_uuid_u16(ctxt->chr->uuid);
-    ESP_LOGD(HID_TAG, "UUID 0x%04X attr 0x%04X arg %d op %d", uuid16,
-             attr_handle, (int)arg, ctxt->op);
-    for (int i = 0; i < 4; i++) {
-        ESP_LOGD(HID_TAG, "M: 0x%02x", mouse_report_buffer[i]);
+    uint8_t report[HID_MOUSE_REPORT_LEN] = {0};
+    hid_conn_t *conn = find_conn(conn_handle);
+    if (conn != NULL) {
+        read_report(&conn->mouse_report, report, sizeof report);
     }
-    int rc = os_mbuf_append(ctxt->om, &mouse_report_buffer,
-                            sizeof mouse_report_buffer);
-    ESP_LOGD(HID_TAG, "Report event done with result code: %d", rc);
+    int rc = os_mbuf_append(ctxt->om, report, sizeof report);
+    TRACE_D(TRACE_REPORT_READ, conn_handle, report[0], rc, 0);
 
     return rc == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
 }
 
-static const uint8_t reportDescriptor[] = {
-    MOUSE_REPORT_ID, 0x01 // report type Input
-};
+int abs_report_cb(uint16_t conn_handle, uint16_t attr_handle,
+                  struct ble_gatt_access_ctxt *ctxt, void *arg) {
+    uint8_t report[HID_ABS_REPORT_LEN] = {0};
+    hid_conn_t *conn = find_conn(conn_handle);
+    if (conn != NULL) {
+        read_report(&conn->abs_report, report, sizeof report);
+    }
+    int rc = os_mbuf_append(ctxt->om, report, sizeof report);
+    return rc == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+}
+
+int key_report_cb(uint16_t conn_handle, uint16_t attr_handle,
+                  struct ble_gatt_access_ctxt *ctxt, void *arg) {
+    uint8_t report[HID_KEYBOARD_REPORT_LEN] = {0};
+    hid_conn_t *conn = find_conn(conn_handle);
+    if (conn != NULL) {
+        read_report(&conn->key_report, report, sizeof report);
+    }
+    int rc = os_mbuf_append(ctxt->om, report, sizeof report);
+    return rc == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+}
+
+/**
+ * Feature report of the mouse: the Resolution Multiplier, which the host
+ * writes to switch the wheel to 1/120 detents.
+ */
+int wheel_multiplier_cb(uint16_t conn_handle, uint16_t attr_handle,
+                        struct ble_gatt_access_ctxt *ctxt, void *arg) {
+    hid_conn_t *conn = find_conn(conn_handle);
+    if (conn == NULL) {
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+    if (ctxt->op == BLE_GATT_ACCESS_OP_READ_CHR) {
+        int rc = os_mbuf_append(ctxt->om, &conn->wheel_multiplier,
+                                sizeof conn->wheel_multiplier);
+        return rc == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+    }
+    if (ctxt->op == BLE_GATT_ACCESS_OP_WRITE_CHR) {
+        uint8_t value;
+        if (OS_MBUF_PKTLEN(ctxt->om) != sizeof value) {
+            return BLE_ATT_ERR_INVAL_ATTR_VALUE_LEN;
+        }
+        os_mbuf_copydata(ctxt->om, 0, sizeof value, &value);
+        // Upper bits are padding.
+        conn->wheel_multiplier = value & 0x03;
+        ESP_LOGI(HID_TAG, "Resolution multiplier %d on %d",
+                 conn->wheel_multiplier, conn_handle);
+        return 0;
+    }
+    return BLE_ATT_ERR_REQ_NOT_SUPPORTED;
+}
 
+/**
+ * Report Reference descriptor of a Report characteristic. arg is the report
+ * id and type, as made by HID_REPORT_REFERENCE.
+ */
 int report_descriptor_cb(uint16_t conn_handle, uint16_t attr_handle,
                          struct ble_gatt_access_ctxt *ctxt, void *arg) {
     ESP_LOGI(HID_TAG, "Report descriptor read");
+    uintptr_t reference = (uintptr_t)arg;
+    const uint8_t reportDescriptor[] = {
+        reference & 0xFF, // report id
+        reference >> 8,   // report type
+    };
     int rc =
         os_mbuf_append(ctxt->om, &reportDescriptor, sizeof reportDescriptor);
 
     return rc == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
-    }
+}
 
 /**
  * @brief HID Information Charasteristic from HIDS Spec
@@ -152,32 +347,331 @@ int pnp_id_cb(uint16_t conn_handle, uint16_t attr_handle,
     return BLE_ATT_ERR_REQ_NOT_SUPPORTED;
 }
 
-void init_hid_control_internal() {}
+void init_hid_control_internal(hid_control_t *hid_control) {
+    hid_control_ref = hid_control;
+}
+
+// Guards in_flight, the stamps and the delivery counters, which the NimBLE
+// host task updates from NOTIFY_TX.
+static portMUX_TYPE credit_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Assumed until the host reports its connection interval.
+#define DEFAULT_CONN_ITVL_US 15000
+
+/**
+ * Whether a report going out as an indication, or as a notification if not,
+ * may be sent now. Credits are per connection, so a host slow to confirm an
+ * indication only holds back its own reports. Call with credit_mux held.
+ */
+static bool has_credit(const hid_conn_t *conn, bool indication) {
+    if (conn->in_flight >= CONFIG_BLE_HID_MAX_IN_FLIGHT) {
+        return false;
+    }
+    if (!indication) {
+        return true;
+    }
+    // ATT allows only one unconfirmed indication at a time, whichever
+    // report it carries.
+    for (uint8_t i = 0; i < conn->in_flight; i++) {
+        const hid_tx_stamp_t *stamp =
+            &conn->tx_stamps[(conn->tx_stamps_head + i) %
+                             CONFIG_BLE_HID_MAX_IN_FLIGHT];
+        if (stamp->indication && stamp->done_us == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Whether the report with report_id goes out as an indication: only when
+ * the host subscribed to indications and not notifications.
+ */
+static bool report_indicated(const hid_conn_t *conn, uint8_t report_id) {
+    switch (report_id) {
+    case ABS_REPORT_ID:
+        return !conn->abs_is_notifiable;
+    case KEYBOARD_REPORT_ID:
+        return !conn->key_is_notifiable;
+    default:
+        return !conn->is_notifiable;
+    }
+}
+
+static int64_t conn_itvl_us(const hid_conn_t *conn) {
+    // Interval is in 1.25ms units.
+    return conn->conn_itvl != 0 ? conn->conn_itvl * 1250
+                                : DEFAULT_CONN_ITVL_US;
+}
+
+static int rc_index(int rc) {
+    return rc >= 0 && rc < HID_DELIVERY_RC_OTHER ? rc : HID_DELIVERY_RC_OTHER;
+}
+
+static void signal_credit(hid_control_t *hid_control) {
+    if (hid_control->credit_returned != NULL) {
+        xSemaphoreGive(hid_control->credit_returned);
+    }
+}
+
+/**
+ * Take back the credit of the oldest report if the link is done with it.
+ * NimBLE raises NOTIFY_TX for a notification from within
+ * ble_gattc_notify_custom, before anything went over the air, so a
+ * notification counts as done once the connection event after it was
+ * handed over has passed; an indication once hid_report_tx_done saw it
+ * confirmed or failed. Call with credit_mux held.
+ */
+static bool release_oldest(hid_conn_t *conn, int64_t now_us,
+                           hid_tx_stamp_t *released) {
+    if (conn->in_flight == 0) {
+        return false;
+    }
+    hid_tx_stamp_t *stamp = &conn->tx_stamps[conn->tx_stamps_head];
+    int64_t due_us = stamp->sent_us + conn_itvl_us(conn);
+    if (!stamp->indication && now_us >= due_us) {
+        stamp->done_us = due_us;
+        stamp->completed = true;
+        conn->delivery.completed++;
+    }
+    if (stamp->done_us == 0) {
+        return false;
+    }
+    *released = *stamp;
+    conn->tx_stamps_head =
+        (conn->tx_stamps_head + 1) % CONFIG_BLE_HID_MAX_IN_FLIGHT;
+    conn->in_flight--;
+    return true;
+}
+
+/**
+ * Take back every credit due and record the latency of the reports they
+ * were for. Only the dispatcher task calls this, so the link and total
+ * histograms have a single writer.
+ */
+static void release_credits(hid_conn_t *conn) {
+    int64_t now_us = esp_timer_get_time();
+    hid_tx_stamp_t stamp;
+    bool released;
+    do {
+        portENTER_CRITICAL(&credit_mux);
+        released = release_oldest(conn, now_us, &stamp);
+        portEXIT_CRITICAL(&credit_mux);
+        if (released && stamp.completed) {
+            hid_latency_record(HID_STAGE_LINK, stamp.done_us - stamp.sent_us);
+            if (stamp.received_us != 0) {
+                hid_latency_record(HID_STAGE_TOTAL,
+                                   stamp.done_us - stamp.received_us);
+            }
+        }
+    } while (released);
+}
+
+bool hid_report_can_send_internal(hid_conn_t *conn, uint8_t report_id) {
+    bool available;
+    release_credits(conn);
+    portENTER_CRITICAL(&credit_mux);
+    available = has_credit(conn, report_indicated(conn, report_id));
+    if (!available) {
+        conn->delivery.stalls++;
+    }
+    portEXIT_CRITICAL(&credit_mux);
+    return available;
+}
+
+int64_t hid_report_credit_due_us(hid_conn_t *conn) {
+    int64_t due_us = INT64_MAX;
+    portENTER_CRITICAL(&credit_mux);
+    const hid_tx_stamp_t *stamp = &conn->tx_stamps[conn->tx_stamps_head];
+    if (conn->in_flight > 0 && !stamp->indication) {
+        due_us = stamp->sent_us + conn_itvl_us(conn);
+    }
+    portEXIT_CRITICAL(&credit_mux);
+    return due_us;
+}
+
+void hid_report_tx_done(hid_control_t *hid_control, hid_conn_t *conn,
+                        int status, bool indication) {
+    // For a notification NOTIFY_TX only says NimBLE took it, from within the
+    // call; release_oldest times those. An indication reports 0 when sent
+    // and BLE_HS_EDONE once confirmed, which the host task may do before
+    // the call returned. An indication refused within the call is left to
+    // send_report, which gets the same status as rc; it is only sent while
+    // no other is unconfirmed, so no other failure can be reported
+    // meanwhile.
+    if (!indication || status == 0 ||
+        (status != BLE_HS_EDONE && atomic_load(&conn->indicating))) {
+        return;
+    }
+    bool completed = status == BLE_HS_EDONE;
+    int64_t now_us = esp_timer_get_time();
+    portENTER_CRITICAL(&credit_mux);
+    // Indications are confirmed in the order sent.
+    for (uint8_t i = 0; i < conn->in_flight; i++) {
+        hid_tx_stamp_t *stamp =
+            &conn->tx_stamps[(conn->tx_stamps_head + i) %
+                             CONFIG_BLE_HID_MAX_IN_FLIGHT];
+        if (stamp->indication && stamp->done_us == 0) {
+            stamp->done_us = now_us;
+            stamp->completed = completed;
+            break;
+        }
+    }
+    if (completed) {
+        conn->delivery.completed++;
+    } else {
+        conn->delivery.tx_errors++;
+        conn->delivery.tx_errors_by_rc[rc_index(status)]++;
+    }
+    portEXIT_CRITICAL(&credit_mux);
+    signal_credit(hid_control);
+}
+
+void hid_report_reset_credits(hid_control_t *hid_control, hid_conn_t *conn) {
+    portENTER_CRITICAL(&credit_mux);
+    conn->in_flight = 0;
+    conn->tx_stamps_head = 0;
+    portEXIT_CRITICAL(&credit_mux);
+    signal_credit(hid_control);
+}
 
-int send_mouse_event_internal(hid_control_t *hid_control, uint8_t mouse_button,
-                              int8_t mickeys_x, int8_t mickeys_y,
-                              int8_t wheel) {
-    ESP_LOGD(HID_TAG, "Notify event");
-    // mouse_report.button = mouse_button;
-    // mouse_report.x = mickeys_x;
-    // mouse_report.y = mickeys_y;
-    // mouse_report.wheel = wheel;
+void hid_report_init_conn(hid_conn_t *conn, uint16_t conn_handle) {
+    portENTER_CRITICAL(&credit_mux);
+    memset(conn, 0, sizeof *conn);
+    conn->conn = conn_handle;
+    conn->in_use = true;
+    portEXIT_CRITICAL(&credit_mux);
+}
 
-    mouse_report_buffer[0] = mouse_button; // Buttons
-    mouse_report_buffer[1] = mickeys_x;    // X
-    mouse_report_buffer[2] = mickeys_y;    // Y
-    mouse_report_buffer[3] = wheel;        // Wheel
+/**
+ * Send report on the characteristic at handle against the connection's
+ * credits, keeping a copy in buffer for reads once it is sent.
+ */
+static int send_report(hid_conn_t *conn, uint16_t handle, bool notifiable,
+                       bool indicatable, hid_report_buffer_t *buffer,
+                       const uint8_t *report, size_t len,
+                       int64_t received_us) {
+    if (!conn->in_use || (!notifiable && !indicatable)) {
+        return BLE_HS_ENOTCONN;
+    }
+
+    release_credits(conn);
+    hid_tx_stamp_t stamp = {.sent_us = esp_timer_get_time(),
+                            .received_us = received_us,
+                            .indication = !notifiable};
+    portENTER_CRITICAL(&credit_mux);
+    bool available = has_credit(conn, stamp.indication);
+    if (available) {
+        conn->tx_stamps[(conn->tx_stamps_head + conn->in_flight) %
+                        CONFIG_BLE_HID_MAX_IN_FLIGHT] = stamp;
+        conn->in_flight++;
+    } else {
+        conn->delivery.stalls++;
+    }
+    portEXIT_CRITICAL(&credit_mux);
+    if (!available) {
+        return BLE_HS_EBUSY;
+    }
 
-    int rc = 0;
-    // Indicate is prefered because host can make response.
-    if (hid_control->is_indicatable) {
-        rc = ble_gattc_indicate(hid_control->conn, report_handle);
-    } else if (hid_control->is_notifiable) {
-        rc = ble_gattc_notify(hid_control->conn, report_handle);
+    // The report travels in its own mbuf, so NimBLE never reads the shared
+    // buffer after this returns.
+    int rc;
+    struct os_mbuf *om = ble_hs_mbuf_from_flat(report, len);
+    if (om == NULL) {
+        rc = BLE_HS_ENOMEM;
+    } else if (notifiable) {
+        // Notifications need no ATT confirmation, so several can be in
+        // flight per connection event. Indicate only for hosts that demand
+        // it.
+        rc = ble_gattc_notify_custom(conn->conn, handle, om);
+    } else {
+        atomic_store(&conn->indicating, true);
+        rc = ble_gattc_indicate_custom(conn->conn, handle, om);
+        atomic_store(&conn->indicating, false);
     }
 
-    if (rc) {
-        ESP_LOGE(HID_TAG, "Notify Error. Function: %s", __FUNCTION__);
+    portENTER_CRITICAL(&credit_mux);
+    if (rc == 0) {
+        conn->delivery.sent++;
+    } else {
+        // The only place a refused report is counted: hid_report_tx_done
+        // skips the NOTIFY_TX raised for it. Its stamp is the newest, and
+        // only this task takes stamps off, so dropping the count drops it.
+        if (conn->in_flight > 0) {
+            conn->in_flight--;
+        }
+        conn->delivery.dropped++;
+        conn->delivery.dropped_by_rc[rc_index(rc)]++;
+    }
+    portEXIT_CRITICAL(&credit_mux);
+    // A read sees what the host was last sent, not a report it never got.
+    if (rc == 0) {
+        publish_report(buffer, report, len);
     }
     return rc;
 }
+
+void hid_report_resolution(const hid_conn_t *conn, int32_t *axis_max,
+                           int32_t *wheel_per_unit) {
+#ifdef CONFIG_BLE_HID_HIGH_RES_REPORT
+    *axis_max = INT16_MAX;
+    *wheel_per_unit = conn->wheel_multiplier ? 1 : MOUSE_WHEEL_RESOLUTION;
+#else
+    *axis_max = INT8_MAX;
+    *wheel_per_unit = MOUSE_WHEEL_RESOLUTION;
+#endif
+}
+
+int send_mouse_event_internal(hid_conn_t *conn, uint8_t mouse_button,
+                              int16_t mickeys_x, int16_t mickeys_y,
+                              int16_t wheel, int64_t received_us) {
+    TRACE_D(TRACE_REPORT_SEND, conn->conn, mickeys_x, mickeys_y, wheel);
+#ifdef CONFIG_BLE_HID_HIGH_RES_REPORT
+    uint16_t x = mickeys_x, y = mickeys_y, w = wheel;
+    uint8_t report[HID_MOUSE_REPORT_LEN] = {
+        mouse_button, // Buttons
+        x & 0xFF,     // X, little endian
+        x >> 8,       //
+        y & 0xFF,     // Y, little endian
+        y >> 8,       //
+        w & 0xFF,     // Wheel, little endian
+        w >> 8,       //
+    };
+#else
+    uint8_t report[HID_MOUSE_REPORT_LEN] = {
+        mouse_button,       // Buttons
+        (uint8_t)mickeys_x, // X
+        (uint8_t)mickeys_y, // Y
+        (uint8_t)wheel,     // Wheel
+    };
+#endif
+    return send_report(conn, report_handle, conn->is_notifiable,
+                       conn->is_indicatable, &conn->mouse_report, report,
+                       sizeof report, received_us);
+}
+
+int send_absolute_event_internal(hid_conn_t *conn, uint8_t mouse_button,
+                                 uint16_t x, uint16_t y, int64_t received_us) {
+    uint8_t report[HID_ABS_REPORT_LEN] = {
+        mouse_button, // Buttons
+        x & 0xFF,     // X, little endian
+        x >> 8,       //
+        y & 0xFF,     // Y, little endian
+        y >> 8,       //
+    };
+    return send_report(conn, abs_report_handle, conn->abs_is_notifiable,
+                       conn->abs_is_indicatable, &conn->abs_report, report,
+                       sizeof report, received_us);
+}
+
+int send_keyboard_event_internal(hid_conn_t *conn, uint8_t modifiers,
+                                 const uint8_t keys[HID_KEYBOARD_KEYS]) {
+    uint8_t report[HID_KEYBOARD_REPORT_LEN] = {
+        modifiers, // Modifiers
+        0,         // Reserved
+    };
+    memcpy(&report[2], keys, HID_KEYBOARD_KEYS);
+    return send_report(conn, key_report_handle, conn->key_is_notifiable,
+                       conn->key_is_indicatable, &conn->key_report, report,
+                       sizeof report, 0);
+}
@@ -1,19 +1,138 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "nimble/ble.h"
+#include "sdkconfig.h"
+#include <stdatomic.h>
+#include <stdbool.h>
 
 #ifndef BLE_HID_COMPONENT_H
 #define BLE_HID_COMPONENT_H
 
+// Return codes told apart in hid_delivery_stats_t. The BLE_HS_E* codes fit;
+// everything from HID_DELIVERY_RC_OTHER on shares the last entry.
+#define HID_DELIVERY_RC_OTHER 32
+
+typedef struct {
+    // Reports handed to NimBLE, and those the link finished with.
+    uint32_t sent;
+    uint32_t completed;
+    // Send attempts while all credits were in use.
+    uint32_t stalls;
+    // Reports NimBLE refused to queue.
+    uint32_t dropped;
+    // Queued reports that failed or were never confirmed.
+    uint32_t tx_errors;
+    // dropped by the rc of ble_gattc_notify_custom/indicate_custom, and
+    // tx_errors by the NOTIFY_TX status.
+    uint32_t dropped_by_rc[HID_DELIVERY_RC_OTHER + 1];
+    uint32_t tx_errors_by_rc[HID_DELIVERY_RC_OTHER + 1];
+} hid_delivery_stats_t;
+
+// One entry per central NimBLE can be connected to at once.
+#define HID_MAX_CONNECTIONS CONFIG_BT_NIMBLE_MAX_CONNECTIONS
+
+#ifdef CONFIG_BLE_HID_HIGH_RES_REPORT
+// Buttons, 16 bit X, Y and wheel.
+#define HID_MOUSE_REPORT_LEN 7
+#else
+// Buttons, 8 bit X, Y and wheel.
+#define HID_MOUSE_REPORT_LEN 4
+#endif
+// Absolute pointer: buttons, 16 bit X and Y.
+#define HID_ABS_REPORT_LEN 5
+// Keys one keyboard report holds down at once.
+#define HID_KEYBOARD_KEYS 6
+// Keyboard: modifiers, reserved, HID_KEYBOARD_KEYS keys.
+#define HID_KEYBOARD_REPORT_LEN (2 + HID_KEYBOARD_KEYS)
+#define HID_REPORT_MAX_LEN HID_KEYBOARD_REPORT_LEN
+
+// Times of a report in flight, for the latency histograms.
+typedef struct {
+    // Handed to NimBLE.
+    int64_t sent_us;
+    // Oldest input in it received by a producer, 0 if unknown.
+    int64_t received_us;
+    // When the link was done with it, 0 while it is not.
+    int64_t done_us;
+    bool indication;
+    // Done by arriving, rather than by failing.
+    bool completed;
+} hid_tx_stamp_t;
+
+// Last report sent on one characteristic, double buffered so report_cb can
+// read it while the next one is written.
+typedef struct {
+    uint8_t data[2][HID_REPORT_MAX_LEN];
+    atomic_uint generation;
+} hid_report_buffer_t;
+
 typedef struct {
+    // Entry belongs to a live connection. Written by the NimBLE host task
+    // only.
+    bool in_use;
     bool is_notifiable;
     bool is_indicatable;
+    // Same for the absolute pointer report.
+    bool abs_is_notifiable;
+    bool abs_is_indicatable;
+    // Same for the keyboard report.
+    bool key_is_notifiable;
+    bool key_is_indicatable;
     // gap connection handle
-    uint16_t conn;   
+    uint16_t conn;
+    // connection parameters granted by the host
+    // interval in 1.25ms units
+    uint16_t conn_itvl;
+    uint16_t conn_latency;
+    // supervision timeout in 10ms units
+    uint16_t supervision_timeout;
+    // Resolution Multiplier feature as set by the host. 1 when it takes the
+    // wheel in 1/120 detents, 0 for whole detents.
+    uint8_t wheel_multiplier;
+    // Reports handed to NimBLE whose credit has not come back: notifications
+    // until a connection interval has passed, indications until confirmed.
+    uint8_t in_flight;
+    // Stamps of those reports in send order, from tx_stamps_head. Credits
+    // come back in the same order.
+    hid_tx_stamp_t tx_stamps[CONFIG_BLE_HID_MAX_IN_FLIGHT];
+    uint8_t tx_stamps_head;
+    // The dispatcher is inside ble_gattc_indicate_custom, which raises
+    // NOTIFY_TX itself for an indication it refuses. Read by the NimBLE host
+    // task.
+    atomic_bool indicating;
+    hid_delivery_stats_t delivery;
+    hid_report_buffer_t mouse_report;
+    hid_report_buffer_t abs_report;
+    hid_report_buffer_t key_report;
+} hid_conn_t;
+
+typedef struct {
+    hid_conn_t conns[HID_MAX_CONNECTIONS];
+    // conn_profile_t requested from every host
+    uint8_t conn_profile;
+    // Optional, given whenever a credit comes back so a stalled sender can
+    // wake up.
+    SemaphoreHandle_t credit_returned;
 } hid_control_t;
 
+/**
+ * Initialize NVS and start the NimBLE host. Returns without waiting for the
+ * host to sync; BOOT_BLE_SYNCED is set, and advertising starts, when it
+ * does.
+ */
 void init_ble_hid(hid_control_t *control);
 
-void init_hid_control();
+void init_hid_control(hid_control_t *control);
+
+/**
+ * Entry of a live connection, or NULL.
+ */
+hid_conn_t *hid_control_find_conn(hid_control_t *control,
+                                  uint16_t conn_handle);
 
-int send_mouse_event(hid_control_t *hid_control, uint8_t mouse_button, int8_t mickeys_x, int8_t mickeys_y, int8_t wheel);
+/**
+ * Whether the host enabled notifications or indications on any report.
+ */
+bool hid_conn_is_subscribed(const hid_conn_t *conn);
 
 #endif // BLE_HID_COMPONENT_H
\ No newline at end of file
@@ -0,0 +1,39 @@
+#ifndef CONN_PARAMS_H
+#define CONN_PARAMS_H
+
+#include "ble_hid_component.h"
+#include "esp_err.h"
+
+typedef enum {
+    // 7.5ms interval, or 11.25ms for hosts refusing the minimum.
+    CONN_PROFILE_LOW_LATENCY = 0,
+    // 15-30ms interval.
+    CONN_PROFILE_BALANCED,
+    // 30-50ms interval, skipping up to 4 events while idle.
+    CONN_PROFILE_LOW_POWER,
+    CONN_PROFILE_COUNT,
+} conn_profile_t;
+
+/**
+ * Ask the host on conn for the active profile's parameters. Called after
+ * connect and after encryption is enabled.
+ */
+void conn_params_request(hid_control_t *hid_control, hid_conn_t *conn);
+
+/**
+ * Make profile active and request it right away from every connected host.
+ * What each host grants shows up in its hid_conn_t on CONN_UPDATE.
+ */
+esp_err_t conn_params_set_profile(hid_control_t *hid_control,
+                                  conn_profile_t profile);
+
+/**
+ * Same as conn_params_set_profile, by name as returned from
+ * conn_params_profile_name. ESP_ERR_NOT_FOUND for unknown names.
+ */
+esp_err_t conn_params_set_profile_by_name(hid_control_t *hid_control,
+                                          const char *name);
+
+const char *conn_params_profile_name(conn_profile_t profile);
+
+#endif // CONN_PARAMS_H
@@ -8,5 +8,7 @@ void gatt_svr_register_cb(struct ble_gatt_register_ctxt *ctxt, void *arg);
 esp_err_t init_gatts_server(void);
 
 uint16_t report_handle;
+uint16_t abs_report_handle;
+uint16_t key_report_handle;
 
 #endif // GATT_HANDLER_H
\ No newline at end of file
@@ -0,0 +1,69 @@
+#ifndef HID_DISPATCHER_H
+#define HID_DISPATCHER_H
+
+#include "ble_hid_component.h"
+#include "freertos/FreeRTOS.h"
+#include "mouse_coalescer.h"
+#include "mouse_input.h"
+#include <stdint.h>
+
+typedef struct {
+    // Time from the first input of a report reaching the dispatcher until the
+    // report is handed to NimBLE.
+    uint32_t latency_count;
+    uint64_t latency_total_us;
+    uint32_t latency_max_us;
+    // Wake ups of the dispatcher task, by reason.
+    uint32_t wakes_input;
+    uint32_t wakes_credit;
+    uint32_t wakes_timer;
+    // Events whose target host was not connected.
+    uint32_t dropped_no_target;
+    // Key strokes whose target host was not connected.
+    uint32_t keys_no_target;
+    // Keyboard reports sent, over every host.
+    uint32_t key_reports;
+} hid_dispatcher_stats_t;
+
+/**
+ * Called from the dispatcher task once the event carrying ack_fd/ack_id is
+ * sent to every host it targets. delivered_us is esp_timer time of the last
+ * one, 0 if the event was dropped everywhere. session is the event's
+ * ack_session, handed back as is.
+ */
+typedef void (*hid_ack_handler_t)(int fd, uint32_t session, uint16_t ack_id,
+                                  int64_t delivered_us);
+
+void hid_dispatcher_register_ack_handler(hid_ack_handler_t handler);
+
+/**
+ * Called from the dispatcher task with every event it takes on, when it
+ * takes it. Must not block.
+ */
+typedef void (*hid_input_tap_t)(const mouse_notification_t *event,
+                                int64_t now_us);
+
+void hid_dispatcher_register_input_tap(hid_input_tap_t tap);
+
+/**
+ * Start the task that turns mouse_notification_t from every mouse_input lane
+ * (HTTP, websocket, UDP, UART) and the strokes of keyboard_input into
+ * reports. mouse_input_init and keyboard_input_init must have run.
+ * It owns the report state and is the only task sending reports, so
+ * producers never touch NimBLE. Each connected host gets its own coalescer,
+ * pacing and credits; mouse_notification_t.target picks one of them or all.
+ * Priority and core come from CONFIG_HID_DISPATCHER_PRIORITY and
+ * CONFIG_HID_DISPATCHER_CORE.
+ */
+void start_hid_dispatcher(hid_control_t *hid_control);
+
+const hid_dispatcher_stats_t *hid_dispatcher_get_stats(void);
+
+/**
+ * Coalescer stats of one host, numbered like mouse_notification_t.target.
+ * NULL for numbers beyond HID_MAX_CONNECTIONS.
+ */
+const mouse_coalescer_stats_t *
+hid_dispatcher_get_coalescer_stats(uint8_t target);
+
+#endif // HID_DISPATCHER_H
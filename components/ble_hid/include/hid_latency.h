@@ -0,0 +1,38 @@
+#ifndef HID_LATENCY_H
+#define HID_LATENCY_H
+
+#include "latency_histogram.h"
+#include <stdint.h>
+
+// Stages an event passes from a producer to the host, each with its own
+// histogram.
+typedef enum {
+    // Producer received the event until the dispatcher took it.
+    HID_STAGE_QUEUE = 0,
+    // Dispatcher took it until its report was handed to NimBLE.
+    HID_STAGE_COALESCE,
+    // Report handed to NimBLE until the link is done with it: the host
+    // confirmed an indication, or a notification's connection event passed.
+    HID_STAGE_LINK,
+    // Producer received the oldest event of a report until the link is done
+    // with it.
+    HID_STAGE_TOTAL,
+    HID_STAGE_COUNT,
+} hid_stage_t;
+
+/**
+ * Every stage is recorded by the dispatcher task, link and total as it takes
+ * credits back, so each histogram has a single writer.
+ */
+void hid_latency_record(hid_stage_t stage, int64_t latency_us);
+
+const latency_histogram_t *hid_latency_get(hid_stage_t stage);
+
+const char *hid_latency_stage_name(hid_stage_t stage);
+
+/**
+ * Clear every histogram. Samples recorded meanwhile may survive.
+ */
+void hid_latency_reset(void);
+
+#endif // HID_LATENCY_H
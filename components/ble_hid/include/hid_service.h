@@ -1,5 +1,20 @@
 #include "ble_hid_component.h"
 #include "host/ble_gatt.h"
+#include "mouse_notification.h"
+#include <stdint.h>
+
+// Report ids in the report map, one Report characteristic each.
+#define MOUSE_REPORT_ID 0x01
+#define ABS_REPORT_ID 0x02
+#define KEYBOARD_REPORT_ID 0x03
+
+// Report types of the Report Reference descriptor.
+#define HID_REPORT_TYPE_INPUT 0x01
+#define HID_REPORT_TYPE_FEATURE 0x03
+
+// arg of report_descriptor_cb.
+#define HID_REPORT_REFERENCE(id, type)                                         \
+    ((void *)(uintptr_t)((type) << 8 | (id)))
 
 int report_map_cb(uint16_t conn_handle, uint16_t attr_handle,
                   struct ble_gatt_access_ctxt *ctxt, void *arg);
@@ -7,6 +22,15 @@ int report_map_cb(uint16_t conn_handle, uint16_t attr_handle,
 int report_cb(uint16_t conn_handle, uint16_t attr_handle,
               struct ble_gatt_access_ctxt *ctxt, void *arg);
 
+int abs_report_cb(uint16_t conn_handle, uint16_t attr_handle,
+                  struct ble_gatt_access_ctxt *ctxt, void *arg);
+
+int key_report_cb(uint16_t conn_handle, uint16_t attr_handle,
+                  struct ble_gatt_access_ctxt *ctxt, void *arg);
+
+int wheel_multiplier_cb(uint16_t conn_handle, uint16_t attr_handle,
+                        struct ble_gatt_access_ctxt *ctxt, void *arg);
+
 int hid_information_cb(uint16_t conn_handle, uint16_t attr_handle,
                        struct ble_gatt_access_ctxt *ctxt, void *arg);
 
@@ -16,8 +40,58 @@ int battery_level_cb(uint16_t conn_handle, uint16_t attr_handle,
 int report_descriptor_cb(uint16_t conn_handle, uint16_t attr_handle,
                          struct ble_gatt_access_ctxt *ctxt, void *arg);
 
-void init_hid_control_internal();
+void init_hid_control_internal(hid_control_t *hid_control);
+
+/**
+ * Take back the credits due, then tell whether one is free for the report
+ * with report_id, which goes out as its own characteristic is subscribed.
+ * Dispatcher task only.
+ */
+bool hid_report_can_send_internal(hid_conn_t *conn, uint8_t report_id);
+
+/**
+ * When the oldest credit in use comes back without further NOTIFY_TX,
+ * INT64_MAX if only a confirmation returns one.
+ */
+int64_t hid_report_credit_due_us(hid_conn_t *conn);
+
+void hid_report_tx_done(hid_control_t *hid_control, hid_conn_t *conn,
+                        int status, bool indication);
+
+void hid_report_reset_credits(hid_control_t *hid_control, hid_conn_t *conn);
+
+/**
+ * Hand the free entry conn to a new connection, cleared. The dispatcher may
+ * still be looking at the credits of the host that had it before.
+ */
+void hid_report_init_conn(hid_conn_t *conn, uint16_t conn_handle);
+
+/**
+ * Largest X/Y/wheel value one mouse report to conn carries, and how many
+ * 1/MOUSE_WHEEL_RESOLUTION detents one wheel unit of it stands for.
+ */
+void hid_report_resolution(const hid_conn_t *conn, int32_t *axis_max,
+                           int32_t *wheel_per_unit);
+
+/**
+ * Send one report to conn, in the units of hid_report_resolution. Only the
+ * HID dispatcher task may call this. received_us is when the oldest input
+ * in the report was received, for the latency histograms; 0 if unknown.
+ */
+int send_mouse_event_internal(hid_conn_t *conn, uint8_t mouse_button,
+                              int16_t mickeys_x, int16_t mickeys_y,
+                              int16_t wheel, int64_t received_us);
+
+/**
+ * Send one absolute pointer report to conn, x and y in 0..32767. Only the
+ * HID dispatcher task may call this.
+ */
+int send_absolute_event_internal(hid_conn_t *conn, uint8_t mouse_button,
+                                 uint16_t x, uint16_t y, int64_t received_us);
 
-int send_mouse_event_internal(hid_control_t *hid_control, uint8_t mouse_button,
-                               int8_t mickeys_x, int8_t mickeys_y,
-                               int8_t wheel);
\ No newline at end of file
+/**
+ * Send one keyboard report to conn: the modifiers and the keys held down,
+ * unused entries 0. Only the HID dispatcher task may call this.
+ */
+int send_keyboard_event_internal(hid_conn_t *conn, uint8_t modifiers,
+                                 const uint8_t keys[HID_KEYBOARD_KEYS]);
@@ -0,0 +1,73 @@
+#ifndef KEY_PACKER_H
+#define KEY_PACKER_H
+
+#include "ble_hid_component.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Strokes queued per host ahead of the report being sent.
+#define KEY_PACKER_LEN 32
+
+typedef struct {
+    uint8_t modifiers;
+    // Keys held down, in the order they were typed; unused entries 0.
+    uint8_t keys[HID_KEYBOARD_KEYS];
+    // Queued strokes the report types.
+    uint8_t strokes;
+} key_packer_report_t;
+
+typedef struct {
+    uint8_t usage;
+    uint8_t modifiers;
+} key_packer_stroke_t;
+
+/**
+ * Text waiting to be typed on one host, and the keys its last report left
+ * down.
+ *
+ * Each report presses the next run of up to HID_KEYBOARD_KEYS strokes and
+ * lets go of the keys of the report before it, so a host sees the presses
+ * of a run in report order and every release with the next report instead
+ * of a report of its own. A run ends at a stroke with other modifiers, a
+ * key already in the run, or a key the last report still holds, which
+ * would not register as a new press; the last case takes a report with
+ * every key up first.
+ */
+typedef struct {
+    key_packer_stroke_t strokes[KEY_PACKER_LEN];
+    uint8_t head;
+    uint8_t count;
+    // Last report sent. Its keys are down on the host.
+    key_packer_report_t held;
+} key_packer_t;
+
+/**
+ * Nothing queued, every key up.
+ */
+void key_packer_init(key_packer_t *packer);
+
+bool key_packer_has_room(const key_packer_t *packer);
+
+/**
+ * Queue one stroke. Check key_packer_has_room first.
+ */
+void key_packer_add(key_packer_t *packer, uint8_t usage, uint8_t modifiers);
+
+/**
+ * Nothing to send: nothing queued and no key left down.
+ */
+bool key_packer_is_idle(const key_packer_t *packer);
+
+/**
+ * Build the next report to send. Nothing changes until key_packer_sent,
+ * so a report the link refused is built again the next time.
+ */
+void key_packer_next(const key_packer_t *packer, key_packer_report_t *report);
+
+/**
+ * Take the strokes of report, as built by key_packer_next, off the queue
+ * once it has been sent.
+ */
+void key_packer_sent(key_packer_t *packer, const key_packer_report_t *report);
+
+#endif // KEY_PACKER_H
@@ -0,0 +1,40 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+
+// Buckets split each power of two in this many, so a bucket is at most 25%
+// wide.
+#define LATENCY_SUB_BUCKETS 4
+// Values below 2^LATENCY_MIN_SHIFT us share the first bucket, values from
+// 2^LATENCY_MAX_SHIFT us (about 4 s) the last one.
+#define LATENCY_MIN_SHIFT 4
+#define LATENCY_MAX_SHIFT 22
+#define LATENCY_BUCKETS                                                        \
+    ((LATENCY_MAX_SHIFT - LATENCY_MIN_SHIFT) * LATENCY_SUB_BUCKETS + 2)
+
+/**
+ * Fixed size log scale histogram of microsecond latencies. Recording is a
+ * few shifts, so it can sit on every hot path; one writer per histogram.
+ */
+typedef struct {
+    uint32_t buckets[LATENCY_BUCKETS];
+    uint32_t count;
+    uint32_t max_us;
+    uint64_t total_us;
+} latency_histogram_t;
+
+void latency_histogram_reset(latency_histogram_t *hist);
+
+void latency_histogram_record(latency_histogram_t *hist, uint32_t latency_us);
+
+/**
+ * Upper bound of the bucket holding the given per mille rank, e.g. 990 for
+ * p99, capped at the largest value seen. 0 while empty.
+ */
+uint32_t latency_histogram_percentile(const latency_histogram_t *hist,
+                                      uint32_t per_mille);
+
+uint32_t latency_histogram_mean(const latency_histogram_t *hist);
+
+#endif // LATENCY_HISTOGRAM_H
@@ -0,0 +1,81 @@
+#ifndef MOUSE_BUTTONS_H
+#define MOUSE_BUTTONS_H
+
+#include "mouse_notification.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// The three buttons hidReportMap declares.
+#define MOUSE_BUTTONS_MASK 0x07
+
+// Queued button changes per host; a double click takes four.
+#define MOUSE_BUTTONS_STEPS 8
+
+typedef struct {
+    // esp_timer time the change is due.
+    int64_t at_us;
+    // Buttons held from then on.
+    uint8_t state;
+} mouse_button_step_t;
+
+/**
+ * Buttons held by down/up/click/double-click commands for one host, and the
+ * timed changes still to come. Each change is sent in a report of its own;
+ * motion arriving while a state lasts is merged into that report.
+ */
+typedef struct {
+    // Buttons held as of the last applied change.
+    uint8_t state;
+    mouse_button_step_t steps[MOUSE_BUTTONS_STEPS];
+    uint8_t head;
+    uint8_t count;
+    // Defaults for clicks that leave hold_ms or gap_ms 0.
+    uint16_t default_hold_ms;
+    uint16_t default_gap_ms;
+} mouse_buttons_t;
+
+/**
+ * No buttons held, nothing queued.
+ */
+void mouse_buttons_init(mouse_buttons_t *buttons, uint16_t default_hold_ms,
+                        uint16_t default_gap_ms);
+
+/**
+ * Whether mouse_buttons_command would take a command with action.
+ */
+bool mouse_buttons_has_room(const mouse_buttons_t *buttons,
+                            mouse_button_action_t action);
+
+/**
+ * Buttons held right after mouse_buttons_command at now_us: its first change
+ * when nothing else is queued before it, otherwise the current state.
+ */
+uint8_t mouse_buttons_preview(const mouse_buttons_t *buttons,
+                              mouse_button_action_t action, uint8_t mask);
+
+/**
+ * Queue the changes of action on the buttons in mask. They start at now_us,
+ * or after the changes already queued, so commands never overlap. Returns
+ * false without queueing anything when there is no room.
+ */
+bool mouse_buttons_command(mouse_buttons_t *buttons,
+                           mouse_button_action_t action, uint8_t mask,
+                           uint16_t hold_ms, uint16_t gap_ms, int64_t now_us);
+
+/**
+ * The next change if it is due at now_us, without applying it.
+ */
+bool mouse_buttons_due(const mouse_buttons_t *buttons, int64_t now_us,
+                       uint8_t *state);
+
+/**
+ * Apply the change mouse_buttons_due returned.
+ */
+void mouse_buttons_pop(mouse_buttons_t *buttons);
+
+/**
+ * When the next change is due, INT64_MAX when none is queued.
+ */
+int64_t mouse_buttons_next_us(const mouse_buttons_t *buttons);
+
+#endif // MOUSE_BUTTONS_H
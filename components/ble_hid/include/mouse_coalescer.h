@@ -0,0 +1,134 @@
+#ifndef MOUSE_COALESCER_H
+#define MOUSE_COALESCER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Number of distinct button states that can be pending at once. Motion is only
+// merged into the newest segment when the button state is unchanged, so a
+// click followed by a move keeps its press/release reports.
+#define MOUSE_COALESCER_SEGMENTS 4
+
+// Upper bounds of the "inputs merged per report" histogram buckets. The last
+// bucket takes everything above the previous bound.
+#define MOUSE_COALESCER_HIST_BUCKETS 6
+
+typedef struct {
+    uint8_t button;
+    // x/y hold a position to move to rather than motion.
+    bool absolute;
+    int32_t x;
+    int32_t y;
+    int32_t wheel;
+    // Inputs merged into this segment since the last flushed report.
+    uint32_t inputs;
+    // Sequence number of the newest input merged into this segment.
+    uint32_t last_input;
+} mouse_coalescer_segment_t;
+
+typedef struct {
+    // Total inputs accepted by mouse_coalescer_add.
+    uint32_t inputs;
+    // Total reports produced by mouse_coalescer_pop.
+    uint32_t reports;
+    // Reports produced only because a sum exceeded the report's range.
+    uint32_t split_reports;
+    // Inputs merged into the last produced report, and the highest ever.
+    uint32_t last_merged;
+    uint32_t max_merged;
+    // Histogram of inputs merged per report: 1, 2, 3-4, 5-8, 9-16, 17+.
+    uint32_t merged_hist[MOUSE_COALESCER_HIST_BUCKETS];
+} mouse_coalescer_stats_t;
+
+typedef struct {
+    mouse_coalescer_segment_t segments[MOUSE_COALESCER_SEGMENTS];
+    uint8_t head;
+    uint8_t count;
+    // Largest value a report carries per axis, and input wheel units per
+    // report wheel unit. See mouse_coalescer_set_resolution.
+    int32_t axis_max;
+    int32_t wheel_per_unit;
+    // Wheel input too small for one report unit, added to the next segment.
+    int32_t wheel_carry;
+    // Buttons of the last report produced, 0 before the first.
+    uint8_t last_button;
+    // Sequence number of the newest input whose motion is completely sent.
+    // Inputs are numbered from 1 by stats.inputs.
+    uint32_t delivered;
+    mouse_coalescer_stats_t stats;
+} mouse_coalescer_t;
+
+typedef struct {
+    uint8_t button;
+    int16_t x;
+    int16_t y;
+    int16_t wheel;
+    // Absolute pointer report instead, at abs_x/abs_y.
+    bool absolute;
+    uint16_t abs_x;
+    uint16_t abs_y;
+} mouse_coalescer_report_t;
+
+/**
+ * Starts with 8 bit reports and the wheel passed through unscaled.
+ */
+void mouse_coalescer_init(mouse_coalescer_t *coalescer);
+
+/**
+ * Set what the next reports carry: axes up to +-axis_max, and the wheel in
+ * units of wheel_per_unit inputs. Takes effect on the next
+ * mouse_coalescer_pop, so it can follow a host changing its resolution.
+ */
+void mouse_coalescer_set_resolution(mouse_coalescer_t *coalescer,
+                                    int32_t axis_max, int32_t wheel_per_unit);
+
+/**
+ * Merge one input into the pending sums.
+ * Returns false without changing anything when a new button state would need
+ * another segment and all are in use; flush with mouse_coalescer_pop first.
+ */
+bool mouse_coalescer_add(mouse_coalescer_t *coalescer, uint8_t button,
+                         int32_t x, int32_t y, int32_t wheel);
+
+/**
+ * Move to an absolute position. Consecutive positions with the same button
+ * state replace each other, as only the last one matters.
+ * Returns false when a new segment would be needed and all are in use.
+ */
+bool mouse_coalescer_add_absolute(mouse_coalescer_t *coalescer,
+                                  uint8_t button, uint16_t x, uint16_t y);
+
+/**
+ * Whether mouse_coalescer_add, or mouse_coalescer_add_absolute when absolute
+ * is set, would take an input with this button state.
+ */
+bool mouse_coalescer_has_room(const mouse_coalescer_t *coalescer,
+                              uint8_t button, bool absolute);
+
+bool mouse_coalescer_is_empty(const mouse_coalescer_t *coalescer);
+
+/**
+ * Throw away pending motion, e.g. when its host disconnected. Stats are kept
+ * and the discarded inputs count as delivered.
+ */
+void mouse_coalescer_discard(mouse_coalescer_t *coalescer);
+
+/**
+ * Take the next report to send, at most one per connection event.
+ * Sums beyond the report's range are split over several reports so that
+ * nothing is truncated. Returns false when there is nothing to send, which
+ * also drains segments holding only wheel input short of one report unit
+ * under unchanged buttons; that input stays in the carry.
+ * Absolute positions come out as one report each.
+ */
+bool mouse_coalescer_pop(mouse_coalescer_t *coalescer,
+                         mouse_coalescer_report_t *report);
+
+/**
+ * The report mouse_coalescer_pop would take next, leaving it pending, e.g.
+ * until the link has accepted it.
+ */
+bool mouse_coalescer_peek(const mouse_coalescer_t *coalescer,
+                          mouse_coalescer_report_t *report);
+
+#endif // MOUSE_COALESCER_H
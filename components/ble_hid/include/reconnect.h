@@ -0,0 +1,65 @@
+#ifndef RECONNECT_H
+#define RECONNECT_H
+
+#include "ble_hid_component.h"
+#include "latency_histogram.h"
+#include "nimble/ble.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Advertising after a link is lost, or at start, in order. Each phase
+ * hands over to the next when it times out; the last one never does.
+ */
+typedef enum {
+    // High duty cycle directed advertising to a bonded host, 1.28 s.
+    RECONNECT_DIRECTED = 0,
+    // Undirected at 20-30 ms, limited discoverable, for 30 s.
+    RECONNECT_FAST,
+    // Undirected at 1-2.5 s, general discoverable, until a host connects.
+    RECONNECT_SLOW,
+    RECONNECT_PHASE_COUNT,
+} reconnect_phase_t;
+
+typedef struct {
+    // Times each phase started advertising, and connections it brought.
+    uint32_t advertised[RECONNECT_PHASE_COUNT];
+    uint32_t connected[RECONNECT_PHASE_COUNT];
+    // From a link loss to the next connection of any host.
+    latency_histogram_t time_to_reconnect;
+    // When the oldest loss not yet followed by a connection happened, 0 if
+    // none.
+    int64_t lost_us;
+} reconnect_stats_t;
+
+/**
+ * Pick the host for directed advertising: the bonded host whose link was
+ * lost last, else the newest bond, as long as it is not connected already.
+ * False if there is none.
+ */
+bool reconnect_directed_peer(const hid_control_t *hid_control,
+                             ble_addr_t *peer);
+
+/**
+ * Note that phase started advertising.
+ */
+void reconnect_advertising(reconnect_phase_t phase);
+
+/**
+ * A link dropped. peer is the host's identity address.
+ */
+void reconnect_link_lost(const ble_addr_t *peer);
+
+/**
+ * A host connected while advertising in phase.
+ */
+void reconnect_link_up(reconnect_phase_t phase);
+
+/**
+ * Written by the NimBLE host task only.
+ */
+const reconnect_stats_t *reconnect_get_stats(void);
+
+const char *reconnect_phase_name(reconnect_phase_t phase);
+
+#endif // RECONNECT_H
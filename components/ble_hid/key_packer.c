@@ -0,0 +1,59 @@
+#include "key_packer.h"
+#include <string.h>
+
+void key_packer_init(key_packer_t *packer) {
+    memset(packer, 0, sizeof *packer);
+}
+
+bool key_packer_has_room(const key_packer_t *packer) {
+    return packer->count < KEY_PACKER_LEN;
+}
+
+void key_packer_add(key_packer_t *packer, uint8_t usage, uint8_t modifiers) {
+    key_packer_stroke_t *stroke =
+        &packer->strokes[(packer->head + packer->count) % KEY_PACKER_LEN];
+    stroke->usage = usage;
+    stroke->modifiers = modifiers;
+    packer->count++;
+}
+
+static bool holds_key(const key_packer_report_t *report, uint8_t usage) {
+    for (int i = 0; i < HID_KEYBOARD_KEYS; i++) {
+        if (report->keys[i] == usage) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool key_packer_is_idle(const key_packer_t *packer) {
+    return packer->count == 0 && packer->held.keys[0] == 0;
+}
+
+void key_packer_next(const key_packer_t *packer, key_packer_report_t *report) {
+    memset(report, 0, sizeof *report);
+    for (uint8_t i = 0; i < packer->count && i < HID_KEYBOARD_KEYS; i++) {
+        const key_packer_stroke_t *stroke =
+            &packer->strokes[(packer->head + i) % KEY_PACKER_LEN];
+        if (i > 0 && stroke->modifiers != report->modifiers) {
+            break;
+        }
+        // Still down from the last report, or pressed earlier in this one:
+        // the host would see no new press.
+        if (holds_key(&packer->held, stroke->usage) ||
+            holds_key(report, stroke->usage)) {
+            break;
+        }
+        // The host applies the modifiers of a report before its keys, so
+        // they may change together with the keys they go with.
+        report->modifiers = stroke->modifiers;
+        report->keys[i] = stroke->usage;
+        report->strokes++;
+    }
+}
+
+void key_packer_sent(key_packer_t *packer, const key_packer_report_t *report) {
+    packer->head = (packer->head + report->strokes) % KEY_PACKER_LEN;
+    packer->count -= report->strokes;
+    packer->held = *report;
+}
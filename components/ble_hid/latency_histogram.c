@@ -0,0 +1,66 @@
+#include "latency_histogram.h"
+#include <string.h>
+
+// log2 of LATENCY_SUB_BUCKETS.
+#define SUB_BUCKET_BITS 2
+
+void latency_histogram_reset(latency_histogram_t *hist) {
+    memset(hist, 0, sizeof *hist);
+}
+
+static uint32_t bucket_of(uint32_t latency_us) {
+    if (latency_us < (1u << LATENCY_MIN_SHIFT)) {
+        return 0;
+    }
+    uint32_t shift = 31 - __builtin_clz(latency_us);
+    if (shift >= LATENCY_MAX_SHIFT) {
+        return LATENCY_BUCKETS - 1;
+    }
+    // The bits below the leading one pick the sub bucket.
+    uint32_t sub = (latency_us >> (shift - SUB_BUCKET_BITS)) &
+                   (LATENCY_SUB_BUCKETS - 1);
+    return 1 + (shift - LATENCY_MIN_SHIFT) * LATENCY_SUB_BUCKETS + sub;
+}
+
+static uint32_t bucket_upper_us(uint32_t bucket) {
+    if (bucket == 0) {
+        return 1u << LATENCY_MIN_SHIFT;
+    }
+    uint32_t shift = LATENCY_MIN_SHIFT + (bucket - 1) / LATENCY_SUB_BUCKETS;
+    uint32_t sub = (bucket - 1) % LATENCY_SUB_BUCKETS;
+    return (LATENCY_SUB_BUCKETS + sub + 1) << (shift - SUB_BUCKET_BITS);
+}
+
+void latency_histogram_record(latency_histogram_t *hist, uint32_t latency_us) {
+    hist->buckets[bucket_of(latency_us)]++;
+    hist->count++;
+    hist->total_us += latency_us;
+    if (latency_us > hist->max_us) {
+        hist->max_us = latency_us;
+    }
+}
+
+uint32_t latency_histogram_percentile(const latency_histogram_t *hist,
+                                      uint32_t per_mille) {
+    if (hist->count == 0) {
+        return 0;
+    }
+    // Rank of the wanted value, from 1.
+    uint64_t rank = ((uint64_t)hist->count * per_mille + 999) / 1000;
+    if (rank == 0) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < LATENCY_BUCKETS - 1; i++) {
+        seen += hist->buckets[i];
+        if (seen >= rank) {
+            uint32_t upper = bucket_upper_us(i);
+            return upper < hist->max_us ? upper : hist->max_us;
+        }
+    }
+    return hist->max_us;
+}
+
+uint32_t latency_histogram_mean(const latency_histogram_t *hist) {
+    return hist->count > 0 ? hist->total_us / hist->count : 0;
+}
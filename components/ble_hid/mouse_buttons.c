@@ -0,0 +1,135 @@
+#include "mouse_buttons.h"
+#include <string.h>
+
+void mouse_buttons_init(mouse_buttons_t *buttons, uint16_t default_hold_ms,
+                        uint16_t default_gap_ms) {
+    memset(buttons, 0, sizeof *buttons);
+    buttons->default_hold_ms = default_hold_ms;
+    buttons->default_gap_ms = default_gap_ms;
+}
+
+static uint8_t steps_for(mouse_button_action_t action) {
+    switch (action) {
+    case MOUSE_BUTTON_DOWN:
+    case MOUSE_BUTTON_UP:
+        return 1;
+    case MOUSE_BUTTON_CLICK:
+        return 2;
+    case MOUSE_BUTTON_DOUBLE_CLICK:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+static mouse_button_step_t *step_at(mouse_buttons_t *buttons, uint8_t index) {
+    return &buttons->steps[(buttons->head + index) % MOUSE_BUTTONS_STEPS];
+}
+
+bool mouse_buttons_has_room(const mouse_buttons_t *buttons,
+                            mouse_button_action_t action) {
+    return buttons->count + steps_for(action) <= MOUSE_BUTTONS_STEPS;
+}
+
+uint8_t mouse_buttons_preview(const mouse_buttons_t *buttons,
+                              mouse_button_action_t action, uint8_t mask) {
+    mask &= MOUSE_BUTTONS_MASK;
+    if (buttons->count > 0) {
+        return buttons->state;
+    }
+    switch (action) {
+    case MOUSE_BUTTON_DOWN:
+    case MOUSE_BUTTON_CLICK:
+    case MOUSE_BUTTON_DOUBLE_CLICK:
+        return buttons->state | mask;
+    case MOUSE_BUTTON_UP:
+        return buttons->state & ~mask;
+    default:
+        return buttons->state;
+    }
+}
+
+static void push_step(mouse_buttons_t *buttons, int64_t at_us,
+                      uint8_t state) {
+    mouse_button_step_t *step = step_at(buttons, buttons->count);
+    step->at_us = at_us;
+    step->state = state;
+    buttons->count++;
+}
+
+bool mouse_buttons_command(mouse_buttons_t *buttons,
+                           mouse_button_action_t action, uint8_t mask,
+                           uint16_t hold_ms, uint16_t gap_ms, int64_t now_us) {
+    if (steps_for(action) == 0) {
+        return true;
+    }
+    if (!mouse_buttons_has_room(buttons, action)) {
+        return false;
+    }
+    mask &= MOUSE_BUTTONS_MASK;
+    int64_t hold_us =
+        (int64_t)(hold_ms != 0 ? hold_ms : buttons->default_hold_ms) * 1000;
+    int64_t gap_us =
+        (int64_t)(gap_ms != 0 ? gap_ms : buttons->default_gap_ms) * 1000;
+
+    // Start from where the queued changes leave the buttons.
+    int64_t at_us = now_us;
+    uint8_t state = buttons->state;
+    if (buttons->count > 0) {
+        const mouse_button_step_t *last = step_at(buttons, buttons->count - 1);
+        if (last->at_us > at_us) {
+            at_us = last->at_us;
+        }
+        state = last->state;
+    }
+
+    switch (action) {
+    case MOUSE_BUTTON_DOWN:
+        push_step(buttons, at_us, state | mask);
+        break;
+    case MOUSE_BUTTON_UP:
+        push_step(buttons, at_us, state & ~mask);
+        break;
+    case MOUSE_BUTTON_DOUBLE_CLICK:
+        push_step(buttons, at_us, state | mask);
+        push_step(buttons, at_us + hold_us, state & ~mask);
+        at_us += hold_us + gap_us;
+        // fall through
+    case MOUSE_BUTTON_CLICK:
+        push_step(buttons, at_us, state | mask);
+        push_step(buttons, at_us + hold_us, state & ~mask);
+        break;
+    default:
+        break;
+    }
+    return true;
+}
+
+bool mouse_buttons_due(const mouse_buttons_t *buttons, int64_t now_us,
+                       uint8_t *state) {
+    if (buttons->count == 0) {
+        return false;
+    }
+    const mouse_button_step_t *step = &buttons->steps[buttons->head];
+    if (step->at_us > now_us) {
+        return false;
+    }
+    *state = step->state;
+    return true;
+}
+
+void mouse_buttons_pop(mouse_buttons_t *buttons) {
+    if (buttons->count == 0) {
+        return;
+    }
+    buttons->state = buttons->steps[buttons->head].state;
+    buttons->head = (buttons->head + 1) % MOUSE_BUTTONS_STEPS;
+    buttons->count--;
+}
+
+int64_t mouse_buttons_next_us(const mouse_buttons_t *buttons) {
+    if (buttons->count == 0) {
+        return INT64_MAX;
+    }
+    return buttons->steps[buttons->head].at_us;
+}
@@ -0,0 +1,214 @@
+#include "mouse_coalescer.h"
+#include <string.h>
+
+void mouse_coalescer_init(mouse_coalescer_t *coalescer) {
+    memset(coalescer, 0, sizeof *coalescer);
+    coalescer->axis_max = INT8_MAX;
+    coalescer->wheel_per_unit = 1;
+}
+
+void mouse_coalescer_set_resolution(mouse_coalescer_t *coalescer,
+                                    int32_t axis_max, int32_t wheel_per_unit) {
+    coalescer->axis_max = axis_max;
+    coalescer->wheel_per_unit = wheel_per_unit > 0 ? wheel_per_unit : 1;
+}
+
+static mouse_coalescer_segment_t *segment_at(mouse_coalescer_t *coalescer,
+                                             uint8_t index) {
+    return &coalescer->segments[(coalescer->head + index) %
+                                MOUSE_COALESCER_SEGMENTS];
+}
+
+static mouse_coalescer_segment_t *tail_segment(mouse_coalescer_t *coalescer) {
+    if (coalescer->count == 0) {
+        return NULL;
+    }
+    return segment_at(coalescer, coalescer->count - 1);
+}
+
+static bool joins_tail(const mouse_coalescer_segment_t *tail, uint8_t button,
+                       bool absolute) {
+    return tail != NULL && tail->button == button &&
+           tail->absolute == absolute;
+}
+
+bool mouse_coalescer_has_room(const mouse_coalescer_t *coalescer,
+                              uint8_t button, bool absolute) {
+    if (coalescer->count < MOUSE_COALESCER_SEGMENTS) {
+        return true;
+    }
+    // Full, but the input can still be merged into the newest segment.
+    const mouse_coalescer_segment_t *tail =
+        &coalescer->segments[(coalescer->head + coalescer->count - 1) %
+                             MOUSE_COALESCER_SEGMENTS];
+    return joins_tail(tail, button, absolute);
+}
+
+/**
+ * Segment the next input with this button state merges into, or NULL when
+ * a new one is needed but all are in use.
+ */
+static mouse_coalescer_segment_t *segment_for(mouse_coalescer_t *coalescer,
+                                              uint8_t button, bool absolute) {
+    mouse_coalescer_segment_t *tail = tail_segment(coalescer);
+    // Motion can only be summed while the button state stays the same.
+    if (!joins_tail(tail, button, absolute)) {
+        if (coalescer->count == MOUSE_COALESCER_SEGMENTS) {
+            return NULL;
+        }
+        tail = segment_at(coalescer, coalescer->count);
+        memset(tail, 0, sizeof *tail);
+        tail->button = button;
+        tail->absolute = absolute;
+        coalescer->count++;
+    }
+    return tail;
+}
+
+static void count_input(mouse_coalescer_t *coalescer,
+                        mouse_coalescer_segment_t *segment) {
+    segment->inputs++;
+    coalescer->stats.inputs++;
+    segment->last_input = coalescer->stats.inputs;
+}
+
+bool mouse_coalescer_add(mouse_coalescer_t *coalescer, uint8_t button,
+                         int32_t x, int32_t y, int32_t wheel) {
+    mouse_coalescer_segment_t *segment =
+        segment_for(coalescer, button, false);
+    if (segment == NULL) {
+        return false;
+    }
+    segment->x += x;
+    segment->y += y;
+    segment->wheel += wheel;
+    count_input(coalescer, segment);
+    return true;
+}
+
+bool mouse_coalescer_add_absolute(mouse_coalescer_t *coalescer,
+                                  uint8_t button, uint16_t x, uint16_t y) {
+    mouse_coalescer_segment_t *segment = segment_for(coalescer, button, true);
+    if (segment == NULL) {
+        return false;
+    }
+    segment->x = x;
+    segment->y = y;
+    count_input(coalescer, segment);
+    return true;
+}
+
+bool mouse_coalescer_is_empty(const mouse_coalescer_t *coalescer) {
+    return coalescer->count == 0;
+}
+
+void mouse_coalescer_discard(mouse_coalescer_t *coalescer) {
+    coalescer->head = 0;
+    coalescer->count = 0;
+    coalescer->wheel_carry = 0;
+    // The next host starts with every button up.
+    coalescer->last_button = 0;
+    coalescer->delivered = coalescer->stats.inputs;
+}
+
+/**
+ * Take up to max report units of per_unit inputs each from pending, leaving
+ * the rest.
+ */
+static int16_t take_axis(int32_t *pending, int32_t max, int32_t per_unit) {
+    int32_t value = *pending / per_unit;
+    if (value > max) {
+        value = max;
+    } else if (value < -max) {
+        value = -max;
+    }
+    *pending -= value * per_unit;
+    return (int16_t)value;
+}
+
+static uint8_t hist_bucket(uint32_t merged) {
+    uint8_t bucket = 0;
+    uint32_t bound = 1;
+    while (merged > bound && bucket < MOUSE_COALESCER_HIST_BUCKETS - 1) {
+        bound <<= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+/**
+ * Whether report would tell the host nothing: no motion and the buttons it
+ * already has.
+ */
+static bool is_idle(const mouse_coalescer_t *coalescer,
+                    const mouse_coalescer_report_t *report) {
+    return !report->absolute && report->x == 0 && report->y == 0 &&
+           report->wheel == 0 && report->button == coalescer->last_button;
+}
+
+bool mouse_coalescer_pop(mouse_coalescer_t *coalescer,
+                         mouse_coalescer_report_t *report) {
+    while (coalescer->count > 0) {
+        mouse_coalescer_segment_t *segment = segment_at(coalescer, 0);
+        int32_t max = coalescer->axis_max;
+        memset(report, 0, sizeof *report);
+        report->button = segment->button;
+        report->absolute = segment->absolute;
+        if (segment->absolute) {
+            report->abs_x = segment->x;
+            report->abs_y = segment->y;
+            segment->x = 0;
+            segment->y = 0;
+        } else {
+            segment->wheel += coalescer->wheel_carry;
+            coalescer->wheel_carry = 0;
+            report->x = take_axis(&segment->x, max, 1);
+            report->y = take_axis(&segment->y, max, 1);
+            report->wheel =
+                take_axis(&segment->wheel, max, coalescer->wheel_per_unit);
+        }
+
+        // Wheel input short of one report unit, with nothing else, is left
+        // in the carry without a report.
+        bool idle = is_idle(coalescer, report);
+        if (!idle) {
+            mouse_coalescer_stats_t *stats = &coalescer->stats;
+            stats->reports++;
+            stats->last_merged = segment->inputs;
+            if (segment->inputs == 0) {
+                // Remainder of a sum that did not fit into the previous
+                // report.
+                stats->split_reports++;
+            } else {
+                stats->merged_hist[hist_bucket(segment->inputs)]++;
+                if (segment->inputs > stats->max_merged) {
+                    stats->max_merged = segment->inputs;
+                }
+            }
+            coalescer->last_button = report->button;
+        }
+        segment->inputs = 0;
+
+        // Drop the segment once drained. A later input with the same button
+        // simply starts a new one. Wheel input short of one report unit
+        // waits for more.
+        if (segment->x == 0 && segment->y == 0 &&
+            segment->wheel / coalescer->wheel_per_unit == 0) {
+            coalescer->wheel_carry += segment->wheel;
+            coalescer->delivered = segment->last_input;
+            coalescer->head = (coalescer->head + 1) % MOUSE_COALESCER_SEGMENTS;
+            coalescer->count--;
+        }
+        if (!idle) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool mouse_coalescer_peek(const mouse_coalescer_t *coalescer,
+                          mouse_coalescer_report_t *report) {
+    // Popping a copy keeps both producing the very same report.
+    mouse_coalescer_t copy = *coalescer;
+    return mouse_coalescer_pop(&copy, report);
+}
@@ -0,0 +1,89 @@
+#include "reconnect.h"
+#include "esp_timer.h"
+#include "host/ble_gap.h"
+#include "host/ble_hs.h"
+#include <string.h>
+
+static const char *const phase_names[RECONNECT_PHASE_COUNT] = {
+    [RECONNECT_DIRECTED] = "directed",
+    [RECONNECT_FAST] = "fast",
+    [RECONNECT_SLOW] = "slow",
+};
+
+static reconnect_stats_t stats;
+// Identity address of the host whose link dropped last.
+static ble_addr_t lost_peer;
+static bool has_lost_peer = false;
+
+static bool is_connected(const hid_control_t *hid_control,
+                         const ble_addr_t *peer) {
+    struct ble_gap_conn_desc desc;
+
+    for (int i = 0; i < HID_MAX_CONNECTIONS; i++) {
+        const hid_conn_t *conn = &hid_control->conns[i];
+        if (conn->in_use && ble_gap_conn_find(conn->conn, &desc) == 0 &&
+            ble_addr_cmp(&desc.peer_id_addr, peer) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool reconnect_directed_peer(const hid_control_t *hid_control,
+                             ble_addr_t *peer) {
+    ble_addr_t bonded[CONFIG_BT_NIMBLE_MAX_BONDS];
+    int count = 0;
+
+    if (ble_store_util_bonded_peers(bonded, &count,
+                                    CONFIG_BT_NIMBLE_MAX_BONDS) != 0) {
+        return false;
+    }
+    // The host lost last, if it is still bonded and has not come back.
+    for (int i = 0; has_lost_peer && i < count; i++) {
+        if (ble_addr_cmp(&bonded[i], &lost_peer) == 0 &&
+            !is_connected(hid_control, &lost_peer)) {
+            *peer = lost_peer;
+            return true;
+        }
+    }
+    // After a reboot nothing was lost yet. The store appends new bonds and
+    // drops the oldest, so the newest is last.
+    for (int i = count - 1; i >= 0; i--) {
+        if (!is_connected(hid_control, &bonded[i])) {
+            *peer = bonded[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+void reconnect_advertising(reconnect_phase_t phase) {
+    stats.advertised[phase]++;
+}
+
+void reconnect_link_lost(const ble_addr_t *peer) {
+    lost_peer = *peer;
+    has_lost_peer = true;
+    if (stats.lost_us == 0) {
+        stats.lost_us = esp_timer_get_time();
+    }
+}
+
+void reconnect_link_up(reconnect_phase_t phase) {
+    stats.connected[phase]++;
+    if (stats.lost_us != 0) {
+        int64_t elapsed_us = esp_timer_get_time() - stats.lost_us;
+        latency_histogram_record(&stats.time_to_reconnect,
+                                 elapsed_us > UINT32_MAX ? UINT32_MAX
+                                                         : elapsed_us);
+        stats.lost_us = 0;
+    }
+}
+
+const reconnect_stats_t *reconnect_get_stats(void) {
+    return &stats;
+}
+
+const char *reconnect_phase_name(reconnect_phase_t phase) {
+    return phase < RECONNECT_PHASE_COUNT ? phase_names[phase] : "unknown";
+}
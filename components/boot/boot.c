@@ -0,0 +1,60 @@
+#include "boot.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#define BOOT_TAG "BOOT"
+
+static const char *const phase_names[BOOT_PHASE_COUNT] = {
+    [BOOT_APP_MAIN] = "app_main",
+    [BOOT_NVS] = "nvs",
+    [BOOT_DISPATCHER] = "dispatcher",
+    [BOOT_BLE_SYNCED] = "ble_synced",
+    [BOOT_NETIF] = "netif",
+    [BOOT_HTTPD] = "httpd",
+    [BOOT_WIFI_UP] = "wifi_up",
+    [BOOT_WIFI_FAILED] = "wifi_failed",
+    [BOOT_HOST_CONNECTED] = "host_connected",
+};
+
+static StaticEventGroup_t group_buffer;
+static EventGroupHandle_t group;
+// Written once per phase, before its bit is set, by whoever reaches it.
+static int64_t phase_us[BOOT_PHASE_COUNT];
+
+void boot_init(void) {
+    group = xEventGroupCreateStatic(&group_buffer);
+}
+
+void boot_done(boot_phase_t phase) {
+    if (xEventGroupGetBits(group) & BOOT_BIT(phase)) {
+        return;
+    }
+    phase_us[phase] = esp_timer_get_time();
+    xEventGroupSetBits(group, BOOT_BIT(phase));
+}
+
+EventBits_t boot_wait(EventBits_t bits, bool all, TickType_t timeout) {
+    return xEventGroupWaitBits(group, bits, pdFALSE, all ? pdTRUE : pdFALSE,
+                               timeout);
+}
+
+int64_t boot_phase_us(boot_phase_t phase) {
+    if (!(xEventGroupGetBits(group) & BOOT_BIT(phase))) {
+        return 0;
+    }
+    return phase_us[phase];
+}
+
+const char *boot_phase_name(boot_phase_t phase) {
+    return phase < BOOT_PHASE_COUNT ? phase_names[phase] : "unknown";
+}
+
+void boot_log_timings(void) {
+    for (int i = 0; i < BOOT_PHASE_COUNT; i++) {
+        int64_t us = boot_phase_us(i);
+        if (us != 0) {
+            ESP_LOGI(BOOT_TAG, "%-14s %7lld ms", boot_phase_name(i),
+                     (long long)(us / 1000));
+        }
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef BOOT_H
+#define BOOT_H
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Milestones of startup, each a bit of the boot event group. Subsystems
+ * wait for the bits they depend on instead of app_main bringing them up one
+ * after another. Names are in boot.c.
+ */
+typedef enum {
+    // app_main entered; everything before it is the bootloader and IDF.
+    BOOT_APP_MAIN,
+    // NVS flash usable, needed by BLE, WiFi and macros.
+    BOOT_NVS,
+    // Lanes, key queue and dispatcher ready to take input.
+    BOOT_DISPATCHER,
+    // NimBLE host synced with the controller and advertising.
+    BOOT_BLE_SYNCED,
+    // TCP/IP stack up; sockets can be bound before there is an address.
+    BOOT_NETIF,
+    // HTTP server and UDP listener accepting.
+    BOOT_HTTPD,
+    // WiFi associated and holding an address.
+    BOOT_WIFI_UP,
+    // WiFi gave up; it is not retried until the next boot.
+    BOOT_WIFI_FAILED,
+    // First BLE host connected.
+    BOOT_HOST_CONNECTED,
+    BOOT_PHASE_COUNT,
+} boot_phase_t;
+
+#define BOOT_BIT(phase) ((EventBits_t)1 << (phase))
+
+/**
+ * Create the event group. Call first thing in app_main.
+ */
+void boot_init(void);
+
+/**
+ * Mark phase reached, waking whoever waits for it. Only the first time is
+ * recorded.
+ */
+void boot_done(boot_phase_t phase);
+
+/**
+ * Wait until every bit of bits is set, or any of them if all is false.
+ * Returns the bits set when it returned, so callers can tell a timeout.
+ */
+EventBits_t boot_wait(EventBits_t bits, bool all, TickType_t timeout);
+
+/**
+ * esp_timer time phase was reached at, 0 if it has not been.
+ */
+int64_t boot_phase_us(boot_phase_t phase);
+
+const char *boot_phase_name(boot_phase_t phase);
+
+/**
+ * Log the time of every phase reached so far.
+ */
+void boot_log_timings(void);
+
+#endif // BOOT_H
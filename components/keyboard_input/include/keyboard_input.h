@@ -0,0 +1,75 @@
+#ifndef KEYBOARD_INPUT_H
+#define KEYBOARD_INPUT_H
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Key strokes waiting for the dispatcher. Power of two.
+#define KEYBOARD_QUEUE_LEN 1024
+
+/**
+ * One character to type: a key pressed with modifiers, then released.
+ */
+typedef struct {
+    // Usage id on the Keyboard/Keypad page.
+    uint8_t usage;
+    // KEYBOARD_MOD_* bits held with it.
+    uint8_t modifiers;
+    // Numbered like mouse_notification_t.target.
+    uint8_t target;
+} key_stroke_t;
+
+typedef enum {
+    KEYBOARD_TYPE_OK = 0,
+    // Not valid UTF-8.
+    KEYBOARD_TYPE_BAD_UTF8,
+    // A character the layout has no key for.
+    KEYBOARD_TYPE_UNSUPPORTED,
+    // Not enough room for the whole text.
+    KEYBOARD_TYPE_FULL,
+} keyboard_type_status_t;
+
+typedef struct {
+    // Texts queued, and the strokes they took.
+    uint32_t texts;
+    uint32_t strokes;
+    // Texts refused for a bad character or for lack of room.
+    uint32_t rejected_bad;
+    uint32_t rejected_full;
+} keyboard_input_stats_t;
+
+/**
+ * Create the wake semaphore. Call before any other function.
+ */
+void keyboard_input_init(void);
+
+/**
+ * Queue UTF-8 text for the hosts of target, all of it or none. "\r\n"
+ * types a single Enter. On KEYBOARD_TYPE_OK strokes is the number queued;
+ * on a bad character error_at is its byte offset. Producer side: only one
+ * task may call this.
+ */
+keyboard_type_status_t keyboard_input_type(const char *text, size_t len,
+                                           uint8_t target, size_t *strokes,
+                                           size_t *error_at);
+
+const char *keyboard_type_status_str(keyboard_type_status_t status);
+
+/**
+ * Consumer side. Given after every queued text; take it, then drain with
+ * keyboard_input_take until it returns false.
+ */
+SemaphoreHandle_t keyboard_input_wake_semaphore(void);
+
+/**
+ * Take the next stroke in the order typed.
+ */
+bool keyboard_input_take(key_stroke_t *stroke);
+
+const keyboard_input_stats_t *keyboard_input_get_stats(void);
+
+#endif // KEYBOARD_INPUT_H
@@ -0,0 +1,24 @@
+#ifndef KEYBOARD_LAYOUT_H
+#define KEYBOARD_LAYOUT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Modifier bits of the keyboard report, one per usage 0xE0..0xE7.
+#define KEYBOARD_MOD_LEFT_CTRL 0x01
+#define KEYBOARD_MOD_LEFT_SHIFT 0x02
+#define KEYBOARD_MOD_LEFT_ALT 0x04
+#define KEYBOARD_MOD_LEFT_GUI 0x08
+
+// Highest usage of the Keyboard/Keypad page the report map declares.
+#define KEYBOARD_USAGE_MAX 0x65
+
+/**
+ * Key and modifiers typing code_point on a host set to the US layout.
+ * Returns false for characters that layout has no key for. '\n' and '\r'
+ * are Enter, '\t' is Tab.
+ */
+bool keyboard_layout_stroke(uint32_t code_point, uint8_t *usage,
+                            uint8_t *modifiers);
+
+#endif // KEYBOARD_LAYOUT_H
@@ -0,0 +1,160 @@
+#include "keyboard_input.h"
+#include "keyboard_layout.h"
+
+// Single producer, single consumer ring. head and tail only grow; the slot
+// is the index modulo KEYBOARD_QUEUE_LEN.
+static key_stroke_t queue[KEYBOARD_QUEUE_LEN];
+// Next stroke to take. Moved only by the consumer.
+static atomic_uint head;
+// Next stroke to write. Moved only by the producer.
+static atomic_uint tail;
+static SemaphoreHandle_t wake_semaphore;
+// Written by the producer.
+static keyboard_input_stats_t stats;
+
+void keyboard_input_init(void) {
+    wake_semaphore = xSemaphoreCreateBinary();
+    atomic_init(&head, 0);
+    atomic_init(&tail, 0);
+}
+
+/**
+ * Decode the code point at the start of text. Returns its length in bytes,
+ * or 0 if text does not start with a well formed UTF-8 sequence.
+ */
+static size_t decode_utf8(const uint8_t *text, size_t len,
+                          uint32_t *code_point) {
+    static const uint32_t min_for_len[] = {0, 0, 0x80, 0x800, 0x10000};
+    size_t seq_len;
+    uint32_t value;
+
+    if (text[0] < 0x80) {
+        *code_point = text[0];
+        return 1;
+    } else if ((text[0] & 0xE0) == 0xC0) {
+        seq_len = 2;
+        value = text[0] & 0x1F;
+    } else if ((text[0] & 0xF0) == 0xE0) {
+        seq_len = 3;
+        value = text[0] & 0x0F;
+    } else if ((text[0] & 0xF8) == 0xF0) {
+        seq_len = 4;
+        value = text[0] & 0x07;
+    } else {
+        return 0;
+    }
+    if (seq_len > len) {
+        return 0;
+    }
+    for (size_t i = 1; i < seq_len; i++) {
+        if ((text[i] & 0xC0) != 0x80) {
+            return 0;
+        }
+        value = value << 6 | (text[i] & 0x3F);
+    }
+    // Overlong forms, surrogates and values past Unicode are malformed.
+    if (value < min_for_len[seq_len] || value > 0x10FFFF ||
+        (value >= 0xD800 && value <= 0xDFFF)) {
+        return 0;
+    }
+    *code_point = value;
+    return seq_len;
+}
+
+/**
+ * Read the character at *pos into stroke and move past it. "\r\n" is read
+ * as one character.
+ */
+static keyboard_type_status_t next_stroke(const uint8_t *text, size_t len,
+                                          size_t *pos, key_stroke_t *stroke) {
+    uint32_t code_point;
+    size_t char_len = decode_utf8(text + *pos, len - *pos, &code_point);
+    if (char_len == 0) {
+        return KEYBOARD_TYPE_BAD_UTF8;
+    }
+    if (!keyboard_layout_stroke(code_point, &stroke->usage,
+                                &stroke->modifiers)) {
+        return KEYBOARD_TYPE_UNSUPPORTED;
+    }
+    *pos += char_len;
+    if (code_point == '\r' && *pos < len && text[*pos] == '\n') {
+        (*pos)++;
+    }
+    return KEYBOARD_TYPE_OK;
+}
+
+keyboard_type_status_t keyboard_input_type(const char *text, size_t len,
+                                           uint8_t target, size_t *strokes,
+                                           size_t *error_at) {
+    const uint8_t *bytes = (const uint8_t *)text;
+    key_stroke_t stroke;
+    size_t count = 0;
+
+    // Check the whole text first, so nothing is typed of a bad one.
+    for (size_t pos = 0; pos < len; count++) {
+        size_t start = pos;
+        keyboard_type_status_t status = next_stroke(bytes, len, &pos, &stroke);
+        if (status != KEYBOARD_TYPE_OK) {
+            *error_at = start;
+            stats.rejected_bad++;
+            return status;
+        }
+    }
+
+    unsigned int first = atomic_load_explicit(&tail, memory_order_relaxed);
+    unsigned int used =
+        first - atomic_load_explicit(&head, memory_order_acquire);
+    if (count > KEYBOARD_QUEUE_LEN - used) {
+        stats.rejected_full++;
+        return KEYBOARD_TYPE_FULL;
+    }
+    size_t pos = 0;
+    for (size_t i = 0; i < count; i++) {
+        next_stroke(bytes, len, &pos, &stroke);
+        stroke.target = target;
+        queue[(first + i) % KEYBOARD_QUEUE_LEN] = stroke;
+    }
+    // Publishes the strokes along with the new tail.
+    atomic_store_explicit(&tail, first + count, memory_order_release);
+    stats.texts++;
+    stats.strokes += count;
+    *strokes = count;
+    if (count > 0) {
+        xSemaphoreGive(wake_semaphore);
+    }
+    return KEYBOARD_TYPE_OK;
+}
+
+const char *keyboard_type_status_str(keyboard_type_status_t status) {
+    switch (status) {
+    case KEYBOARD_TYPE_OK:
+        return "ok";
+    case KEYBOARD_TYPE_BAD_UTF8:
+        return "malformed UTF-8";
+    case KEYBOARD_TYPE_UNSUPPORTED:
+        return "no key for character";
+    case KEYBOARD_TYPE_FULL:
+        return "queue full";
+    default:
+        return "unknown";
+    }
+}
+
+SemaphoreHandle_t keyboard_input_wake_semaphore(void) {
+    return wake_semaphore;
+}
+
+bool keyboard_input_take(key_stroke_t *stroke) {
+    unsigned int index = atomic_load_explicit(&head, memory_order_relaxed);
+    if (index == atomic_load_explicit(&tail, memory_order_acquire)) {
+        return false;
+    }
+    *stroke = queue[index % KEYBOARD_QUEUE_LEN];
+    // The producer may reuse the slot once head has moved past it.
+    atomic_store_explicit(&head, index + 1, memory_order_release);
+    return true;
+}
+
+const keyboard_input_stats_t *keyboard_input_get_stats(void) {
+    return &stats;
+}
@@ -0,0 +1,65 @@
+#include "keyboard_layout.h"
+#include <stddef.h>
+
+// Usage ids of the Keyboard/Keypad page.
+#define USAGE_A 0x04
+#define USAGE_ENTER 0x28
+#define USAGE_TAB 0x2B
+#define USAGE_SPACE 0x2C
+
+typedef struct {
+    char plain;
+    char shifted;
+    uint8_t usage;
+} key_pair_t;
+
+// Keys typing a symbol, unshifted and shifted. Digits are only listed for
+// their shifted symbols.
+static const key_pair_t symbol_keys[] = {
+    {'1', '!', 0x1E}, {'2', '@', 0x1F}, {'3', '#', 0x20}, {'4', '$', 0x21},
+    {'5', '%', 0x22}, {'6', '^', 0x23}, {'7', '&', 0x24}, {'8', '*', 0x25},
+    {'9', '(', 0x26}, {'0', ')', 0x27}, {'-', '_', 0x2D}, {'=', '+', 0x2E},
+    {'[', '{', 0x2F}, {']', '}', 0x30}, {'\\', '|', 0x31}, {';', ':', 0x33},
+    {'\'', '"', 0x34}, {'`', '~', 0x35}, {',', '<', 0x36}, {'.', '>', 0x37},
+    {'/', '?', 0x38},
+};
+
+bool keyboard_layout_stroke(uint32_t code_point, uint8_t *usage,
+                            uint8_t *modifiers) {
+    *modifiers = 0;
+    if (code_point >= 'a' && code_point <= 'z') {
+        *usage = USAGE_A + (code_point - 'a');
+        return true;
+    }
+    if (code_point >= 'A' && code_point <= 'Z') {
+        *usage = USAGE_A + (code_point - 'A');
+        *modifiers = KEYBOARD_MOD_LEFT_SHIFT;
+        return true;
+    }
+    switch (code_point) {
+    case '\n':
+    case '\r':
+        *usage = USAGE_ENTER;
+        return true;
+    case '\t':
+        *usage = USAGE_TAB;
+        return true;
+    case ' ':
+        *usage = USAGE_SPACE;
+        return true;
+    default:
+        break;
+    }
+    for (size_t i = 0; i < sizeof symbol_keys / sizeof *symbol_keys; i++) {
+        if (code_point == (uint8_t)symbol_keys[i].plain) {
+            *usage = symbol_keys[i].usage;
+            return true;
+        }
+        if (code_point == (uint8_t)symbol_keys[i].shifted) {
+            *usage = symbol_keys[i].usage;
+            *modifiers = KEYBOARD_MOD_LEFT_SHIFT;
+            return true;
+        }
+    }
+    return false;
+}
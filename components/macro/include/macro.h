@@ -0,0 +1,85 @@
+#ifndef MACRO_H
+#define MACRO_H
+
+#include "esp_err.h"
+#include "mouse_notification.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Longest macro name. NVS keys hold 15 characters and chunks add ".NNN".
+#define MACRO_NAME_MAX_LEN 11
+
+// Fastest replay, as a multiple of the recorded speed.
+#define MACRO_MAX_SPEED 16
+
+typedef enum {
+    MACRO_IDLE = 0,
+    MACRO_RECORDING,
+    MACRO_PLAYING,
+} macro_state_t;
+
+typedef struct {
+    uint32_t recorded;
+    // Events lost while recording because flash writes fell behind.
+    uint32_t record_dropped;
+    uint32_t played;
+    uint32_t flash_errors;
+    // Times a replay waited for room in the scheduler.
+    uint32_t replay_waits;
+} macro_stats_t;
+
+/**
+ * Open the macro NVS namespace and start the task doing all flash work.
+ * NVS must be initialized (init_ble_hid does), and mouse_scheduler_init must
+ * have run.
+ */
+void macro_init(void);
+
+/**
+ * Feed of every event the dispatcher takes, for
+ * hid_dispatcher_register_input_tap. Only appends to RAM; full chunks are
+ * written by the macro task.
+ */
+void macro_record_tap(const mouse_notification_t *event, int64_t now_us);
+
+/**
+ * Record every following event, from any producer, under name until
+ * macro_stop. An existing macro of that name is replaced.
+ * ESP_ERR_INVALID_ARG for a bad name, ESP_ERR_INVALID_STATE while busy.
+ */
+esp_err_t macro_record_start(const char *name);
+
+/**
+ * Replay name through mouse_scheduler with its recorded timing, speed times
+ * faster. Chunks are read from flash while the previous ones play, so long
+ * macros never sit in RAM whole. target overrides the recorded targets when
+ * not NULL.
+ * ESP_ERR_NOT_FOUND for an unknown macro, ESP_ERR_INVALID_STATE while busy.
+ */
+esp_err_t macro_play(const char *name, uint8_t speed, const uint8_t *target);
+
+/**
+ * Finish the recording, or stop the replay and drop what it already
+ * scheduled; events others scheduled stay. A replay counts as playing until
+ * its last event is released. Writes the events recorded, or played so far.
+ * ESP_ERR_INVALID_STATE when idle.
+ */
+esp_err_t macro_stop(uint32_t *events);
+
+/**
+ * ESP_ERR_NOT_FOUND for an unknown macro, ESP_ERR_INVALID_STATE while busy.
+ */
+esp_err_t macro_delete(const char *name);
+
+/**
+ * Write a "name events=N duration_ms=M" line per stored macro.
+ * Returns the length written, truncated to fit buf.
+ */
+size_t macro_list(char *buf, size_t len);
+
+macro_state_t macro_get_state(void);
+
+const macro_stats_t *macro_get_stats(void);
+
+#endif // MACRO_H
@@ -0,0 +1,523 @@
+#include "macro.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "mouse_scheduler.h"
+#include "nvs.h"
+#include "sdkconfig.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#define MACRO_TAG "macro"
+
+#define MACRO_NAMESPACE "macros"
+#define MACRO_FORMAT_VERSION 2
+
+// Records per flash chunk, the unit written while recording and read while
+// replaying.
+#define CHUNK_RECORDS 32
+// Chunk numbers have to fit the three digits a key has left.
+#define MAX_CHUNKS 1000
+
+// Head start of a replay, for its first chunk to be scheduled in time.
+#define REPLAY_LEAD_US 20000
+// How often a replay looks for room in the scheduler.
+#define REPLAY_POLL_MS 10
+
+#define COMMAND_QUEUE_LEN 8
+
+#define RECORD_FLAG_ABSOLUTE 0x01
+
+_Static_assert(CONFIG_MOUSE_SCHEDULER_CAPACITY >= 2 * CHUNK_RECORDS,
+               "a replay schedules a chunk while the previous one plays");
+
+// Stored form of one event.
+typedef struct __attribute__((packed)) {
+    // Since the previous record.
+    uint32_t delta_us;
+    // abs_x/abs_y for absolute records.
+    int16_t x;
+    int16_t y;
+    int16_t wheel;
+    uint8_t button;
+    // mouse_button_action_t, with hold_ms and gap_ms of clicks.
+    uint8_t button_action;
+    uint16_t hold_ms;
+    uint16_t gap_ms;
+    uint8_t target;
+    uint8_t flags;
+} macro_record_t;
+
+// Stored under the macro's name; chunks are under "name.N".
+typedef struct {
+    uint16_t version;
+    uint16_t chunks;
+    uint32_t events;
+    uint32_t duration_ms;
+} macro_header_t;
+
+typedef struct {
+    macro_record_t records[CHUNK_RECORDS];
+    size_t count;
+} chunk_t;
+
+typedef enum {
+    // Replace the macro in name with the recording that follows.
+    CMD_RECORD,
+    // Write recorder.buffers[buffer] as chunk.
+    CMD_WRITE_CHUNK,
+    // Store the header once every chunk is written.
+    CMD_FINISH,
+    CMD_PLAY,
+} command_type_t;
+
+typedef struct {
+    command_type_t type;
+    char name[MACRO_NAME_MAX_LEN + 1];
+    uint8_t buffer;
+    uint16_t chunk;
+    macro_header_t header;
+    uint8_t speed;
+    bool override_target;
+    uint8_t target;
+} command_t;
+
+// Shared by the dispatcher task feeding the tap and the task calling
+// macro_stop, guarded by recorder_mux.
+static struct {
+    bool active;
+    chunk_t buffers[2];
+    // Buffer the tap appends to.
+    uint8_t filling;
+    // Handed to the macro task and not written yet.
+    bool writing[2];
+    uint16_t next_chunk;
+    uint32_t events;
+    int64_t first_us;
+    int64_t last_us;
+} recorder;
+static portMUX_TYPE recorder_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static nvs_handle_t macro_nvs;
+static QueueHandle_t command_queue = NULL;
+static atomic_int state = MACRO_IDLE;
+static atomic_bool stop_replay = false;
+// Scheduler owner of the replay's events, so stopping it leaves everyone
+// else's scheduled events alone.
+static atomic_uint replay_owner = MOUSE_SCHEDULER_NO_OWNER;
+static atomic_uint replayed = 0;
+static macro_stats_t stats;
+
+static bool valid_name(const char *name) {
+    size_t len = strlen(name);
+    if (len == 0 || len > MACRO_NAME_MAX_LEN) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        char c = name[i];
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+              (c >= '0' && c <= '9') || c == '_' || c == '-')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void chunk_key(char *key, const char *name, uint16_t chunk) {
+    snprintf(key, NVS_KEY_NAME_MAX_SIZE, "%s.%u", name, chunk);
+}
+
+static bool read_header(const char *name, macro_header_t *header) {
+    size_t len = sizeof *header;
+    return nvs_get_blob(macro_nvs, name, header, &len) == ESP_OK &&
+           len == sizeof *header && header->version == MACRO_FORMAT_VERSION;
+}
+
+static bool read_chunk(const char *name, uint16_t index, chunk_t *chunk) {
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    size_t len = sizeof chunk->records;
+    chunk_key(key, name, index);
+    if (nvs_get_blob(macro_nvs, key, chunk->records, &len) != ESP_OK ||
+        len % sizeof(macro_record_t) != 0) {
+        stats.flash_errors++;
+        return false;
+    }
+    chunk->count = len / sizeof(macro_record_t);
+    return true;
+}
+
+/**
+ * Erase the header and chunks of name, up to chunks when no header is left.
+ */
+static void erase_macro(const char *name, uint16_t chunks) {
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    macro_header_t header;
+    if (read_header(name, &header)) {
+        chunks = header.chunks;
+        nvs_erase_key(macro_nvs, name);
+    }
+    for (uint16_t i = 0; i < chunks; i++) {
+        chunk_key(key, name, i);
+        nvs_erase_key(macro_nvs, key);
+    }
+    nvs_commit(macro_nvs);
+}
+
+static void send_command(const command_t *cmd) {
+    if (xQueueSend(command_queue, cmd, 0) != pdTRUE) {
+        // Only if the task is stuck on flash for a long time.
+        ESP_LOGE(MACRO_TAG, "command queue full");
+    }
+}
+
+void macro_record_tap(const mouse_notification_t *event, int64_t now_us) {
+    command_t cmd = {.type = CMD_WRITE_CHUNK};
+    bool post = false;
+
+    portENTER_CRITICAL(&recorder_mux);
+    if (!recorder.active) {
+        portEXIT_CRITICAL(&recorder_mux);
+        return;
+    }
+    chunk_t *chunk = &recorder.buffers[recorder.filling];
+    if (recorder.writing[recorder.filling] ||
+        recorder.next_chunk == MAX_CHUNKS) {
+        stats.record_dropped++;
+    } else {
+        macro_record_t *record = &chunk->records[chunk->count++];
+        int64_t delta_us = recorder.events == 0 ? 0 : now_us - recorder.last_us;
+        record->delta_us = delta_us > UINT32_MAX ? UINT32_MAX : delta_us;
+        record->x = event->absolute ? (int16_t)event->abs_x : event->x;
+        record->y = event->absolute ? (int16_t)event->abs_y : event->y;
+        record->wheel = event->wheel;
+        record->button = event->button;
+        record->button_action = event->button_action;
+        record->hold_ms = event->hold_ms;
+        record->gap_ms = event->gap_ms;
+        record->target = event->target;
+        record->flags = event->absolute ? RECORD_FLAG_ABSOLUTE : 0;
+        if (recorder.events == 0) {
+            recorder.first_us = now_us;
+        }
+        recorder.last_us = now_us;
+        recorder.events++;
+        stats.recorded++;
+        if (chunk->count == CHUNK_RECORDS) {
+            post = true;
+            cmd.buffer = recorder.filling;
+            cmd.chunk = recorder.next_chunk++;
+            recorder.writing[recorder.filling] = true;
+            recorder.filling ^= 1;
+        }
+    }
+    portEXIT_CRITICAL(&recorder_mux);
+
+    if (post) {
+        send_command(&cmd);
+    }
+}
+
+static void write_chunk(const char *name, bool *failed,
+                        const command_t *cmd) {
+    chunk_t *chunk = &recorder.buffers[cmd->buffer];
+    char key[NVS_KEY_NAME_MAX_SIZE];
+
+    // The tap leaves a buffer alone while it is marked as writing.
+    if (!*failed) {
+        chunk_key(key, name, cmd->chunk);
+        esp_err_t err = nvs_set_blob(macro_nvs, key, chunk->records,
+                                     chunk->count * sizeof(macro_record_t));
+        if (err != ESP_OK) {
+            ESP_LOGE(MACRO_TAG, "writing %s failed: %s", key,
+                     esp_err_to_name(err));
+            stats.flash_errors++;
+            *failed = true;
+        }
+    }
+    portENTER_CRITICAL(&recorder_mux);
+    chunk->count = 0;
+    recorder.writing[cmd->buffer] = false;
+    portEXIT_CRITICAL(&recorder_mux);
+}
+
+static void finish_recording(const char *name, bool failed,
+                             const command_t *cmd) {
+    if (!failed &&
+        (nvs_set_blob(macro_nvs, name, &cmd->header, sizeof cmd->header) !=
+             ESP_OK ||
+         nvs_commit(macro_nvs) != ESP_OK)) {
+        stats.flash_errors++;
+        failed = true;
+    }
+    if (failed) {
+        // A partial macro would replay something else than was recorded.
+        erase_macro(name, cmd->header.chunks);
+    } else {
+        ESP_LOGI(MACRO_TAG, "recorded %s: %u events", name,
+                 (unsigned)cmd->header.events);
+    }
+    atomic_store(&state, MACRO_IDLE);
+}
+
+/**
+ * Wait until the scheduler can take count more events.
+ * Returns false if the replay was stopped meanwhile.
+ */
+static bool wait_for_room(size_t count) {
+    while (!atomic_load(&stop_replay)) {
+        if (mouse_scheduler_pending() + count <=
+            CONFIG_MOUSE_SCHEDULER_CAPACITY) {
+            return true;
+        }
+        stats.replay_waits++;
+        vTaskDelay(pdMS_TO_TICKS(REPLAY_POLL_MS));
+    }
+    return false;
+}
+
+/**
+ * Wait until the replay's scheduled events are all released.
+ */
+static void wait_for_release(uint32_t owner) {
+    while (!atomic_load(&stop_replay) &&
+           mouse_scheduler_pending_for(owner) > 0) {
+        vTaskDelay(pdMS_TO_TICKS(REPLAY_POLL_MS));
+    }
+}
+
+static void play(const command_t *cmd) {
+    static chunk_t chunk;
+    static mouse_notification_t events[CHUNK_RECORDS];
+    macro_header_t header;
+
+    if (!read_header(cmd->name, &header)) {
+        stats.flash_errors++;
+        atomic_store(&state, MACRO_IDLE);
+        return;
+    }
+
+    uint32_t owner = atomic_load(&replay_owner);
+    int64_t start_us = esp_timer_get_time() + REPLAY_LEAD_US;
+    // Recorded time of the current record since the first one.
+    uint64_t offset_us = 0;
+    for (uint16_t c = 0; c < header.chunks; c++) {
+        // Read while the chunks scheduled before still play.
+        if (!read_chunk(cmd->name, c, &chunk) || !wait_for_room(chunk.count)) {
+            break;
+        }
+        for (size_t i = 0; i < chunk.count; i++) {
+            const macro_record_t *record = &chunk.records[i];
+            mouse_notification_t *event = &events[i];
+            bool absolute = record->flags & RECORD_FLAG_ABSOLUTE;
+            offset_us += record->delta_us;
+            *event = (mouse_notification_t){0};
+            event->absolute = absolute;
+            event->x = absolute ? 0 : record->x;
+            event->y = absolute ? 0 : record->y;
+            event->abs_x = absolute ? (uint16_t)record->x : 0;
+            event->abs_y = absolute ? (uint16_t)record->y : 0;
+            event->wheel = record->wheel;
+            event->button = record->button;
+            event->button_action = record->button_action;
+            event->hold_ms = record->hold_ms;
+            event->gap_ms = record->gap_ms;
+            event->target =
+                cmd->override_target ? cmd->target : record->target;
+            event->at_us = start_us + offset_us / cmd->speed;
+        }
+        if (!mouse_scheduler_submit_all(events, chunk.count, owner)) {
+            break;
+        }
+        stats.played += chunk.count;
+        atomic_fetch_add(&replayed, chunk.count);
+    }
+    // Still playing, and stoppable, until the last chunk is out.
+    wait_for_release(owner);
+    if (atomic_load(&stop_replay)) {
+        // A chunk may have gone in after macro_stop cancelled the others.
+        mouse_scheduler_cancel(owner);
+    }
+    atomic_store(&state, MACRO_IDLE);
+}
+
+static void macro_task(void *pvParameters) {
+    command_t cmd;
+    // Macro being recorded, and whether a write of it failed.
+    char recording[MACRO_NAME_MAX_LEN + 1] = "";
+    bool failed = false;
+
+    while (1) {
+        xQueueReceive(command_queue, &cmd, portMAX_DELAY);
+        switch (cmd.type) {
+        case CMD_RECORD:
+            erase_macro(cmd.name, 0);
+            strcpy(recording, cmd.name);
+            failed = false;
+            break;
+        case CMD_WRITE_CHUNK:
+            write_chunk(recording, &failed, &cmd);
+            break;
+        case CMD_FINISH:
+            finish_recording(recording, failed, &cmd);
+            break;
+        case CMD_PLAY:
+            play(&cmd);
+            break;
+        }
+    }
+}
+
+void macro_init(void) {
+    esp_err_t err = nvs_open(MACRO_NAMESPACE, NVS_READWRITE, &macro_nvs);
+    if (err != ESP_OK) {
+        ESP_LOGE(MACRO_TAG, "nvs_open failed: %s", esp_err_to_name(err));
+        return;
+    }
+    command_queue = xQueueCreate(COMMAND_QUEUE_LEN, sizeof(command_t));
+    xTaskCreate(&macro_task, "macro", 4096, NULL, 3, NULL);
+}
+
+esp_err_t macro_record_start(const char *name) {
+    command_t cmd = {.type = CMD_RECORD};
+    int idle = MACRO_IDLE;
+
+    if (!valid_name(name)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (command_queue == NULL ||
+        !atomic_compare_exchange_strong(&state, &idle, MACRO_RECORDING)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    strcpy(cmd.name, name);
+    // Queued ahead of any chunk, so the old macro is gone before they land.
+    send_command(&cmd);
+
+    portENTER_CRITICAL(&recorder_mux);
+    memset(&recorder, 0, sizeof recorder);
+    recorder.active = true;
+    portEXIT_CRITICAL(&recorder_mux);
+    return ESP_OK;
+}
+
+esp_err_t macro_play(const char *name, uint8_t speed, const uint8_t *target) {
+    command_t cmd = {.type = CMD_PLAY, .speed = speed};
+    macro_header_t header;
+    int idle = MACRO_IDLE;
+
+    if (!valid_name(name) || speed == 0 || speed > MACRO_MAX_SPEED) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (command_queue == NULL ||
+        !atomic_compare_exchange_strong(&state, &idle, MACRO_PLAYING)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!read_header(name, &header)) {
+        atomic_store(&state, MACRO_IDLE);
+        return ESP_ERR_NOT_FOUND;
+    }
+    strcpy(cmd.name, name);
+    if (target != NULL) {
+        cmd.override_target = true;
+        cmd.target = *target;
+    }
+    atomic_store(&stop_replay, false);
+    atomic_store(&replayed, 0);
+    atomic_store(&replay_owner, mouse_scheduler_new_owner());
+    send_command(&cmd);
+    return ESP_OK;
+}
+
+static uint32_t stop_recording(void) {
+    command_t write = {.type = CMD_WRITE_CHUNK};
+    command_t finish = {.type = CMD_FINISH};
+    bool post = false;
+
+    portENTER_CRITICAL(&recorder_mux);
+    recorder.active = false;
+    chunk_t *chunk = &recorder.buffers[recorder.filling];
+    if (chunk->count > 0 && !recorder.writing[recorder.filling]) {
+        post = true;
+        write.buffer = recorder.filling;
+        write.chunk = recorder.next_chunk++;
+        recorder.writing[recorder.filling] = true;
+    }
+    finish.header.version = MACRO_FORMAT_VERSION;
+    finish.header.chunks = recorder.next_chunk;
+    finish.header.events = recorder.events;
+    finish.header.duration_ms = (recorder.last_us - recorder.first_us) / 1000;
+    portEXIT_CRITICAL(&recorder_mux);
+
+    if (post) {
+        send_command(&write);
+    }
+    send_command(&finish);
+    return finish.header.events;
+}
+
+esp_err_t macro_stop(uint32_t *events) {
+    switch (atomic_load(&state)) {
+    case MACRO_RECORDING:
+        *events = stop_recording();
+        return ESP_OK;
+    case MACRO_PLAYING:
+        atomic_store(&stop_replay, true);
+        mouse_scheduler_cancel(atomic_load(&replay_owner));
+        *events = atomic_load(&replayed);
+        return ESP_OK;
+    default:
+        return ESP_ERR_INVALID_STATE;
+    }
+}
+
+esp_err_t macro_delete(const char *name) {
+    macro_header_t header;
+
+    if (!valid_name(name)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // The macro task only touches flash while busy.
+    if (command_queue == NULL || atomic_load(&state) != MACRO_IDLE) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!read_header(name, &header)) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    erase_macro(name, header.chunks);
+    return ESP_OK;
+}
+
+size_t macro_list(char *buf, size_t len) {
+    size_t used = 0;
+
+    buf[0] = '\0';
+    nvs_iterator_t it =
+        nvs_entry_find(NVS_DEFAULT_PART_NAME, MACRO_NAMESPACE, NVS_TYPE_BLOB);
+    while (it != NULL) {
+        nvs_entry_info_t info;
+        macro_header_t header;
+        nvs_entry_info(it, &info);
+        it = nvs_entry_next(it);
+        // Chunks are listed through their header.
+        if (strchr(info.key, '.') != NULL || !read_header(info.key, &header)) {
+            continue;
+        }
+        int n = snprintf(buf + used, len - used,
+                         "%s events=%u duration_ms=%u\n", info.key,
+                         (unsigned)header.events,
+                         (unsigned)header.duration_ms);
+        if (n < 0 || (size_t)n >= len - used) {
+            used = len - 1;
+            nvs_release_iterator(it);
+            break;
+        }
+        used += n;
+    }
+    return used;
+}
+
+macro_state_t macro_get_state(void) { return atomic_load(&state); }
+
+const macro_stats_t *macro_get_stats(void) { return &stats; }
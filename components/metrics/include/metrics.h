@@ -0,0 +1,73 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "freertos/FreeRTOS.h"
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Text buffered before it is handed to the flush callback.
+#define METRICS_WRITER_BUF_LEN 768
+
+/**
+ * Counter with a slot per core. Incrementing touches only the caller's
+ * core's slot, so tasks on both cores never contend on it; the slots are
+ * summed when scraped.
+ */
+typedef struct {
+    atomic_uint per_core[portNUM_PROCESSORS];
+} metrics_counter_t;
+
+static inline void metrics_counter_add(metrics_counter_t *counter,
+                                       uint32_t n) {
+    atomic_fetch_add_explicit(&counter->per_core[xPortGetCoreID()], n,
+                              memory_order_relaxed);
+}
+
+static inline void metrics_counter_inc(metrics_counter_t *counter) {
+    metrics_counter_add(counter, 1);
+}
+
+uint32_t metrics_counter_sum(const metrics_counter_t *counter);
+
+typedef void (*metrics_flush_t)(void *ctx, const char *data, size_t len);
+
+/**
+ * Writes the Prometheus text exposition format in pieces of at most
+ * METRICS_WRITER_BUF_LEN, so a scrape needs no buffer for the whole page.
+ */
+typedef struct {
+    char buf[METRICS_WRITER_BUF_LEN];
+    size_t used;
+    metrics_flush_t flush;
+    void *ctx;
+} metrics_writer_t;
+
+void metrics_writer_init(metrics_writer_t *writer, metrics_flush_t flush,
+                         void *ctx);
+
+/**
+ * Start a metric family. type is "counter" or "gauge".
+ */
+void metrics_family(metrics_writer_t *writer, const char *name,
+                    const char *type, const char *help);
+
+/**
+ * One sample of the current family. labels is the text inside the braces,
+ * e.g. target="1", or NULL.
+ */
+void metrics_sample(metrics_writer_t *writer, const char *name,
+                    const char *labels, int64_t value);
+
+/**
+ * Family with a single unlabelled sample.
+ */
+void metrics_single(metrics_writer_t *writer, const char *name,
+                    const char *type, const char *help, int64_t value);
+
+/**
+ * Hand out what is still buffered.
+ */
+void metrics_writer_finish(metrics_writer_t *writer);
+
+#endif // METRICS_H
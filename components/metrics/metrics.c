@@ -0,0 +1,79 @@
+#include "metrics.h"
+#include <stdarg.h>
+#include <stdio.h>
+
+uint32_t metrics_counter_sum(const metrics_counter_t *counter) {
+    uint32_t sum = 0;
+    for (int i = 0; i < portNUM_PROCESSORS; i++) {
+        sum += atomic_load_explicit(&counter->per_core[i],
+                                    memory_order_relaxed);
+    }
+    return sum;
+}
+
+void metrics_writer_init(metrics_writer_t *writer, metrics_flush_t flush,
+                         void *ctx) {
+    writer->used = 0;
+    writer->flush = flush;
+    writer->ctx = ctx;
+}
+
+static void flush_buffer(metrics_writer_t *writer) {
+    if (writer->used > 0) {
+        writer->flush(writer->ctx, writer->buf, writer->used);
+        writer->used = 0;
+    }
+}
+
+/**
+ * Append one line, flushing first when it does not fit behind what is
+ * buffered. Lines longer than the buffer are cut.
+ */
+static void write_line(metrics_writer_t *writer, const char *format, ...) {
+    for (int attempt = 0; attempt < 2; attempt++) {
+        size_t room = sizeof writer->buf - writer->used;
+        va_list args;
+        va_start(args, format);
+        int len = vsnprintf(writer->buf + writer->used, room, format, args);
+        va_end(args);
+        if (len < 0) {
+            return;
+        }
+        if ((size_t)len < room) {
+            writer->used += len;
+            return;
+        }
+        if (writer->used == 0) {
+            // Too long even for an empty buffer; keep the cut line.
+            writer->used = sizeof writer->buf - 1;
+            writer->buf[writer->used - 1] = '\n';
+            return;
+        }
+        flush_buffer(writer);
+    }
+}
+
+void metrics_family(metrics_writer_t *writer, const char *name,
+                    const char *type, const char *help) {
+    write_line(writer, "# HELP %s %s\n# TYPE %s %s\n", name, help, name,
+               type);
+}
+
+void metrics_sample(metrics_writer_t *writer, const char *name,
+                    const char *labels, int64_t value) {
+    if (labels != NULL) {
+        write_line(writer, "%s{%s} %lld\n", name, labels, (long long)value);
+    } else {
+        write_line(writer, "%s %lld\n", name, (long long)value);
+    }
+}
+
+void metrics_single(metrics_writer_t *writer, const char *name,
+                    const char *type, const char *help, int64_t value) {
+    metrics_family(writer, name, type, help);
+    metrics_sample(writer, name, NULL, value);
+}
+
+void metrics_writer_finish(metrics_writer_t *writer) {
+    flush_buffer(writer);
+}
@@ -0,0 +1,67 @@
+#ifndef MOUSE_INPUT_H
+#define MOUSE_INPUT_H
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "mouse_notification.h"
+#include "mouse_ring.h"
+
+// Producers that can register a lane.
+#define MOUSE_INPUT_MAX_LANES 6
+
+/**
+ * One producer's path to the dispatcher. Each lane is a mouse_ring_t, so
+ * every lane must only be written from a single task.
+ */
+typedef struct {
+    const char *name;
+    mouse_ring_t ring;
+} mouse_input_lane_t;
+
+/**
+ * Create the lanes' shared wake semaphore. Call before any other function.
+ */
+void mouse_input_init(void);
+
+/**
+ * Returns NULL once MOUSE_INPUT_MAX_LANES are in use.
+ */
+mouse_input_lane_t *mouse_input_register_lane(const char *name,
+                                              mouse_ring_policy_t policy);
+
+/**
+ * Push one event under the lane's overflow policy and wake the consumer.
+ * Stamps received_us with the current time if the producer did not.
+ * Returns false if the event was dropped.
+ */
+bool mouse_input_submit(mouse_input_lane_t *lane,
+                        const mouse_notification_t *event);
+
+/**
+ * Push all events or none of them, and wake the consumer. Unlike
+ * mouse_input_submit, received_us is taken as given.
+ */
+bool mouse_input_submit_all(mouse_input_lane_t *lane,
+                            const mouse_notification_t *events, size_t count);
+
+/**
+ * Events one submission can take at most.
+ */
+size_t mouse_input_capacity(void);
+
+/**
+ * Consumer side. Given after every submission; take it, then drain with
+ * mouse_input_take until it returns false.
+ */
+SemaphoreHandle_t mouse_input_wake_semaphore(void);
+
+/**
+ * Take the next event from any lane, visiting lanes round robin.
+ */
+bool mouse_input_take(mouse_notification_t *event);
+
+size_t mouse_input_lane_count(void);
+
+mouse_input_lane_t *mouse_input_get_lane(size_t index);
+
+#endif // MOUSE_INPUT_H
@@ -0,0 +1,66 @@
+#ifndef MOUSE_NOTIFICATION_H
+#define MOUSE_NOTIFICATION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// mouse_notification_t.wheel units per wheel detent.
+#define MOUSE_WHEEL_RESOLUTION 120
+
+// Largest mouse_notification_t.abs_x/abs_y, at the right or bottom edge.
+#define MOUSE_ABS_MAX 32767
+
+// mouse_notification_t.target that reaches every connected host. Single
+// hosts are numbered from 1.
+#define MOUSE_TARGET_ALL 0
+
+// What mouse_notification_t.button_action does with the buttons in button.
+typedef enum {
+    // Pressed for this event only; the next event without them releases.
+    MOUSE_BUTTON_MOMENTARY = 0,
+    // Pressed until an MOUSE_BUTTON_UP.
+    MOUSE_BUTTON_DOWN,
+    MOUSE_BUTTON_UP,
+    // Pressed for hold_ms, then released.
+    MOUSE_BUTTON_CLICK,
+    // Two clicks, gap_ms apart.
+    MOUSE_BUTTON_DOUBLE_CLICK,
+} mouse_button_action_t;
+
+typedef struct {
+    int16_t x;
+    int16_t y;
+    // In 1/MOUSE_WHEEL_RESOLUTION detents.
+    int16_t wheel;
+    uint8_t button;
+    // mouse_button_action_t applied to button. The dispatcher keeps the
+    // buttons of commands pressed across events, see mouse_buttons.h.
+    uint8_t button_action;
+    // Press and release times of clicks, 0 for the configured defaults.
+    uint16_t hold_ms;
+    uint16_t gap_ms;
+    // Host to send to, MOUSE_TARGET_ALL for every connected one.
+    uint8_t target;
+    // Move the pointer to abs_x/abs_y (0..MOUSE_ABS_MAX) instead of by x/y.
+    // wheel is not used then.
+    bool absolute;
+    uint16_t abs_x;
+    uint16_t abs_y;
+    // Wait after the previous event before this one is sent, as received.
+    // Producers turn it into at_us; the dispatcher does not wait for it.
+    uint16_t delay_ms;
+    // esp_timer time to send at, through mouse_scheduler. 0 for as soon as
+    // possible.
+    int64_t at_us;
+    // esp_timer time the producer received it, where latency is measured
+    // from. mouse_input_submit stamps it when left 0.
+    int64_t received_us;
+    // Frame id to acknowledge once this event is sent over BLE.
+    uint16_t ack_id;
+    // Websocket waiting for the ack, 0 when none was requested.
+    int ack_fd;
+    // Session ack_fd belonged to, so a reused fd is not acked.
+    uint32_t ack_session;
+} mouse_notification_t;
+
+#endif // MOUSE_NOTIFICATION_H
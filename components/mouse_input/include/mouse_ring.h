@@ -0,0 +1,81 @@
+#ifndef MOUSE_RING_H
+#define MOUSE_RING_H
+
+#include "mouse_notification.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Power of two.
+#define MOUSE_RING_CAPACITY 64
+
+typedef enum {
+    // Keep what is queued, lose the new event.
+    MOUSE_RING_DROP_NEWEST = 0,
+    // Make room by losing the oldest queued event.
+    MOUSE_RING_DROP_OLDEST,
+    // Sum the new motion into the newest queued event. Falls back to
+    // dropping the new event when the two can't be merged.
+    MOUSE_RING_MERGE_TAIL,
+} mouse_ring_policy_t;
+
+typedef struct {
+    uint32_t pushed;
+    uint32_t popped;
+    uint32_t dropped_newest;
+    uint32_t dropped_oldest;
+    uint32_t merged;
+    // Highest occupancy seen by the producer.
+    uint32_t high_watermark;
+} mouse_ring_stats_t;
+
+typedef struct {
+    // One of the SLOT_* states in mouse_ring.c. Whoever moves a slot from
+    // full to busy owns it until setting it back.
+    atomic_uint state;
+    // Ring position of the stored event.
+    uint32_t pos;
+    mouse_notification_t event;
+} mouse_ring_slot_t;
+
+/**
+ * Fixed capacity lock-free ring with one producer and one consumer.
+ * Dropping the oldest event and merging into the newest one both claim the
+ * affected slot with a CAS, so neither side ever waits for the other; a
+ * claim that loses simply falls back to dropping the new event.
+ */
+typedef struct {
+    mouse_ring_slot_t slots[MOUSE_RING_CAPACITY];
+    // Next position to pop. Moved only by whoever owns the slot there.
+    atomic_uint head;
+    // Next position to push. Moved only by the producer.
+    atomic_uint tail;
+    mouse_ring_policy_t policy;
+    // Written by the producer, except popped.
+    mouse_ring_stats_t stats;
+} mouse_ring_t;
+
+void mouse_ring_init(mouse_ring_t *ring, mouse_ring_policy_t policy);
+
+/**
+ * Producer side. Returns false if the event was dropped.
+ */
+bool mouse_ring_push(mouse_ring_t *ring, const mouse_notification_t *event);
+
+/**
+ * Producer side. Pushes all events or, if they don't fit, none of them
+ * regardless of the policy.
+ */
+bool mouse_ring_push_all(mouse_ring_t *ring, const mouse_notification_t *events,
+                         size_t count);
+
+/**
+ * Consumer side. Returns false when empty, or when the next slot is
+ * momentarily claimed by the producer; the producer signals again after.
+ */
+bool mouse_ring_pop(mouse_ring_t *ring, mouse_notification_t *event);
+
+uint32_t mouse_ring_occupancy(mouse_ring_t *ring);
+
+#endif // MOUSE_RING_H
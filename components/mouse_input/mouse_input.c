@@ -0,0 +1,75 @@
+#include "mouse_input.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+
+static mouse_input_lane_t lanes[MOUSE_INPUT_MAX_LANES];
+static atomic_uint lane_count;
+static SemaphoreHandle_t wake_semaphore;
+// Lane the consumer looks at first next time, so no producer starves others.
+static size_t next_lane;
+
+void mouse_input_init(void) {
+    wake_semaphore = xSemaphoreCreateBinary();
+    atomic_init(&lane_count, 0);
+}
+
+mouse_input_lane_t *mouse_input_register_lane(const char *name,
+                                              mouse_ring_policy_t policy) {
+    static portMUX_TYPE register_mux = portMUX_INITIALIZER_UNLOCKED;
+    mouse_input_lane_t *lane = NULL;
+
+    // Only registration locks; the lane is published after it is set up.
+    portENTER_CRITICAL(&register_mux);
+    unsigned int index = atomic_load(&lane_count);
+    if (index < MOUSE_INPUT_MAX_LANES) {
+        lane = &lanes[index];
+        lane->name = name;
+        mouse_ring_init(&lane->ring, policy);
+        atomic_store(&lane_count, index + 1);
+    }
+    portEXIT_CRITICAL(&register_mux);
+    return lane;
+}
+
+bool mouse_input_submit(mouse_input_lane_t *lane,
+                        const mouse_notification_t *event) {
+    mouse_notification_t stamped = *event;
+    if (stamped.received_us == 0) {
+        stamped.received_us = esp_timer_get_time();
+    }
+    bool pushed = mouse_ring_push(&lane->ring, &stamped);
+    // Also on failure: the consumer may have backed off a slot we claimed.
+    xSemaphoreGive(wake_semaphore);
+    return pushed;
+}
+
+bool mouse_input_submit_all(mouse_input_lane_t *lane,
+                            const mouse_notification_t *events, size_t count) {
+    bool pushed = mouse_ring_push_all(&lane->ring, events, count);
+    if (pushed) {
+        xSemaphoreGive(wake_semaphore);
+    }
+    return pushed;
+}
+
+size_t mouse_input_capacity(void) { return MOUSE_RING_CAPACITY; }
+
+SemaphoreHandle_t mouse_input_wake_semaphore(void) { return wake_semaphore; }
+
+bool mouse_input_take(mouse_notification_t *event) {
+    size_t count = atomic_load(&lane_count);
+    for (size_t i = 0; i < count; i++) {
+        mouse_input_lane_t *lane = &lanes[(next_lane + i) % count];
+        if (mouse_ring_pop(&lane->ring, event)) {
+            next_lane = (next_lane + i + 1) % count;
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t mouse_input_lane_count(void) { return atomic_load(&lane_count); }
+
+mouse_input_lane_t *mouse_input_get_lane(size_t index) {
+    return index < mouse_input_lane_count() ? &lanes[index] : NULL;
+}
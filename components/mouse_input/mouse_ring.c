@@ -0,0 +1,182 @@
+#include "mouse_ring.h"
+#include <string.h>
+
+#define RING_MASK (MOUSE_RING_CAPACITY - 1)
+
+// Sums have to fit the event's own fields; the dispatcher splits them into
+// reports.
+#define EVENT_AXIS_MAX INT16_MAX
+
+enum {
+    SLOT_EMPTY = 0,
+    SLOT_FULL,
+    // Claimed by the consumer, or by the producer dropping or merging.
+    SLOT_BUSY,
+};
+
+void mouse_ring_init(mouse_ring_t *ring, mouse_ring_policy_t policy) {
+    memset(ring, 0, sizeof *ring);
+    for (int i = 0; i < MOUSE_RING_CAPACITY; i++) {
+        atomic_init(&ring->slots[i].state, SLOT_EMPTY);
+    }
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    ring->policy = policy;
+}
+
+static bool claim(mouse_ring_slot_t *slot) {
+    unsigned int expected = SLOT_FULL;
+    return atomic_compare_exchange_strong_explicit(
+        &slot->state, &expected, SLOT_BUSY, memory_order_acquire,
+        memory_order_relaxed);
+}
+
+static void store_at(mouse_ring_t *ring, uint32_t tail,
+                     const mouse_notification_t *event) {
+    mouse_ring_slot_t *slot = &ring->slots[tail & RING_MASK];
+    slot->pos = tail;
+    slot->event = *event;
+    atomic_store_explicit(&slot->state, SLOT_FULL, memory_order_release);
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+static bool fits_axis(int32_t value) {
+    return value >= -EVENT_AXIS_MAX && value <= EVENT_AXIS_MAX;
+}
+
+/**
+ * Whether event can be folded into queued without changing what the host
+ * sees beyond the timing of the motion.
+ */
+static bool mergeable(const mouse_notification_t *queued,
+                      const mouse_notification_t *event) {
+    return !queued->absolute && !event->absolute &&
+           queued->button == event->button &&
+           queued->button_action == MOUSE_BUTTON_MOMENTARY &&
+           event->button_action == MOUSE_BUTTON_MOMENTARY &&
+           queued->target == event->target && event->delay_ms == 0 &&
+           event->ack_fd == 0 && queued->ack_fd == 0 &&
+           fits_axis(queued->x + event->x) && fits_axis(queued->y + event->y) &&
+           fits_axis(queued->wheel + event->wheel);
+}
+
+static bool drop_oldest(mouse_ring_t *ring, uint32_t head) {
+    mouse_ring_slot_t *slot = &ring->slots[head & RING_MASK];
+    if (!claim(slot)) {
+        // The consumer is taking it right now, so room is on its way.
+        return false;
+    }
+    atomic_store_explicit(&slot->state, SLOT_EMPTY, memory_order_release);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    ring->stats.dropped_oldest++;
+    return true;
+}
+
+static bool merge_tail(mouse_ring_t *ring, uint32_t tail,
+                       const mouse_notification_t *event) {
+    mouse_ring_slot_t *slot = &ring->slots[(tail - 1) & RING_MASK];
+    if (!claim(slot)) {
+        return false;
+    }
+    bool merged = mergeable(&slot->event, event);
+    if (merged) {
+        slot->event.x += event->x;
+        slot->event.y += event->y;
+        slot->event.wheel += event->wheel;
+        ring->stats.merged++;
+    }
+    atomic_store_explicit(&slot->state, SLOT_FULL, memory_order_release);
+    return merged;
+}
+
+static void note_occupancy(mouse_ring_t *ring, uint32_t occupancy) {
+    if (occupancy > ring->stats.high_watermark) {
+        ring->stats.high_watermark = occupancy;
+    }
+}
+
+bool mouse_ring_push(mouse_ring_t *ring, const mouse_notification_t *event) {
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    // The consumer empties a slot before moving head, so a free position
+    // always has an empty slot.
+    if (tail - head == MOUSE_RING_CAPACITY) {
+        switch (ring->policy) {
+        case MOUSE_RING_DROP_OLDEST:
+            if (drop_oldest(ring, head)) {
+                break;
+            }
+            ring->stats.dropped_newest++;
+            return false;
+        case MOUSE_RING_MERGE_TAIL:
+            if (merge_tail(ring, tail, event)) {
+                return true;
+            }
+            ring->stats.dropped_newest++;
+            return false;
+        case MOUSE_RING_DROP_NEWEST:
+        default:
+            ring->stats.dropped_newest++;
+            return false;
+        }
+    }
+
+    store_at(ring, tail, event);
+    ring->stats.pushed++;
+    note_occupancy(ring, tail + 1 -
+                             atomic_load_explicit(&ring->head,
+                                                  memory_order_relaxed));
+    return true;
+}
+
+bool mouse_ring_push_all(mouse_ring_t *ring, const mouse_notification_t *events,
+                         size_t count) {
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    // Free space only grows while the producer is not pushing.
+    if (MOUSE_RING_CAPACITY - (tail - head) < count) {
+        ring->stats.dropped_newest += count;
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        store_at(ring, tail + i, &events[i]);
+    }
+    ring->stats.pushed += count;
+    note_occupancy(ring, tail + count - head);
+    return true;
+}
+
+bool mouse_ring_pop(mouse_ring_t *ring, mouse_notification_t *event) {
+    while (1) {
+        uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        if (head == tail) {
+            return false;
+        }
+
+        mouse_ring_slot_t *slot = &ring->slots[head & RING_MASK];
+        if (!claim(slot)) {
+            // Producer is dropping or merging into it and signals when done.
+            return false;
+        }
+        if (slot->pos != head) {
+            // head was dropped under us and the slot already reused.
+            atomic_store_explicit(&slot->state, SLOT_FULL,
+                                  memory_order_release);
+            continue;
+        }
+
+        *event = slot->event;
+        atomic_store_explicit(&slot->state, SLOT_EMPTY, memory_order_release);
+        atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+        ring->stats.popped++;
+        return true;
+    }
+}
+
+uint32_t mouse_ring_occupancy(mouse_ring_t *ring) {
+    return atomic_load_explicit(&ring->tail, memory_order_acquire) -
+           atomic_load_explicit(&ring->head, memory_order_acquire);
+}
@@ -0,0 +1,66 @@
+#ifndef MOUSE_SCHEDULER_H
+#define MOUSE_SCHEDULER_H
+
+#include "mouse_notification.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    uint32_t scheduled;
+    uint32_t released;
+    // Submissions refused because the queue was full.
+    uint32_t rejected;
+    // Events whose at_us had already passed when submitted, by more than
+    // the timer would be early anyway.
+    uint32_t late;
+    // How far past at_us events were handed to the dispatcher.
+    uint64_t lateness_total_us;
+    uint32_t lateness_max_us;
+    // Most events waiting at once.
+    uint32_t high_watermark;
+} mouse_scheduler_stats_t;
+
+// Owner of events nobody cancels as a group.
+#define MOUSE_SCHEDULER_NO_OWNER 0
+
+/**
+ * Register the "scheduled" mouse_input lane and create the release timer.
+ * mouse_input_init must have run.
+ */
+void mouse_scheduler_init(void);
+
+/**
+ * A new owner id, never MOUSE_SCHEDULER_NO_OWNER, for events to be counted
+ * or cancelled together.
+ */
+uint32_t mouse_scheduler_new_owner(void);
+
+/**
+ * Queue events until their mouse_notification_t.at_us, all of them or none.
+ * A one-shot esp_timer armed at the earliest one releases them into the
+ * "scheduled" lane, in time order and in submission order for equal times.
+ * delay_ms is ignored. Events already due go out on the next timer run.
+ * owner tags them for mouse_scheduler_cancel, MOUSE_SCHEDULER_NO_OWNER when
+ * nobody needs to.
+ * Returns false when CONFIG_MOUSE_SCHEDULER_CAPACITY would be exceeded.
+ */
+bool mouse_scheduler_submit_all(const mouse_notification_t *events,
+                                size_t count, uint32_t owner);
+
+/**
+ * Drop the queued events of owner, leaving everyone else's. Returns how
+ * many were dropped.
+ */
+size_t mouse_scheduler_cancel(uint32_t owner);
+
+size_t mouse_scheduler_pending(void);
+
+/**
+ * Events of owner still waiting for their time.
+ */
+size_t mouse_scheduler_pending_for(uint32_t owner);
+
+const mouse_scheduler_stats_t *mouse_scheduler_get_stats(void);
+
+#endif // MOUSE_SCHEDULER_H
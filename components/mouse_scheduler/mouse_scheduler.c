@@ -0,0 +1,250 @@
+#include "mouse_scheduler.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "mouse_input.h"
+#include "sdkconfig.h"
+
+#define SCHEDULER_TAG "mouse_scheduler"
+
+// Events due this soon are released now rather than on another timer run,
+// which would not fire much earlier.
+#define RELEASE_SLACK_US 200
+// Wait before trying a full lane again.
+#define RETRY_US 1000
+
+typedef struct {
+    mouse_notification_t event;
+    // Submission order, keeping equal times in order.
+    uint32_t seq;
+    uint32_t owner;
+} scheduled_event_t;
+
+// Binary min-heap on (event.at_us, seq).
+static scheduled_event_t heap[CONFIG_MOUSE_SCHEDULER_CAPACITY];
+static size_t heap_len = 0;
+static uint32_t next_seq = 0;
+static uint32_t last_owner = MOUSE_SCHEDULER_NO_OWNER;
+// Guards the heap, the timer and the stats against the submitting tasks.
+// Held only for list operations, never across a FreeRTOS call, so the
+// esp_timer task never waits for a preempted submitter.
+static portMUX_TYPE scheduler_mux = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t release_timer = NULL;
+// Only the timer callback submits to it.
+static mouse_input_lane_t *lane = NULL;
+static mouse_scheduler_stats_t stats;
+
+static bool earlier(const scheduled_event_t *a, const scheduled_event_t *b) {
+    if (a->event.at_us != b->event.at_us) {
+        return a->event.at_us < b->event.at_us;
+    }
+    return (int32_t)(a->seq - b->seq) < 0;
+}
+
+static void swap(size_t a, size_t b) {
+    scheduled_event_t tmp = heap[a];
+    heap[a] = heap[b];
+    heap[b] = tmp;
+}
+
+static void heap_insert(const scheduled_event_t *entry) {
+    size_t i = heap_len++;
+    heap[i] = *entry;
+    while (i > 0 && earlier(&heap[i], &heap[(i - 1) / 2])) {
+        swap(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void heap_push(const mouse_notification_t *event, uint32_t owner) {
+    scheduled_event_t entry = {
+        .event = *event, .seq = next_seq++, .owner = owner};
+    heap_insert(&entry);
+}
+
+static void sift_down(size_t i) {
+    while (1) {
+        size_t smallest = i;
+        size_t left = 2 * i + 1;
+        size_t right = left + 1;
+        if (left < heap_len && earlier(&heap[left], &heap[smallest])) {
+            smallest = left;
+        }
+        if (right < heap_len && earlier(&heap[right], &heap[smallest])) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            return;
+        }
+        swap(i, smallest);
+        i = smallest;
+    }
+}
+
+static void heap_pop(void) {
+    heap[0] = heap[--heap_len];
+    sift_down(0);
+}
+
+/**
+ * Arm the timer for the earliest event. Called with scheduler_mux held;
+ * esp_timer only takes its own spinlock.
+ */
+static void arm_timer(int64_t now_us) {
+    esp_timer_stop(release_timer);
+    if (heap_len == 0) {
+        return;
+    }
+    int64_t wait_us = heap[0].event.at_us - now_us;
+    esp_timer_start_once(release_timer, wait_us > 0 ? wait_us : 0);
+}
+
+static void note_lateness(int64_t lateness_us) {
+    if (lateness_us < 0) {
+        lateness_us = 0;
+    }
+    stats.lateness_total_us += lateness_us;
+    if (lateness_us > stats.lateness_max_us) {
+        stats.lateness_max_us = lateness_us;
+    }
+}
+
+/**
+ * Take the earliest event off the heap if it is due, else arm the timer for
+ * it.
+ */
+static bool take_due(scheduled_event_t *due) {
+    portENTER_CRITICAL(&scheduler_mux);
+    int64_t now_us = esp_timer_get_time();
+    bool taken =
+        heap_len > 0 && heap[0].event.at_us <= now_us + RELEASE_SLACK_US;
+    if (taken) {
+        *due = heap[0];
+        heap_pop();
+    } else {
+        arm_timer(now_us);
+    }
+    portEXIT_CRITICAL(&scheduler_mux);
+    return taken;
+}
+
+static void release_timer_cb(void *arg) {
+    scheduled_event_t due;
+    while (take_due(&due)) {
+        // Latency of a scheduled event counts from when it was due.
+        due.event.received_us = due.event.at_us;
+        // Outside the lock: submitting wakes the dispatcher.
+        bool submitted = mouse_input_submit(lane, &due.event);
+        int64_t now_us = esp_timer_get_time();
+        portENTER_CRITICAL(&scheduler_mux);
+        if (submitted) {
+            note_lateness(now_us - due.event.at_us);
+            stats.released++;
+        } else {
+            // The lane is full; the dispatcher wakes to drain it, so try
+            // again shortly rather than lose the event. It keeps its place
+            // among equal times.
+            heap_insert(&due);
+            esp_timer_stop(release_timer);
+            esp_timer_start_once(release_timer, RETRY_US);
+        }
+        portEXIT_CRITICAL(&scheduler_mux);
+        if (!submitted) {
+            ESP_LOGD(SCHEDULER_TAG, "lane full, retrying");
+            return;
+        }
+    }
+}
+
+void mouse_scheduler_init(void) {
+    // Events are released one by one; keep their timing unless the
+    // dispatcher falls behind, and then at least keep the motion.
+    lane = mouse_input_register_lane("scheduled", MOUSE_RING_MERGE_TAIL);
+    const esp_timer_create_args_t args = {.callback = release_timer_cb,
+                                          .name = "mouse_scheduler"};
+    ESP_ERROR_CHECK(esp_timer_create(&args, &release_timer));
+}
+
+uint32_t mouse_scheduler_new_owner(void) {
+    portENTER_CRITICAL(&scheduler_mux);
+    if (++last_owner == MOUSE_SCHEDULER_NO_OWNER) {
+        last_owner++;
+    }
+    uint32_t owner = last_owner;
+    portEXIT_CRITICAL(&scheduler_mux);
+    return owner;
+}
+
+bool mouse_scheduler_submit_all(const mouse_notification_t *events,
+                                size_t count, uint32_t owner) {
+    if (lane == NULL) {
+        return false;
+    }
+
+    portENTER_CRITICAL(&scheduler_mux);
+    if (CONFIG_MOUSE_SCHEDULER_CAPACITY - heap_len < count) {
+        stats.rejected += count;
+        portEXIT_CRITICAL(&scheduler_mux);
+        return false;
+    }
+    int64_t now_us = esp_timer_get_time();
+    int64_t earliest_us = heap_len > 0 ? heap[0].event.at_us : INT64_MAX;
+    for (size_t i = 0; i < count; i++) {
+        mouse_notification_t event = events[i];
+        event.delay_ms = 0;
+        // Due within the slack, it still goes out on time.
+        if (event.at_us + RELEASE_SLACK_US < now_us) {
+            stats.late++;
+        }
+        heap_push(&event, owner);
+    }
+    stats.scheduled += count;
+    if (heap_len > stats.high_watermark) {
+        stats.high_watermark = heap_len;
+    }
+    // Only a new earliest event needs the timer moved.
+    if (heap_len > 0 && heap[0].event.at_us < earliest_us) {
+        arm_timer(now_us);
+    }
+    portEXIT_CRITICAL(&scheduler_mux);
+    return true;
+}
+
+size_t mouse_scheduler_cancel(uint32_t owner) {
+    if (release_timer == NULL) {
+        return 0;
+    }
+    portENTER_CRITICAL(&scheduler_mux);
+    size_t kept = 0;
+    for (size_t i = 0; i < heap_len; i++) {
+        if (heap[i].owner != owner) {
+            heap[kept++] = heap[i];
+        }
+    }
+    size_t dropped = heap_len - kept;
+    if (dropped > 0) {
+        heap_len = kept;
+        for (size_t i = heap_len / 2; i-- > 0;) {
+            sift_down(i);
+        }
+        arm_timer(esp_timer_get_time());
+    }
+    portEXIT_CRITICAL(&scheduler_mux);
+    return dropped;
+}
+
+size_t mouse_scheduler_pending(void) { return heap_len; }
+
+size_t mouse_scheduler_pending_for(uint32_t owner) {
+    size_t pending = 0;
+    portENTER_CRITICAL(&scheduler_mux);
+    for (size_t i = 0; i < heap_len; i++) {
+        pending += heap[i].owner == owner;
+    }
+    portEXIT_CRITICAL(&scheduler_mux);
+    return pending;
+}
+
+const mouse_scheduler_stats_t *mouse_scheduler_get_stats(void) {
+    return &stats;
+}
@@ -0,0 +1,92 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "freertos/FreeRTOS.h"
+#include "sdkconfig.h"
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TRACE_LEVEL_NONE 0
+#define TRACE_LEVEL_INFO 1
+#define TRACE_LEVEL_DEBUG 2
+
+#define TRACE_ARGS 4
+
+/**
+ * What a record stands for. Names and argument names are in trace.c.
+ */
+typedef enum {
+    // GET /mouse queued an event: x, y, wheel, target.
+    TRACE_HTTP_MOUSE,
+    // UART console key: character, x, y.
+    TRACE_UART_KEY,
+    // Dispatcher sends relative motion: target, x, y, events merged.
+    TRACE_DISPATCH_MOVE,
+    // Dispatcher places the pointer: target, x, y.
+    TRACE_DISPATCH_PLACE,
+    // Dispatcher sends a keyboard report: target, modifiers, first key,
+    // strokes typed.
+    TRACE_DISPATCH_KEYS,
+    // Relative report handed to NimBLE: conn handle, x, y, wheel.
+    TRACE_REPORT_SEND,
+    // Host read the report characteristic: conn handle, buttons, rc.
+    TRACE_REPORT_READ,
+    TRACE_EVENT_COUNT,
+} trace_event_t;
+
+/**
+ * One fixed size record. seq is written last: the ring index plus one, so a
+ * reader can tell a finished record from one being overwritten.
+ */
+typedef struct {
+    int64_t ts_us;
+    atomic_uint seq;
+    uint32_t event;
+    int32_t args[TRACE_ARGS];
+} trace_record_t;
+
+/**
+ * Append a record to the calling core's ring. No formatting and no lock;
+ * safe from tasks on both cores and from interrupts.
+ */
+void trace_record(trace_event_t event, int32_t a0, int32_t a1, int32_t a2,
+                  int32_t a3);
+
+typedef void (*trace_flush_t)(void *ctx, const char *data, size_t len);
+
+/**
+ * Write what the rings hold as Chrome trace event JSON, which Perfetto and
+ * chrome://tracing open, in pieces through flush. Records overwritten while
+ * this runs are skipped.
+ */
+void trace_dump(trace_flush_t flush, void *ctx);
+
+/**
+ * Leave out everything recorded so far from later dumps.
+ */
+void trace_clear(void);
+
+// Trace points are compiled out above CONFIG_TRACE_LEVEL. The arguments are
+// then not evaluated.
+#define TRACE_POINT_OFF(event, a0, a1, a2, a3)                                 \
+    do {                                                                       \
+        (void)sizeof(a0);                                                      \
+        (void)sizeof(a1);                                                      \
+        (void)sizeof(a2);                                                      \
+        (void)sizeof(a3);                                                      \
+    } while (0)
+
+#if CONFIG_TRACE_LEVEL >= TRACE_LEVEL_INFO
+#define TRACE_I(event, a0, a1, a2, a3) trace_record(event, a0, a1, a2, a3)
+#else
+#define TRACE_I(event, a0, a1, a2, a3) TRACE_POINT_OFF(event, a0, a1, a2, a3)
+#endif
+
+#if CONFIG_TRACE_LEVEL >= TRACE_LEVEL_DEBUG
+#define TRACE_D(event, a0, a1, a2, a3) trace_record(event, a0, a1, a2, a3)
+#else
+#define TRACE_D(event, a0, a1, a2, a3) TRACE_POINT_OFF(event, a0, a1, a2, a3)
+#endif
+
+#endif // TRACE_H
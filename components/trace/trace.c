@@ -0,0 +1,166 @@
+#include "trace.h"
+#include "esp_timer.h"
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+// Text buffered by trace_dump before it is handed to the flush callback.
+#define TRACE_DUMP_BUF_LEN 512
+
+typedef struct {
+    // Index the next record goes to; it only grows, the slot wraps.
+    atomic_uint next;
+    // Dumps skip records below this index, set by trace_clear.
+    atomic_uint start;
+    trace_record_t records[CONFIG_TRACE_RING_LEN];
+} trace_ring_t;
+
+typedef struct {
+    const char *name;
+    // NULL for unused arguments.
+    const char *args[TRACE_ARGS];
+} trace_event_info_t;
+
+typedef struct {
+    char buf[TRACE_DUMP_BUF_LEN];
+    size_t used;
+    trace_flush_t flush;
+    void *ctx;
+} dump_writer_t;
+
+static const trace_event_info_t event_info[TRACE_EVENT_COUNT] = {
+    [TRACE_HTTP_MOUSE] = {"http_mouse", {"x", "y", "wheel", "target"}},
+    [TRACE_UART_KEY] = {"uart_key", {"key", "x", "y", NULL}},
+    [TRACE_DISPATCH_MOVE] = {"dispatch_move",
+                             {"target", "x", "y", "merged"}},
+    [TRACE_DISPATCH_PLACE] = {"dispatch_place", {"target", "x", "y", NULL}},
+    [TRACE_DISPATCH_KEYS] = {"dispatch_keys",
+                             {"target", "modifiers", "key", "strokes"}},
+    [TRACE_REPORT_SEND] = {"report_send", {"conn", "x", "y", "wheel"}},
+    [TRACE_REPORT_READ] = {"report_read", {"conn", "buttons", "rc", NULL}},
+};
+
+// One ring per core, so tasks on different cores never write the same
+// cache lines. Tasks sharing a core take slots with an atomic increment.
+static trace_ring_t rings[portNUM_PROCESSORS];
+
+void trace_record(trace_event_t event, int32_t a0, int32_t a1, int32_t a2,
+                  int32_t a3) {
+    int64_t ts_us = esp_timer_get_time();
+    // A task moved to the other core right after this still gets a slot of
+    // its own, only in the other core's ring.
+    trace_ring_t *ring = &rings[xPortGetCoreID()];
+    uint32_t index =
+        atomic_fetch_add_explicit(&ring->next, 1, memory_order_relaxed);
+    trace_record_t *record = &ring->records[index % CONFIG_TRACE_RING_LEN];
+
+    atomic_store_explicit(&record->seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    record->ts_us = ts_us;
+    record->event = event;
+    record->args[0] = a0;
+    record->args[1] = a1;
+    record->args[2] = a2;
+    record->args[3] = a3;
+    atomic_store_explicit(&record->seq, index + 1, memory_order_release);
+}
+
+void trace_clear(void) {
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        atomic_store(&rings[core].start, atomic_load(&rings[core].next));
+    }
+}
+
+/**
+ * Copy the record at index, or return false if it was not written yet or
+ * got overwritten while being copied.
+ */
+static bool read_record(trace_ring_t *ring, uint32_t index,
+                        trace_record_t *out) {
+    trace_record_t *record = &ring->records[index % CONFIG_TRACE_RING_LEN];
+    uint32_t seq = atomic_load_explicit(&record->seq, memory_order_acquire);
+    if (seq != index + 1) {
+        return false;
+    }
+    out->ts_us = record->ts_us;
+    out->event = record->event;
+    for (int i = 0; i < TRACE_ARGS; i++) {
+        out->args[i] = record->args[i];
+    }
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&record->seq, memory_order_relaxed) == seq &&
+           out->event < TRACE_EVENT_COUNT;
+}
+
+static void flush_buffer(dump_writer_t *writer) {
+    if (writer->used > 0) {
+        writer->flush(writer->ctx, writer->buf, writer->used);
+        writer->used = 0;
+    }
+}
+
+/**
+ * Append text, flushing first when it does not fit behind what is buffered.
+ */
+static void write_text(dump_writer_t *writer, const char *format, ...) {
+    for (int attempt = 0; attempt < 2; attempt++) {
+        size_t room = sizeof writer->buf - writer->used;
+        va_list args;
+        va_start(args, format);
+        int len = vsnprintf(writer->buf + writer->used, room, format, args);
+        va_end(args);
+        if (len < 0 || (size_t)len >= sizeof writer->buf) {
+            return;
+        }
+        if ((size_t)len < room) {
+            writer->used += len;
+            return;
+        }
+        flush_buffer(writer);
+    }
+}
+
+static void write_record(dump_writer_t *writer, int core,
+                         const trace_record_t *record) {
+    const trace_event_info_t *info = &event_info[record->event];
+
+    write_text(writer,
+               ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%lld,"
+               "\"pid\":1,\"tid\":%d,\"args\":{",
+               info->name, (long long)record->ts_us, core);
+    for (int i = 0; i < TRACE_ARGS && info->args[i] != NULL; i++) {
+        write_text(writer, "%s\"%s\":%d", i > 0 ? "," : "", info->args[i],
+                   (int)record->args[i]);
+    }
+    write_text(writer, "}}");
+}
+
+void trace_dump(trace_flush_t flush, void *ctx) {
+    dump_writer_t writer = {.used = 0, .flush = flush, .ctx = ctx};
+    trace_record_t record;
+
+    // Timestamps are esp_timer microseconds, the unit the format expects.
+    write_text(&writer, "{\"traceEvents\":[\n"
+                        "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+                        "\"args\":{\"name\":\"mouse_server\"}}");
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        trace_ring_t *ring = &rings[core];
+        write_text(&writer,
+                   ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                   "\"tid\":%d,\"args\":{\"name\":\"core %d\"}}",
+                   core, core);
+
+        uint32_t next = atomic_load_explicit(&ring->next, memory_order_acquire);
+        uint32_t first = atomic_load(&ring->start);
+        if (next - first > CONFIG_TRACE_RING_LEN) {
+            first = next - CONFIG_TRACE_RING_LEN;
+        }
+        for (uint32_t index = first; index != next; index++) {
+            if (read_record(ring, index, &record)) {
+                write_record(&writer, core, &record);
+            }
+        }
+    }
+    write_text(&writer, "\n]}\n");
+    flush_buffer(&writer);
+}
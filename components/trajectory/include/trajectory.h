@@ -0,0 +1,78 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include "esp_err.h"
+#include "trajectory_curve.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Trajectories that can run at the same time.
+#define TRAJECTORY_MAX_ACTIVE 4
+
+// Duration when a request does not give one, and the longest accepted.
+#define TRAJECTORY_DEFAULT_DURATION_MS 200
+#define TRAJECTORY_MAX_DURATION_MS 10000
+
+typedef struct {
+    trajectory_curve_t curve;
+    // Relative: total motion, wheel in 1/MOUSE_WHEEL_RESOLUTION detents.
+    int16_t dx;
+    int16_t dy;
+    int16_t wheel;
+    // Absolute: move to ax/ay, starting at from_x/from_y when has_from is
+    // set and at the last absolute point a trajectory reached otherwise.
+    bool absolute;
+    uint16_t ax;
+    uint16_t ay;
+    bool has_from;
+    uint16_t from_x;
+    uint16_t from_y;
+    // Bezier control points, relative to the start.
+    int16_t c1x;
+    int16_t c1y;
+    int16_t c2x;
+    int16_t c2y;
+    uint16_t duration_ms;
+    // Buttons held while moving, e.g. for a drag. Released once the
+    // trajectory ends or is cancelled.
+    uint8_t button;
+    // mouse_notification_t.target of every step.
+    uint8_t target;
+} trajectory_request_t;
+
+typedef struct {
+    uint32_t started;
+    uint32_t completed;
+    uint32_t cancelled;
+    // Events handed to the "trajectory" lane, and those it refused, which a
+    // later step sends again.
+    uint32_t steps;
+    uint32_t dropped;
+} trajectory_stats_t;
+
+/**
+ * Register the "trajectory" mouse_input lane and create the step timer.
+ * mouse_input_init must have run.
+ */
+void trajectory_init(void);
+
+/**
+ * Start a trajectory and write its id. Steps go out every
+ * CONFIG_TRAJECTORY_STEP_MS on an esp_timer, each one the motion since the
+ * previous step. Buttons of running trajectories with the same target are
+ * combined, so a drag and a move compose.
+ * ESP_ERR_NO_MEM when TRAJECTORY_MAX_ACTIVE are running.
+ */
+esp_err_t trajectory_start(const trajectory_request_t *request,
+                           uint32_t *id);
+
+/**
+ * Stop a running trajectory where it is, releasing its buttons.
+ * id 0 cancels all of them.
+ * Returns the number cancelled.
+ */
+int trajectory_cancel(uint32_t id);
+
+const trajectory_stats_t *trajectory_get_stats(void);
+
+#endif // TRAJECTORY_H
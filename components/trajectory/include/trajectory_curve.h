@@ -0,0 +1,50 @@
+#ifndef TRAJECTORY_CURVE_H
+#define TRAJECTORY_CURVE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    // Straight line at constant speed.
+    TRAJECTORY_LINEAR = 0,
+    // Straight line, accelerating and then slowing down.
+    TRAJECTORY_EASE_IN_OUT,
+    // Cubic Bezier path through the two control points, constant parameter
+    // speed.
+    TRAJECTORY_BEZIER,
+    TRAJECTORY_CURVE_COUNT,
+} trajectory_curve_t;
+
+typedef struct {
+    float x;
+    float y;
+} trajectory_point_t;
+
+typedef struct {
+    trajectory_curve_t curve;
+    trajectory_point_t from;
+    trajectory_point_t to;
+    // Bezier control points, absolute like from and to.
+    trajectory_point_t c1;
+    trajectory_point_t c2;
+} trajectory_path_t;
+
+/**
+ * Point of path at t in 0..1, where t is the elapsed fraction of the
+ * duration.
+ */
+trajectory_point_t trajectory_path_at(const trajectory_path_t *path, float t);
+
+/**
+ * Fraction of a straight motion covered at t, as used for the wheel.
+ */
+float trajectory_progress(trajectory_curve_t curve, float t);
+
+/**
+ * Curve by name: "linear", "ease" or "bezier". Returns false for others.
+ */
+bool trajectory_curve_from_name(const char *name, size_t len,
+                                trajectory_curve_t *curve);
+
+#endif // TRAJECTORY_CURVE_H
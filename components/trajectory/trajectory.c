@@ -0,0 +1,332 @@
+#include "trajectory.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "mouse_input.h"
+#include "sdkconfig.h"
+#include <math.h>
+#include <string.h>
+
+#define TRAJECTORY_TAG "trajectory"
+
+// Events one step can produce: a move and a release per trajectory.
+#define STEP_EVENTS_MAX (2 * TRAJECTORY_MAX_ACTIVE)
+
+typedef struct {
+    bool active;
+    bool cancelled;
+    uint32_t id;
+    trajectory_request_t request;
+    trajectory_path_t path;
+    int64_t start_us;
+    // Whole units already sent by a relative trajectory.
+    int32_t sent_x;
+    int32_t sent_y;
+    int32_t sent_wheel;
+    // A step carrying its buttons is queued, so idle steps can be skipped.
+    bool pressed;
+    // Its last events are being queued. It keeps its slot until they are
+    // in, so one the lane refuses can go back to it.
+    bool ending;
+} trajectory_t;
+
+static trajectory_t trajectories[TRAJECTORY_MAX_ACTIVE];
+// Guards trajectories, the timer and the stats against trajectory_start and
+// trajectory_cancel, which run in other tasks than the timer callback. Never
+// held across a FreeRTOS call, so the esp_timer task does not wait for a
+// preempted caller.
+static portMUX_TYPE trajectory_mux = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t step_timer = NULL;
+static bool timer_running = false;
+// Only the timer callback submits to it.
+static mouse_input_lane_t *lane = NULL;
+static uint32_t next_id = 1;
+// Last point an absolute trajectory reached, where the next one starts.
+static bool has_last_abs = false;
+static trajectory_point_t last_abs;
+static trajectory_stats_t stats;
+
+static bool shares_target(uint8_t a, uint8_t b) {
+    return a == MOUSE_TARGET_ALL || b == MOUSE_TARGET_ALL || a == b;
+}
+
+/**
+ * Buttons held by the running trajectories that reach target.
+ */
+static uint8_t held_buttons(uint8_t target) {
+    uint8_t buttons = 0;
+    for (int i = 0; i < TRAJECTORY_MAX_ACTIVE; i++) {
+        const trajectory_t *t = &trajectories[i];
+        if (t->active && !t->ending &&
+            shares_target(t->request.target, target)) {
+            buttons |= t->request.button;
+        }
+    }
+    return buttons;
+}
+
+/**
+ * Motion from what was already sent up to position, in whole units.
+ */
+static int16_t take_units(float position, int32_t *sent) {
+    int32_t delta = (int32_t)lroundf(position) - *sent;
+    if (delta > INT16_MAX) {
+        delta = INT16_MAX;
+    } else if (delta < -INT16_MAX) {
+        delta = -INT16_MAX;
+    }
+    *sent += delta;
+    return (int16_t)delta;
+}
+
+static uint16_t abs_coordinate(float value) {
+    if (value <= 0.0f) {
+        return 0;
+    }
+    return value >= MOUSE_ABS_MAX ? MOUSE_ABS_MAX : (uint16_t)lroundf(value);
+}
+
+static void build_path(trajectory_t *t) {
+    const trajectory_request_t *request = &t->request;
+    trajectory_path_t *path = &t->path;
+
+    path->curve = request->curve;
+    if (request->absolute) {
+        path->to.x = request->ax;
+        path->to.y = request->ay;
+        if (request->has_from) {
+            path->from.x = request->from_x;
+            path->from.y = request->from_y;
+        } else if (has_last_abs) {
+            path->from = last_abs;
+        } else {
+            // Nowhere known to start from; place directly.
+            path->from = path->to;
+        }
+    } else {
+        path->from.x = 0.0f;
+        path->from.y = 0.0f;
+        path->to.x = request->dx;
+        path->to.y = request->dy;
+    }
+    path->c1.x = path->from.x + request->c1x;
+    path->c1.y = path->from.y + request->c1y;
+    path->c2.x = path->from.x + request->c2x;
+    path->c2.y = path->from.y + request->c2y;
+}
+
+/**
+ * Fill the event moving t to where it is at now_us.
+ * Returns true once it reached its end and all of its motion is taken.
+ */
+static bool step_one(trajectory_t *t, int64_t now_us,
+                     mouse_notification_t *mouse_ev) {
+    const trajectory_request_t *request = &t->request;
+    float progress = 1.0f;
+    if (request->duration_ms > 0) {
+        progress = (float)(now_us - t->start_us) /
+                   (request->duration_ms * 1000.0f);
+        if (progress > 1.0f) {
+            progress = 1.0f;
+        }
+    }
+
+    trajectory_point_t point = trajectory_path_at(&t->path, progress);
+    memset(mouse_ev, 0, sizeof *mouse_ev);
+    mouse_ev->target = request->target;
+    if (request->absolute) {
+        mouse_ev->absolute = true;
+        mouse_ev->abs_x = abs_coordinate(point.x);
+        mouse_ev->abs_y = abs_coordinate(point.y);
+        last_abs = point;
+        has_last_abs = true;
+    } else {
+        mouse_ev->x = take_units(point.x, &t->sent_x);
+        mouse_ev->y = take_units(point.y, &t->sent_y);
+        float wheel =
+            request->wheel * trajectory_progress(request->curve, progress);
+        mouse_ev->wheel = take_units(wheel, &t->sent_wheel);
+        // Motion too long for one event is left for the next steps.
+        if (t->sent_x != lroundf(point.x) || t->sent_y != lroundf(point.y) ||
+            t->sent_wheel != lroundf(wheel)) {
+            return false;
+        }
+    }
+    return progress >= 1.0f;
+}
+
+/**
+ * Hand what an event the lane refused took back to its trajectory, so a
+ * later step sends it again.
+ */
+static void unstep(trajectory_t *t, const mouse_notification_t *mouse_ev) {
+    if (t->ending) {
+        // It ended with this step; it ends again once the rest is out.
+        t->ending = false;
+        if (!t->cancelled) {
+            stats.completed--;
+        }
+    }
+    if (!t->request.absolute) {
+        t->sent_x -= mouse_ev->x;
+        t->sent_y -= mouse_ev->y;
+        t->sent_wheel -= mouse_ev->wheel;
+    }
+}
+
+/**
+ * One step of every running trajectory, from the esp_timer task.
+ */
+static void step_timer_cb(void *arg) {
+    mouse_notification_t events[STEP_EVENTS_MAX];
+    // Trajectory each event belongs to, and whether it is its release.
+    trajectory_t *owners[STEP_EVENTS_MAX];
+    bool releases[STEP_EVENTS_MAX];
+    size_t count = 0;
+    int64_t now_us = esp_timer_get_time();
+
+    portENTER_CRITICAL(&trajectory_mux);
+    for (int i = 0; i < TRAJECTORY_MAX_ACTIVE; i++) {
+        trajectory_t *t = &trajectories[i];
+        if (!t->active) {
+            continue;
+        }
+        if (!t->cancelled) {
+            mouse_notification_t *mouse_ev = &events[count];
+            bool done = step_one(t, now_us, mouse_ev);
+            // Nothing moved; only the first step has buttons to press.
+            bool idle = !mouse_ev->absolute && mouse_ev->x == 0 &&
+                        mouse_ev->y == 0 && mouse_ev->wheel == 0 &&
+                        (t->pressed || t->request.button == 0);
+            if (!idle) {
+                owners[count] = t;
+                releases[count++] = false;
+            }
+            if (!done) {
+                continue;
+            }
+            stats.completed++;
+        }
+        t->ending = true;
+        if (t->request.button != 0) {
+            memset(&events[count], 0, sizeof events[count]);
+            events[count].target = t->request.target;
+            owners[count] = t;
+            releases[count++] = true;
+        }
+    }
+    // Buttons are settled once every trajectory has stepped, so one ending
+    // now no longer holds them for the others.
+    for (size_t i = 0; i < count; i++) {
+        events[i].button = held_buttons(events[i].target);
+        if (!releases[i]) {
+            // Its last move still carries its own buttons.
+            events[i].button |= owners[i]->request.button;
+        }
+    }
+    portEXIT_CRITICAL(&trajectory_mux);
+
+    // Submitting wakes the dispatcher, so not under the lock. The slots of
+    // ending trajectories stay taken meanwhile.
+    size_t queued = 0;
+    while (queued < count && mouse_input_submit(lane, &events[queued])) {
+        queued++;
+    }
+
+    portENTER_CRITICAL(&trajectory_mux);
+    for (size_t i = 0; i < queued; i++) {
+        if (!releases[i]) {
+            owners[i]->pressed = true;
+        }
+    }
+    stats.steps += queued;
+    // The lane is full. Stop there to keep the order; the rest is sent again
+    // by the next step.
+    for (size_t i = queued; i < count; i++) {
+        unstep(owners[i], &events[i]);
+        stats.dropped++;
+    }
+    bool any_active = false;
+    for (int i = 0; i < TRAJECTORY_MAX_ACTIVE; i++) {
+        trajectory_t *t = &trajectories[i];
+        if (t->ending) {
+            // All of its events are in.
+            t->active = false;
+            t->ending = false;
+        }
+        any_active |= t->active;
+    }
+    if (!any_active) {
+        // trajectory_start restarts it under the same lock.
+        esp_timer_stop(step_timer);
+        timer_running = false;
+    }
+    portEXIT_CRITICAL(&trajectory_mux);
+}
+
+void trajectory_init(void) {
+    // Steps carry motion since the previous one, so merging keeps the total.
+    lane = mouse_input_register_lane("trajectory", MOUSE_RING_MERGE_TAIL);
+    const esp_timer_create_args_t args = {.callback = step_timer_cb,
+                                          .name = "trajectory"};
+    ESP_ERROR_CHECK(esp_timer_create(&args, &step_timer));
+}
+
+esp_err_t trajectory_start(const trajectory_request_t *request,
+                           uint32_t *id) {
+    esp_err_t err = ESP_ERR_NO_MEM;
+    if (lane == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    portENTER_CRITICAL(&trajectory_mux);
+    for (int i = 0; i < TRAJECTORY_MAX_ACTIVE; i++) {
+        trajectory_t *t = &trajectories[i];
+        if (t->active) {
+            continue;
+        }
+        memset(t, 0, sizeof *t);
+        t->request = *request;
+        t->id = next_id++;
+        if (next_id == 0) {
+            next_id = 1;
+        }
+        t->start_us = esp_timer_get_time();
+        build_path(t);
+        t->active = true;
+        *id = t->id;
+        stats.started++;
+        err = ESP_OK;
+        break;
+    }
+    if (err == ESP_OK && !timer_running) {
+        esp_timer_start_periodic(step_timer, CONFIG_TRAJECTORY_STEP_MS * 1000);
+        timer_running = true;
+    }
+    portEXIT_CRITICAL(&trajectory_mux);
+    return err;
+}
+
+int trajectory_cancel(uint32_t id) {
+    int cancelled = 0;
+    if (step_timer == NULL) {
+        return 0;
+    }
+
+    portENTER_CRITICAL(&trajectory_mux);
+    for (int i = 0; i < TRAJECTORY_MAX_ACTIVE; i++) {
+        trajectory_t *t = &trajectories[i];
+        // One ending is as good as done.
+        if (t->active && !t->ending && !t->cancelled &&
+            (id == 0 || t->id == id)) {
+            // The next step releases its buttons.
+            t->cancelled = true;
+            cancelled++;
+        }
+    }
+    stats.cancelled += cancelled;
+    portEXIT_CRITICAL(&trajectory_mux);
+    return cancelled;
+}
+
+const trajectory_stats_t *trajectory_get_stats(void) { return &stats; }
@@ -0,0 +1,67 @@
+#include "trajectory_curve.h"
+#include <stddef.h>
+#include <string.h>
+
+static const char *const curve_names[TRAJECTORY_CURVE_COUNT] = {
+    [TRAJECTORY_LINEAR] = "linear",
+    [TRAJECTORY_EASE_IN_OUT] = "ease",
+    [TRAJECTORY_BEZIER] = "bezier",
+};
+
+static float clamp_unit(float t) {
+    if (t < 0.0f) {
+        return 0.0f;
+    }
+    return t > 1.0f ? 1.0f : t;
+}
+
+float trajectory_progress(trajectory_curve_t curve, float t) {
+    t = clamp_unit(t);
+    if (curve == TRAJECTORY_EASE_IN_OUT) {
+        // Cubic ease in and out, symmetric around the midpoint.
+        if (t < 0.5f) {
+            return 4.0f * t * t * t;
+        }
+        float rest = 2.0f - 2.0f * t;
+        return 1.0f - rest * rest * rest / 2.0f;
+    }
+    return t;
+}
+
+static float lerp(float from, float to, float s) {
+    return from + (to - from) * s;
+}
+
+trajectory_point_t trajectory_path_at(const trajectory_path_t *path,
+                                      float t) {
+    trajectory_point_t point;
+    t = clamp_unit(t);
+    if (path->curve == TRAJECTORY_BEZIER) {
+        float u = 1.0f - t;
+        float b0 = u * u * u;
+        float b1 = 3.0f * u * u * t;
+        float b2 = 3.0f * u * t * t;
+        float b3 = t * t * t;
+        point.x = b0 * path->from.x + b1 * path->c1.x + b2 * path->c2.x +
+                  b3 * path->to.x;
+        point.y = b0 * path->from.y + b1 * path->c1.y + b2 * path->c2.y +
+                  b3 * path->to.y;
+        return point;
+    }
+    float s = trajectory_progress(path->curve, t);
+    point.x = lerp(path->from.x, path->to.x, s);
+    point.y = lerp(path->from.y, path->to.y, s);
+    return point;
+}
+
+bool trajectory_curve_from_name(const char *name, size_t len,
+                                trajectory_curve_t *curve) {
+    for (int i = 0; i < TRAJECTORY_CURVE_COUNT; i++) {
+        if (strlen(curve_names[i]) == len &&
+            memcmp(curve_names[i], name, len) == 0) {
+            *curve = i;
+            return true;
+        }
+    }
+    return false;
+}
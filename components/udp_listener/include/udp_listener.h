@@ -0,0 +1,54 @@
+#ifndef UDP_LISTENER_H
+#define UDP_LISTENER_H
+
+#include "mouse_input.h"
+#include "mouse_wire.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct {
+    uint32_t received;
+    uint32_t accepted;
+    // Same sequence number as the last accepted datagram.
+    uint32_t duplicates;
+    // Older than the last accepted datagram.
+    uint32_t stale;
+    // Wrong size or values the report can't carry.
+    uint32_t malformed;
+    // Accepted but lost to the lane's overflow policy.
+    uint32_t queue_full;
+} udp_listener_stats_t;
+
+typedef struct {
+    bool has_last;
+    uint32_t last_seq;
+    // Sender of last_seq; a new sender starts its own sequence.
+    uint32_t last_addr;
+    uint16_t last_port;
+    uint64_t last_client_us;
+    udp_listener_stats_t stats;
+} udp_listener_state_t;
+
+/**
+ * Decide whether a datagram from addr:port should be used and decode it.
+ * Needs no socket, so the filtering can be run against any packet source.
+ */
+bool udp_listener_accept(udp_listener_state_t *state, const void *datagram,
+                         size_t len, uint32_t addr, uint16_t port,
+                         mouse_notification_t *mouse_ev);
+
+/**
+ * Receive datagrams from an already bound socket into lane until the socket
+ * fails. Works with any socket, e.g. a loopback one on a host build.
+ */
+void udp_listener_serve(int sock, mouse_input_lane_t *lane,
+                        udp_listener_state_t *state);
+
+/**
+ * Start a task listening on port, feeding its own "udp" mouse_input lane.
+ */
+void start_udp_listener(uint16_t port);
+
+const udp_listener_stats_t *udp_listener_get_stats(void);
+
+#endif // UDP_LISTENER_H
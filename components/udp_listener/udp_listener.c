@@ -0,0 +1,132 @@
+#include "udp_listener.h"
+#include "freertos/task.h"
+#include <string.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+
+#define UDP_TAG "udp_listener"
+
+// A sequence number this far behind the last one means the client restarted
+// its counter rather than a late packet.
+#define SEQ_RESYNC_WINDOW 1024
+
+typedef struct {
+    uint16_t port;
+    mouse_input_lane_t *lane;
+} udp_listener_args_t;
+
+static udp_listener_args_t listener_args;
+static udp_listener_state_t listener_state;
+
+bool udp_listener_accept(udp_listener_state_t *state, const void *datagram,
+                         size_t len, uint32_t addr, uint16_t port,
+                         mouse_notification_t *mouse_ev) {
+    mouse_wire_datagram_t packet;
+
+    state->stats.received++;
+    if (len != sizeof packet) {
+        state->stats.malformed++;
+        return false;
+    }
+    memcpy(&packet, datagram, sizeof packet);
+
+    bool same_sender = state->has_last && state->last_addr == addr &&
+                       state->last_port == port;
+    if (same_sender) {
+        int32_t diff = (int32_t)(packet.seq - state->last_seq);
+        if (diff == 0) {
+            state->stats.duplicates++;
+            return false;
+        }
+        if (diff < 0 && diff > -SEQ_RESYNC_WINDOW) {
+            state->stats.stale++;
+            return false;
+        }
+    }
+
+    mouse_wire_event_t event = {.dx = packet.dx,
+                                .dy = packet.dy,
+                                .wheel = packet.wheel,
+                                .buttons = packet.buttons,
+                                .delay_ms = 0};
+    if (!mouse_wire_decode(&event, mouse_ev)) {
+        state->stats.malformed++;
+        return false;
+    }
+
+    state->has_last = true;
+    state->last_seq = packet.seq;
+    state->last_addr = addr;
+    state->last_port = port;
+    state->last_client_us = packet.client_us;
+    state->stats.accepted++;
+    return true;
+}
+
+void udp_listener_serve(int sock, mouse_input_lane_t *lane,
+                        udp_listener_state_t *state) {
+    // One byte more than a datagram so oversized ones are seen as such.
+    uint8_t buf[sizeof(mouse_wire_datagram_t) + 1];
+    struct sockaddr_in from;
+    socklen_t from_len;
+    mouse_notification_t mouse_ev;
+
+    while (1) {
+        from_len = sizeof from;
+        int len = recvfrom(sock, buf, sizeof buf, 0, (struct sockaddr *)&from,
+                           &from_len);
+        if (len < 0) {
+            ESP_LOGE(UDP_TAG, "recvfrom failed");
+            return;
+        }
+        if (udp_listener_accept(state, buf, len, from.sin_addr.s_addr,
+                                from.sin_port, &mouse_ev) &&
+            !mouse_input_submit(lane, &mouse_ev)) {
+            state->stats.queue_full++;
+        }
+    }
+}
+
+static void udp_listener_task(void *pvParameters) {
+    udp_listener_args_t *args = (udp_listener_args_t *)pvParameters;
+
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) {
+        ESP_LOGE(UDP_TAG, "Unable to create socket");
+        vTaskDelete(NULL);
+        return;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(args->port);
+    if (bind(sock, (struct sockaddr *)&addr, sizeof addr) < 0) {
+        ESP_LOGE(UDP_TAG, "Unable to bind port %d", args->port);
+        close(sock);
+        vTaskDelete(NULL);
+        return;
+    }
+
+    ESP_LOGI(UDP_TAG, "Listening on UDP port %d", args->port);
+    udp_listener_serve(sock, args->lane, &listener_state);
+    close(sock);
+    vTaskDelete(NULL);
+}
+
+void start_udp_listener(uint16_t port) {
+    listener_args.port = port;
+    // Only the newest motion matters on this path; stale datagrams go first.
+    listener_args.lane =
+        mouse_input_register_lane("udp", MOUSE_RING_DROP_OLDEST);
+    xTaskCreate(&udp_listener_task, "udp_listener", 4096, &listener_args, 5,
+                NULL);
+}
+
+const udp_listener_stats_t *udp_listener_get_stats(void) {
+    return &listener_state.stats;
+}
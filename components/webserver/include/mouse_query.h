@@ -0,0 +1,65 @@
+#ifndef MOUSE_QUERY_H
+#define MOUSE_QUERY_H
+
+#include "mouse_notification.h"
+#include "trajectory.h"
+#include <stddef.h>
+
+// Longest hold= and gap= of a button command.
+#define MOUSE_BUTTON_MAX_MS 5000
+
+typedef enum {
+    MOUSE_QUERY_OK = 0,
+    // Value is not a number, or not true/false for a flag.
+    MOUSE_QUERY_MALFORMED,
+    // Number does not fit in the report field.
+    MOUSE_QUERY_OUT_OF_RANGE,
+    // Only part of a point, such as ax without ay, was given.
+    MOUSE_QUERY_INCOMPLETE,
+} mouse_query_status_t;
+
+typedef struct {
+    mouse_query_status_t status;
+    // Offending key inside the parsed query, not NUL terminated.
+    const char *key;
+    size_t key_len;
+} mouse_query_error_t;
+
+/**
+ * Parse a /mouse query string (without '?') in one pass.
+ * Unknown keys are ignored. ax/ay make an absolute event, which ignores x, y
+ * and wheel. at is the esp_timer time to send it at. action (down, up, click
+ * or double; click=true is action=click) applies to the buttons in button,
+ * button 1 when none are given, with hold and gap in ms. On error, mouse_ev
+ * is left partially filled and err describes the first bad key.
+ */
+mouse_query_status_t parse_mouse_query(const char *query, size_t len,
+                                       mouse_notification_t *mouse_ev,
+                                       mouse_query_error_t *err);
+
+/**
+ * Parse a /mouse/move query string (without '?') into a trajectory.
+ * Unknown keys are ignored. ax/ay make an absolute trajectory, starting at
+ * fx/fy when given. curve is "linear", "ease" (the default) or "bezier" with
+ * control points c1x/c1y and c2x/c2y relative to the start; ms is the
+ * duration, TRAJECTORY_DEFAULT_DURATION_MS when absent.
+ */
+mouse_query_status_t parse_move_query(const char *query, size_t len,
+                                      trajectory_request_t *request,
+                                      mouse_query_error_t *err);
+
+/**
+ * Parse a target value: "all" or a host number from 1.
+ */
+mouse_query_status_t parse_mouse_target(const char *value, size_t len,
+                                        uint8_t *target);
+
+/**
+ * Parse an esp_timer time in microseconds.
+ */
+mouse_query_status_t parse_mouse_time(const char *value, size_t len,
+                                      int64_t *time_us);
+
+const char *mouse_query_status_str(mouse_query_status_t status);
+
+#endif // MOUSE_QUERY_H
@@ -0,0 +1,60 @@
+#ifndef MOUSE_WIRE_H
+#define MOUSE_WIRE_H
+
+#include "mouse_notification.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Binary motion record shared by the streaming endpoints.
+ * Packed, little endian. dx, dy and wheel range from -127 to 127. delay_ms
+ * is the wait after the previous event.
+ */
+typedef struct __attribute__((packed)) {
+    int8_t dx;
+    int8_t dy;
+    int8_t wheel;
+    uint8_t buttons;
+    uint16_t delay_ms;
+} mouse_wire_event_t;
+
+// Set in mouse_wire_frame_header_t.flags to get a mouse_wire_ack_t back.
+#define MOUSE_WIRE_FLAG_ACK 0x01
+
+/**
+ * Header of a binary websocket frame, followed by mouse_wire_event_t records.
+ */
+typedef struct __attribute__((packed)) {
+    uint8_t flags;
+    uint16_t frame_id;
+} mouse_wire_frame_header_t;
+
+/**
+ * Sent back for frames with MOUSE_WIRE_FLAG_ACK once their last event went
+ * out over BLE. delivered_us is esp_timer time, 0 if the frame was dropped.
+ */
+typedef struct __attribute__((packed)) {
+    uint16_t frame_id;
+    int64_t delivered_us;
+} mouse_wire_ack_t;
+
+/**
+ * UDP datagram, exactly this size. seq increases by one per datagram from a
+ * client; client_us is the client's clock when it was sent.
+ */
+typedef struct __attribute__((packed)) {
+    uint32_t seq;
+    uint64_t client_us;
+    int8_t dx;
+    int8_t dy;
+    int8_t wheel;
+    uint8_t buttons;
+} mouse_wire_datagram_t;
+
+/**
+ * Convert a wire record, rejecting values outside the wire format's ranges.
+ */
+bool mouse_wire_decode(const mouse_wire_event_t *wire,
+                       mouse_notification_t *mouse_ev);
+
+#endif // MOUSE_WIRE_H
@@ -3,16 +3,61 @@
 #define WEBSERVER_H
 
 #include "freertos/FreeRTOS.h"
-#include "freertos/queue.h"
+#include "metrics.h"
+#include "mouse_notification.h"
 #include <esp_http_server.h>
 
+// Most events accepted in one POST /mouse/batch request. Must not exceed
+// mouse_input_capacity().
+#define MOUSE_BATCH_MAX_EVENTS 32
+
+// Longest text, in bytes, one POST /keyboard/type request takes. Read onto
+// the httpd task's stack.
+#define KEYBOARD_TYPE_MAX_LEN 512
+
+// Room for every endpoint registered by start_webserver.
+#define WEBSERVER_MAX_URI_HANDLERS 16
+
+/**
+ * Start the server. Input from every endpoint goes to the dispatcher through
+ * the "http" mouse_input lane and keyboard_input, so mouse_input_init and
+ * keyboard_input_init must have run.
+ */
 httpd_handle_t start_webserver(void);
-void register_mouse_notification_queue(QueueHandle_t theHandle);
 
-typedef struct {
-    int8_t x;
-    int8_t y;
-    uint8_t button;
-} mouse_notification_t;
+/**
+ * Backs GET /conn. profile is the requested profile name or NULL to only
+ * query. Writes the resulting state as text into status.
+ * Returns ESP_ERR_NOT_FOUND for an unknown profile.
+ */
+typedef esp_err_t (*conn_profile_handler_t)(const char *profile, char *status,
+                                             size_t status_len);
+
+void register_conn_profile_handler(conn_profile_handler_t handler);
+
+/**
+ * Backs GET /latency. Writes the latency percentiles of every stage as text
+ * into report, then clears the histograms when reset is set.
+ */
+typedef void (*latency_report_handler_t)(bool reset, char *report,
+                                         size_t report_len);
+
+void register_latency_report_handler(latency_report_handler_t handler);
+
+/**
+ * Backs GET /metrics beyond the server's own counters. Writes the rest of
+ * the device's metrics into writer from the httpd task; must not block.
+ */
+typedef void (*metrics_collector_t)(metrics_writer_t *writer);
+
+void register_metrics_collector(metrics_collector_t collector);
+
+/**
+ * Tell a websocket client that the event carrying ack_fd/ack_id was sent.
+ * Safe to call from any task. delivered_us of 0 reports a dropped frame.
+ * Nothing is sent if fd no longer holds the websocket session it had.
+ */
+void webserver_ack_delivery(int fd, uint32_t session, uint16_t frame_id,
+                            int64_t delivered_us);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,376 @@
+#include "mouse_query.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef enum {
+    // Signed relative axis.
+    FIELD_AXIS,
+    // Wheel in whole detents.
+    FIELD_DETENTS,
+    // Button bitmask.
+    FIELD_BUTTONS,
+    // "true" is a click command.
+    FIELD_CLICK,
+    // mouse_button_action_t by name.
+    FIELD_ACTION,
+    // Host number, or "all".
+    FIELD_TARGET,
+    // Coordinate of a point; every key of its group is needed.
+    FIELD_ABS,
+    // Unsigned 16 bit number.
+    FIELD_UINT16,
+    // trajectory_curve_t by name.
+    FIELD_CURVE,
+    // esp_timer time in microseconds.
+    FIELD_TIME,
+} field_kind_t;
+
+// Keys of a group have to be given together, e.g. both coordinates of a
+// point. 0 is no group.
+#define QUERY_GROUP_MAX 3
+
+// No flag to set.
+#define NO_FLAG SIZE_MAX
+
+typedef struct {
+    const char *name;
+    field_kind_t kind;
+    size_t offset;
+    int32_t min;
+    int32_t max;
+    uint8_t group;
+    // bool set once the key is given, or NO_FLAG.
+    size_t flag;
+} query_key_t;
+
+typedef struct {
+    const query_key_t *keys;
+    size_t count;
+} query_table_t;
+
+#define QUERY_TABLE(keys) {keys, sizeof keys / sizeof keys[0]}
+
+// Supported /mouse keys. New keys only need a row here.
+static const query_key_t mouse_keys[] = {
+    {"x", FIELD_AXIS, offsetof(mouse_notification_t, x), -INT16_MAX,
+     INT16_MAX, 0, NO_FLAG},
+    {"y", FIELD_AXIS, offsetof(mouse_notification_t, y), -INT16_MAX,
+     INT16_MAX, 0, NO_FLAG},
+    {"wheel", FIELD_DETENTS, offsetof(mouse_notification_t, wheel),
+     -INT16_MAX / MOUSE_WHEEL_RESOLUTION, INT16_MAX / MOUSE_WHEEL_RESOLUTION, 0,
+     NO_FLAG},
+    // Wheel in 1/MOUSE_WHEEL_RESOLUTION detents.
+    {"scroll", FIELD_AXIS, offsetof(mouse_notification_t, wheel), -INT16_MAX,
+     INT16_MAX, 0, NO_FLAG},
+    {"button", FIELD_BUTTONS, offsetof(mouse_notification_t, button), 0, 7, 0,
+     NO_FLAG},
+    {"click", FIELD_CLICK, offsetof(mouse_notification_t, button_action), 0,
+     1, 0, NO_FLAG},
+    {"action", FIELD_ACTION, offsetof(mouse_notification_t, button_action), 0,
+     0, 0, NO_FLAG},
+    {"hold", FIELD_UINT16, offsetof(mouse_notification_t, hold_ms), 1,
+     MOUSE_BUTTON_MAX_MS, 0, NO_FLAG},
+    {"gap", FIELD_UINT16, offsetof(mouse_notification_t, gap_ms), 1,
+     MOUSE_BUTTON_MAX_MS, 0, NO_FLAG},
+    {"target", FIELD_TARGET, offsetof(mouse_notification_t, target), 1,
+     UINT8_MAX, 0, NO_FLAG},
+    {"ax", FIELD_ABS, offsetof(mouse_notification_t, abs_x), 0, MOUSE_ABS_MAX,
+     1, offsetof(mouse_notification_t, absolute)},
+    {"ay", FIELD_ABS, offsetof(mouse_notification_t, abs_y), 0, MOUSE_ABS_MAX,
+     1, offsetof(mouse_notification_t, absolute)},
+    {"at", FIELD_TIME, offsetof(mouse_notification_t, at_us), 0, 0, 0,
+     NO_FLAG},
+};
+
+// Supported /mouse/move keys.
+static const query_key_t move_keys[] = {
+    {"dx", FIELD_AXIS, offsetof(trajectory_request_t, dx), -INT16_MAX,
+     INT16_MAX, 0, NO_FLAG},
+    {"dy", FIELD_AXIS, offsetof(trajectory_request_t, dy), -INT16_MAX,
+     INT16_MAX, 0, NO_FLAG},
+    {"wheel", FIELD_DETENTS, offsetof(trajectory_request_t, wheel),
+     -INT16_MAX / MOUSE_WHEEL_RESOLUTION, INT16_MAX / MOUSE_WHEEL_RESOLUTION, 0,
+     NO_FLAG},
+    {"scroll", FIELD_AXIS, offsetof(trajectory_request_t, wheel), -INT16_MAX,
+     INT16_MAX, 0, NO_FLAG},
+    {"ax", FIELD_ABS, offsetof(trajectory_request_t, ax), 0, MOUSE_ABS_MAX, 1,
+     offsetof(trajectory_request_t, absolute)},
+    {"ay", FIELD_ABS, offsetof(trajectory_request_t, ay), 0, MOUSE_ABS_MAX, 1,
+     offsetof(trajectory_request_t, absolute)},
+    {"fx", FIELD_ABS, offsetof(trajectory_request_t, from_x), 0,
+     MOUSE_ABS_MAX, 2, offsetof(trajectory_request_t, has_from)},
+    {"fy", FIELD_ABS, offsetof(trajectory_request_t, from_y), 0,
+     MOUSE_ABS_MAX, 2, offsetof(trajectory_request_t, has_from)},
+    {"c1x", FIELD_AXIS, offsetof(trajectory_request_t, c1x), -INT16_MAX,
+     INT16_MAX, 0, NO_FLAG},
+    {"c1y", FIELD_AXIS, offsetof(trajectory_request_t, c1y), -INT16_MAX,
+     INT16_MAX, 0, NO_FLAG},
+    {"c2x", FIELD_AXIS, offsetof(trajectory_request_t, c2x), -INT16_MAX,
+     INT16_MAX, 0, NO_FLAG},
+    {"c2y", FIELD_AXIS, offsetof(trajectory_request_t, c2y), -INT16_MAX,
+     INT16_MAX, 0, NO_FLAG},
+    {"ms", FIELD_UINT16, offsetof(trajectory_request_t, duration_ms), 0,
+     TRAJECTORY_MAX_DURATION_MS, 0, NO_FLAG},
+    {"curve", FIELD_CURVE, offsetof(trajectory_request_t, curve), 0, 0, 0,
+     NO_FLAG},
+    {"button", FIELD_BUTTONS, offsetof(trajectory_request_t, button), 0, 7, 0,
+     NO_FLAG},
+    {"target", FIELD_TARGET, offsetof(trajectory_request_t, target), 1,
+     UINT8_MAX, 0, NO_FLAG},
+};
+
+static const query_table_t mouse_table = QUERY_TABLE(mouse_keys);
+static const query_table_t move_table = QUERY_TABLE(move_keys);
+
+static const query_key_t *find_key(const query_table_t *table, const char *key,
+                                   size_t key_len) {
+    for (size_t i = 0; i < table->count; i++) {
+        const char *name = table->keys[i].name;
+        if (strncmp(name, key, key_len) == 0 && name[key_len] == '\0') {
+            return &table->keys[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Strict decimal parse of [value, value + len). Rejects empty strings and
+ * trailing garbage, and stops accumulating early so it cannot overflow.
+ */
+static mouse_query_status_t parse_int(const char *value, size_t len,
+                                      int32_t *out) {
+    size_t i = 0;
+    bool negative = false;
+    if (i < len && (value[i] == '-' || value[i] == '+')) {
+        negative = value[i] == '-';
+        i++;
+    }
+    if (i == len) {
+        return MOUSE_QUERY_MALFORMED;
+    }
+
+    int32_t result = 0;
+    bool too_big = false;
+    for (; i < len; i++) {
+        if (value[i] < '0' || value[i] > '9') {
+            return MOUSE_QUERY_MALFORMED;
+        }
+        if (result < 100000) {
+            result = result * 10 + (value[i] - '0');
+        } else {
+            too_big = true;
+        }
+    }
+    if (too_big) {
+        return MOUSE_QUERY_OUT_OF_RANGE;
+    }
+    *out = negative ? -result : result;
+    return MOUSE_QUERY_OK;
+}
+
+/**
+ * Parse an action name: down, up, click or double.
+ */
+static mouse_query_status_t parse_button_action(const char *value, size_t len,
+                                                uint8_t *action) {
+    static const char *const names[] = {
+        [MOUSE_BUTTON_DOWN] = "down",
+        [MOUSE_BUTTON_UP] = "up",
+        [MOUSE_BUTTON_CLICK] = "click",
+        [MOUSE_BUTTON_DOUBLE_CLICK] = "double",
+    };
+    for (size_t i = MOUSE_BUTTON_DOWN; i < sizeof names / sizeof *names; i++) {
+        if (strlen(names[i]) == len && memcmp(names[i], value, len) == 0) {
+            *action = (uint8_t)i;
+            return MOUSE_QUERY_OK;
+        }
+    }
+    return MOUSE_QUERY_MALFORMED;
+}
+
+static mouse_query_status_t apply_value(const query_key_t *key,
+                                        const char *value, size_t len,
+                                        void *out) {
+    uint8_t *field = (uint8_t *)out + key->offset;
+
+    if (key->kind == FIELD_TARGET) {
+        return parse_mouse_target(value, len, field);
+    }
+    if (key->kind == FIELD_TIME) {
+        return parse_mouse_time(value, len, (int64_t *)field);
+    }
+    if (key->kind == FIELD_CURVE) {
+        return trajectory_curve_from_name(value, len,
+                                          (trajectory_curve_t *)field)
+                   ? MOUSE_QUERY_OK
+                   : MOUSE_QUERY_MALFORMED;
+    }
+    if (key->kind == FIELD_ACTION) {
+        return parse_button_action(value, len, field);
+    }
+    if (key->kind == FIELD_CLICK) {
+        if (len == 4 && memcmp(value, "true", 4) == 0) {
+            *field = MOUSE_BUTTON_CLICK;
+        } else if (!(len == 5 && memcmp(value, "false", 5) == 0)) {
+            return MOUSE_QUERY_MALFORMED;
+        }
+        return MOUSE_QUERY_OK;
+    }
+
+    int32_t number;
+    mouse_query_status_t status = parse_int(value, len, &number);
+    if (status != MOUSE_QUERY_OK) {
+        return status;
+    }
+    if (number < key->min || number > key->max) {
+        return MOUSE_QUERY_OUT_OF_RANGE;
+    }
+    if (key->kind == FIELD_AXIS) {
+        *(int16_t *)field = (int16_t)number;
+    } else if (key->kind == FIELD_DETENTS) {
+        *(int16_t *)field = (int16_t)(number * MOUSE_WHEEL_RESOLUTION);
+    } else if (key->kind == FIELD_ABS || key->kind == FIELD_UINT16) {
+        *(uint16_t *)field = (uint16_t)number;
+    } else {
+        *field |= (uint8_t)number;
+    }
+    if (key->flag != NO_FLAG) {
+        *(bool *)((uint8_t *)out + key->flag) = true;
+    }
+    return MOUSE_QUERY_OK;
+}
+
+mouse_query_status_t parse_mouse_target(const char *value, size_t len,
+                                        uint8_t *target) {
+    if (len == 3 && memcmp(value, "all", 3) == 0) {
+        *target = MOUSE_TARGET_ALL;
+        return MOUSE_QUERY_OK;
+    }
+    int32_t number;
+    mouse_query_status_t status = parse_int(value, len, &number);
+    if (status != MOUSE_QUERY_OK) {
+        return status;
+    }
+    if (number < 1 || number > UINT8_MAX) {
+        return MOUSE_QUERY_OUT_OF_RANGE;
+    }
+    *target = (uint8_t)number;
+    return MOUSE_QUERY_OK;
+}
+
+mouse_query_status_t parse_mouse_time(const char *value, size_t len,
+                                      int64_t *time_us) {
+    // 18 digits always fit in an int64_t.
+    if (len == 0 || len > 18) {
+        return len == 0 ? MOUSE_QUERY_MALFORMED : MOUSE_QUERY_OUT_OF_RANGE;
+    }
+    int64_t result = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (value[i] < '0' || value[i] > '9') {
+            return MOUSE_QUERY_MALFORMED;
+        }
+        result = result * 10 + (value[i] - '0');
+    }
+    *time_us = result;
+    return MOUSE_QUERY_OK;
+}
+
+static void set_error(mouse_query_error_t *err, mouse_query_status_t status,
+                      const char *key, size_t key_len) {
+    if (err != NULL) {
+        err->status = status;
+        err->key = key;
+        err->key_len = key_len;
+    }
+}
+
+/**
+ * Parse query into out, which table describes and which has been cleared.
+ */
+static mouse_query_status_t parse_query(const query_table_t *table,
+                                        const char *query, size_t len,
+                                        void *out, mouse_query_error_t *err) {
+    const char *end = query + len;
+    const char *pair = query;
+    // Bit per table row of the grouped keys given, and the last one per
+    // group.
+    uint32_t seen = 0;
+    const char *group_key[QUERY_GROUP_MAX + 1] = {NULL};
+    size_t group_key_len[QUERY_GROUP_MAX + 1] = {0};
+
+    while (pair < end) {
+        const char *pair_end = memchr(pair, '&', end - pair);
+        if (pair_end == NULL) {
+            pair_end = end;
+        }
+        const char *eq = memchr(pair, '=', pair_end - pair);
+        const char *key = pair;
+        size_t key_len = (eq != NULL ? eq : pair_end) - pair;
+
+        const query_key_t *known = find_key(table, key, key_len);
+        if (known != NULL) {
+            mouse_query_status_t status = MOUSE_QUERY_MALFORMED;
+            if (eq != NULL) {
+                status = apply_value(known, eq + 1, pair_end - (eq + 1), out);
+            }
+            if (status != MOUSE_QUERY_OK) {
+                set_error(err, status, key, key_len);
+                return status;
+            }
+            if (known->group != 0) {
+                seen |= 1u << (known - table->keys);
+                group_key[known->group] = key;
+                group_key_len[known->group] = key_len;
+            }
+        }
+        pair = pair_end + 1;
+    }
+    for (size_t i = 0; i < table->count; i++) {
+        uint8_t group = table->keys[i].group;
+        if (group != 0 && group_key[group] != NULL && !(seen & (1u << i))) {
+            set_error(err, MOUSE_QUERY_INCOMPLETE, group_key[group],
+                      group_key_len[group]);
+            return MOUSE_QUERY_INCOMPLETE;
+        }
+    }
+    return MOUSE_QUERY_OK;
+}
+
+mouse_query_status_t parse_mouse_query(const char *query, size_t len,
+                                       mouse_notification_t *mouse_ev,
+                                       mouse_query_error_t *err) {
+    memset(mouse_ev, 0, sizeof *mouse_ev);
+    mouse_query_status_t status =
+        parse_query(&mouse_table, query, len, mouse_ev, err);
+    // Commands without button= act on button 1.
+    if (mouse_ev->button_action != MOUSE_BUTTON_MOMENTARY &&
+        mouse_ev->button == 0) {
+        mouse_ev->button = 0x01;
+    }
+    return status;
+}
+
+mouse_query_status_t parse_move_query(const char *query, size_t len,
+                                      trajectory_request_t *request,
+                                      mouse_query_error_t *err) {
+    memset(request, 0, sizeof *request);
+    request->curve = TRAJECTORY_EASE_IN_OUT;
+    request->duration_ms = TRAJECTORY_DEFAULT_DURATION_MS;
+    return parse_query(&move_table, query, len, request, err);
+}
+
+const char *mouse_query_status_str(mouse_query_status_t status) {
+    switch (status) {
+    case MOUSE_QUERY_OK:
+        return "ok";
+    case MOUSE_QUERY_MALFORMED:
+        return "malformed value";
+    case MOUSE_QUERY_OUT_OF_RANGE:
+        return "value out of range";
+    case MOUSE_QUERY_INCOMPLETE:
+        return "needs every coordinate of the point";
+    }
+    return "unknown error";
+}
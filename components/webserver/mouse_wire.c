@@ -0,0 +1,20 @@
+#include "mouse_wire.h"
+
+bool mouse_wire_decode(const mouse_wire_event_t *wire,
+                       mouse_notification_t *mouse_ev) {
+    // The wire format keeps motion symmetric, -127 to 127, whatever report
+    // the device is built with; -128 would only fit the 16 bit one. Only 3
+    // buttons exist.
+    if (wire->dx == INT8_MIN || wire->dy == INT8_MIN ||
+        wire->wheel == INT8_MIN || wire->buttons > 0x07) {
+        return false;
+    }
+    *mouse_ev = (mouse_notification_t){0};
+    mouse_ev->x = wire->dx;
+    mouse_ev->y = wire->dy;
+    // The wire format keeps whole detents.
+    mouse_ev->wheel = wire->wheel * MOUSE_WHEEL_RESOLUTION;
+    mouse_ev->button = wire->buttons;
+    mouse_ev->delay_ms = wire->delay_ms;
+    return true;
+}
@@ -1,4 +1,14 @@
 #include "webserver.h"
+#include "esp_timer.h"
+#include "keyboard_input.h"
+#include "macro.h"
+#include "metrics.h"
+#include "mouse_input.h"
+#include "mouse_query.h"
+#include "mouse_scheduler.h"
+#include "mouse_wire.h"
+#include "trace.h"
+#include "trajectory.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -8,49 +18,88 @@
 
 #define WEB_SERVER_TAG "webserver"
 
-QueueHandle_t notificationQueue = NULL;
+// All handlers run in the httpd task, so one lane serves every endpoint.
+static mouse_input_lane_t *http_lane = NULL;
+static httpd_handle_t server_handle = NULL;
+static conn_profile_handler_t connProfileHandler = NULL;
+static latency_report_handler_t latencyReportHandler = NULL;
+static metrics_collector_t metricsCollector = NULL;
 
-void register_mouse_notification_queue(QueueHandle_t theHandle) {
-    notificationQueue = theHandle;
+// Requests rejected as malformed: 400 responses and dropped websocket frames.
+static metrics_counter_t bad_requests;
+
+void register_conn_profile_handler(conn_profile_handler_t handler) {
+    connProfileHandler = handler;
+}
+
+void register_latency_report_handler(latency_report_handler_t handler) {
+    latencyReportHandler = handler;
+}
+
+void register_metrics_collector(metrics_collector_t collector) {
+    metricsCollector = collector;
+}
+
+static void send_bad_request(httpd_req_t *req, const char *msg) {
+    metrics_counter_inc(&bad_requests);
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, msg);
+}
+
+// Longest query accepted by /mouse and the other endpoints reading
+// parameters, including the terminating NUL.
+#define MOUSE_QUERY_BUF_LEN 128
+
+/**
+ * Whether the query of req is too long to read, so its parameters cannot be
+ * told from absent ones.
+ */
+static bool query_too_long(httpd_req_t *req) {
+    return httpd_req_get_url_query_len(req) >= MOUSE_QUERY_BUF_LEN;
 }
 
 /* Our URI handler function to be called during GET /uri request */
 esp_err_t get_handler(httpd_req_t *req) {
-    char *buf;
-    size_t buf_len = httpd_req_get_url_query_len(req) + 1;
-    if (buf_len > 1) {
-        buf = malloc(buf_len);
-        if (httpd_req_get_url_query_str(req, buf, buf_len) == ESP_OK) {
-            ESP_LOGD(WEB_SERVER_TAG, "Found URL query => %s", buf);
-            char param[8];
+    // Latency is measured from here.
+    int64_t received_us = esp_timer_get_time();
+    char buf[MOUSE_QUERY_BUF_LEN];
+    size_t query_len = httpd_req_get_url_query_len(req);
+    if (query_len > 0) {
+        if (query_len >= sizeof buf) {
+            httpd_resp_send_err(req, HTTPD_414_URI_TOO_LONG,
+                                "Query too long");
+            return ESP_OK;
+        }
+        if (httpd_req_get_url_query_str(req, buf, sizeof buf) == ESP_OK) {
             mouse_notification_t mouse_ev;
-            memset(&mouse_ev, 0, sizeof(mouse_ev));
-
-            // ESP_ERR_HTTPD_RESULT_TRUNC or NOT_FOUND will just fall back to
-            // default
-            if (httpd_query_key_value(buf, "x", param, sizeof(param)) ==
-                ESP_OK) {
-                ESP_LOGD(WEB_SERVER_TAG, "x => %s", param);
-                mouse_ev.x = atoi(param);
-            }
-            if (httpd_query_key_value(buf, "y", param, sizeof(param)) ==
-                ESP_OK) {
-                ESP_LOGD(WEB_SERVER_TAG, "y => %s", param);
-                mouse_ev.y = atoi(param);
-            }
-            if (httpd_query_key_value(buf, "click", param, sizeof(param)) ==
-                ESP_OK) {
-                ESP_LOGD(WEB_SERVER_TAG, "click => %s", param);
-                if (strcmp(param, "true") == 0) {
-                    mouse_ev.button = 0x01;
-                }
+            mouse_query_error_t err;
+
+            if (parse_mouse_query(buf, query_len, &mouse_ev, &err) !=
+                MOUSE_QUERY_OK) {
+                char msg[48];
+                snprintf(msg, sizeof msg, "%.*s: %s", (int)err.key_len,
+                         err.key, mouse_query_status_str(err.status));
+                send_bad_request(req, msg);
+                return ESP_OK;
             }
+            mouse_ev.received_us = received_us;
+            TRACE_D(TRACE_HTTP_MOUSE, mouse_ev.x, mouse_ev.y, mouse_ev.wheel,
+                    mouse_ev.target);
 
-            if (notificationQueue != NULL) {
-                xQueueSend(notificationQueue, &mouse_ev, 0);
+            if (mouse_ev.at_us != 0) {
+                if (!mouse_scheduler_submit_all(&mouse_ev, 1,
+                                                MOUSE_SCHEDULER_NO_OWNER)) {
+                    httpd_resp_set_status(req, "503 Service Unavailable");
+                    httpd_resp_send(req, "Schedule full",
+                                    HTTPD_RESP_USE_STRLEN);
+                    return ESP_OK;
+                }
+            } else if (http_lane == NULL ||
+                       !mouse_input_submit(http_lane, &mouse_ev)) {
+                httpd_resp_set_status(req, "503 Service Unavailable");
+                httpd_resp_send(req, "Queue full", HTTPD_RESP_USE_STRLEN);
+                return ESP_OK;
             }
         }
-        free(buf);
     }
 
     /* Send a simple response */
@@ -59,26 +108,863 @@ esp_err_t get_handler(httpd_req_t *req) {
     return ESP_OK;
 }
 
+static bool decode_events(const mouse_wire_event_t *events, size_t count,
+                          int64_t received_us, mouse_notification_t *out) {
+    for (size_t i = 0; i < count; i++) {
+        if (!mouse_wire_decode(&events[i], &out[i])) {
+            return false;
+        }
+        out[i].received_us = received_us;
+    }
+    return true;
+}
+
+/**
+ * Read ?target= of req, MOUSE_TARGET_ALL when absent. Check query_too_long
+ * first.
+ * Returns false for a malformed target.
+ */
+static bool query_target(httpd_req_t *req, uint8_t *target) {
+    char query[MOUSE_QUERY_BUF_LEN];
+    char value[8];
+
+    *target = MOUSE_TARGET_ALL;
+    if (httpd_req_get_url_query_str(req, query, sizeof query) != ESP_OK) {
+        return true;
+    }
+    esp_err_t err =
+        httpd_query_key_value(query, "target", value, sizeof value);
+    if (err == ESP_ERR_NOT_FOUND) {
+        return true;
+    }
+    // A value too long for value is no target either.
+    return err == ESP_OK &&
+           parse_mouse_target(value, strlen(value), target) == MOUSE_QUERY_OK;
+}
+
+/**
+ * Read ?at= of req, 0 when absent. Check query_too_long first.
+ * Returns false for a malformed time.
+ */
+static bool query_at(httpd_req_t *req, int64_t *at_us) {
+    char query[MOUSE_QUERY_BUF_LEN];
+    char value[24];
+
+    *at_us = 0;
+    if (httpd_req_get_url_query_str(req, query, sizeof query) != ESP_OK) {
+        return true;
+    }
+    esp_err_t err = httpd_query_key_value(query, "at", value, sizeof value);
+    if (err == ESP_ERR_NOT_FOUND) {
+        return true;
+    }
+    return err == ESP_OK &&
+           parse_mouse_time(value, strlen(value), at_us) == MOUSE_QUERY_OK;
+}
+
+/**
+ * Turn the delays of a batch starting at at_us into send times, keeping the
+ * spacing the client recorded.
+ */
+static void set_schedule(mouse_notification_t *events, size_t count,
+                         int64_t at_us) {
+    for (size_t i = 0; i < count; i++) {
+        at_us += events[i].delay_ms * 1000;
+        events[i].at_us = at_us;
+        events[i].delay_ms = 0;
+    }
+}
+
+static void set_target(mouse_notification_t *events, size_t count,
+                       uint8_t target) {
+    for (size_t i = 0; i < count; i++) {
+        events[i].target = target;
+    }
+}
+
+/**
+ * Queue all events or none of them.
+ */
+static bool enqueue_events(const mouse_notification_t *events, size_t count) {
+    return http_lane != NULL &&
+           mouse_input_submit_all(http_lane, events, count);
+}
+
+static bool has_delays(const mouse_notification_t *events, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (events[i].delay_ms != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Queue a batch whole or not at all. With at_us, or with delays counting
+ * from now, it waits in mouse_scheduler: the dispatcher would hold every
+ * lane and host for a delay.
+ */
+static bool submit_batch(mouse_notification_t *events, size_t count,
+                         int64_t at_us) {
+    if (at_us == 0 && has_delays(events, count)) {
+        at_us = esp_timer_get_time();
+    }
+    if (at_us == 0) {
+        return enqueue_events(events, count);
+    }
+    set_schedule(events, count, at_us);
+    return mouse_scheduler_submit_all(events, count,
+                                      MOUSE_SCHEDULER_NO_OWNER);
+}
+
+/**
+ * Read the body of req, len bytes, into buf. Returns false when the
+ * connection broke; httpd closes it then.
+ */
+static bool recv_body(httpd_req_t *req, char *buf, size_t len) {
+    size_t received = 0;
+    while (received < len) {
+        int ret = httpd_req_recv(req, buf + received, len - received);
+        if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+            continue;
+        }
+        if (ret <= 0) {
+            return false;
+        }
+        received += ret;
+    }
+    return true;
+}
+
+/**
+ * POST /mouse/batch?target=&at=
+ * Body is an array of mouse_wire_event_t. The whole batch is queued or
+ * rejected as a unit. With at, the first event is sent at that esp_timer
+ * time and the delays are offsets from there.
+ */
+esp_err_t batch_post_handler(httpd_req_t *req) {
+    // Too big for the httpd task's stack. httpd runs every handler on that
+    // one task, so one copy serves all requests.
+    static mouse_wire_event_t events[MOUSE_BATCH_MAX_EVENTS];
+    static mouse_notification_t batch[MOUSE_BATCH_MAX_EVENTS];
+    int64_t received_us = esp_timer_get_time();
+    size_t body_len = req->content_len;
+    uint8_t target;
+    int64_t at_us;
+
+    if (query_too_long(req)) {
+        httpd_resp_send_err(req, HTTPD_414_URI_TOO_LONG, "Query too long");
+        return ESP_OK;
+    }
+    if (!query_target(req, &target)) {
+        send_bad_request(req, "Bad target");
+        return ESP_OK;
+    }
+    if (!query_at(req, &at_us)) {
+        send_bad_request(req, "Bad time");
+        return ESP_OK;
+    }
+
+    if (body_len == 0 || body_len % sizeof(mouse_wire_event_t) != 0 ||
+        body_len > sizeof events) {
+        send_bad_request(req, "Bad batch length");
+        return ESP_OK;
+    }
+
+    if (!recv_body(req, (char *)events, body_len)) {
+        return ESP_FAIL;
+    }
+
+    size_t count = body_len / sizeof(mouse_wire_event_t);
+    if (!decode_events(events, count, received_us, batch)) {
+        send_bad_request(req, "Event value out of range");
+        return ESP_OK;
+    }
+    set_target(batch, count, target);
+
+    if (!submit_batch(batch, count, at_us)) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_send(req, "Queue full", HTTPD_RESP_USE_STRLEN);
+        return ESP_OK;
+    }
+
+    httpd_resp_send(req, "Batch queued", HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+}
+
+/**
+ * POST /keyboard/type?target=
+ * Body is UTF-8 text, typed as on a US layout keyboard. The whole text is
+ * queued or rejected as a unit; answers queued=N, the characters typed.
+ */
+esp_err_t keyboard_type_handler(httpd_req_t *req) {
+    // Off the httpd task's stack, like the buffers of /mouse/batch.
+    static char text[KEYBOARD_TYPE_MAX_LEN];
+    size_t body_len = req->content_len;
+    uint8_t target;
+    size_t strokes, error_at;
+    char resp[48];
+
+    if (query_too_long(req)) {
+        httpd_resp_send_err(req, HTTPD_414_URI_TOO_LONG, "Query too long");
+        return ESP_OK;
+    }
+    if (!query_target(req, &target)) {
+        send_bad_request(req, "Bad target");
+        return ESP_OK;
+    }
+    if (body_len == 0 || body_len > sizeof text) {
+        send_bad_request(req, "Bad text length");
+        return ESP_OK;
+    }
+    if (!recv_body(req, text, body_len)) {
+        return ESP_FAIL;
+    }
+
+    keyboard_type_status_t status =
+        keyboard_input_type(text, body_len, target, &strokes, &error_at);
+    if (status == KEYBOARD_TYPE_FULL) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_send(req, "Queue full", HTTPD_RESP_USE_STRLEN);
+        return ESP_OK;
+    }
+    if (status != KEYBOARD_TYPE_OK) {
+        snprintf(resp, sizeof resp, "At byte %u: %s", (unsigned)error_at,
+                 keyboard_type_status_str(status));
+        send_bad_request(req, resp);
+        return ESP_OK;
+    }
+    snprintf(resp, sizeof resp, "queued=%u", (unsigned)strokes);
+    httpd_resp_send(req, resp, HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+}
+
+/**
+ * GET /conn?profile=
+ * Switches the BLE connection parameter profile of every host and reports
+ * what each one granted. Without a query only reports.
+ */
+esp_err_t conn_get_handler(httpd_req_t *req) {
+    char query[48];
+    char profile[24];
+    // Static for the same reason as in batch_post_handler.
+    static char status[320];
+    const char *requested = NULL;
+
+    if (connProfileHandler == NULL) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR,
+                            "Not available");
+        return ESP_OK;
+    }
+    if (httpd_req_get_url_query_str(req, query, sizeof query) == ESP_OK &&
+        httpd_query_key_value(query, "profile", profile, sizeof profile) ==
+            ESP_OK) {
+        requested = profile;
+    }
+
+    if (connProfileHandler(requested, status, sizeof status) != ESP_OK) {
+        send_bad_request(req, "Unknown profile");
+        return ESP_OK;
+    }
+    httpd_resp_send(req, status, HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+}
+
+/**
+ * GET /mouse/move?dx=&dy=&ms=&curve=...
+ * Starts a trajectory on the device and answers its id, so one request
+ * gives smooth motion regardless of the network.
+ */
+esp_err_t move_get_handler(httpd_req_t *req) {
+    char buf[MOUSE_QUERY_BUF_LEN];
+    char resp[24];
+    size_t query_len = httpd_req_get_url_query_len(req);
+    trajectory_request_t request;
+    mouse_query_error_t err;
+    uint32_t id;
+
+    if (query_len >= sizeof buf) {
+        httpd_resp_send_err(req, HTTPD_414_URI_TOO_LONG, "Query too long");
+        return ESP_OK;
+    }
+    if (query_len == 0 ||
+        httpd_req_get_url_query_str(req, buf, sizeof buf) != ESP_OK) {
+        buf[0] = '\0';
+        query_len = 0;
+    }
+    if (parse_move_query(buf, query_len, &request, &err) != MOUSE_QUERY_OK) {
+        char msg[48];
+        snprintf(msg, sizeof msg, "%.*s: %s", (int)err.key_len, err.key,
+                 mouse_query_status_str(err.status));
+        send_bad_request(req, msg);
+        return ESP_OK;
+    }
+
+    if (trajectory_start(&request, &id) != ESP_OK) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_send(req, "Too many trajectories", HTTPD_RESP_USE_STRLEN);
+        return ESP_OK;
+    }
+    snprintf(resp, sizeof resp, "id=%u", (unsigned)id);
+    httpd_resp_send(req, resp, HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+}
+
+/**
+ * GET /mouse/cancel?id=
+ * Stops the trajectory id where it is, or every one without an id.
+ */
+esp_err_t cancel_get_handler(httpd_req_t *req) {
+    char query[32];
+    char value[12];
+    char resp[24];
+    uint32_t id = 0;
+
+    if (httpd_req_get_url_query_str(req, query, sizeof query) == ESP_OK &&
+        httpd_query_key_value(query, "id", value, sizeof value) == ESP_OK) {
+        char *end;
+        unsigned long parsed = strtoul(value, &end, 10);
+        if (end == value || *end != '\0' || parsed == 0 ||
+            parsed > UINT32_MAX) {
+            send_bad_request(req, "Bad id");
+            return ESP_OK;
+        }
+        id = (uint32_t)parsed;
+    }
+
+    snprintf(resp, sizeof resp, "cancelled=%d", trajectory_cancel(id));
+    httpd_resp_send(req, resp, HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+}
+
+/**
+ * GET /clock
+ * Reports the esp_timer clock when the request was handled and just before
+ * the answer, for the client to estimate its offset NTP style.
+ */
+esp_err_t clock_get_handler(httpd_req_t *req) {
+    int64_t rx_us = esp_timer_get_time();
+    char resp[48];
+
+    snprintf(resp, sizeof resp, "rx_us=%lld tx_us=%lld", (long long)rx_us,
+             (long long)esp_timer_get_time());
+    httpd_resp_send(req, resp, HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+}
+
+/**
+ * GET /latency?reset=1
+ * Per stage latency percentiles from producer to NOTIFY_TX. reset clears
+ * them after reporting, to measure a new setting from scratch.
+ */
+esp_err_t latency_get_handler(httpd_req_t *req) {
+    char query[24];
+    char value[4];
+    // Handlers take turns on the httpd task, so one copy is enough.
+    static char report[512];
+    bool reset = false;
+
+    if (latencyReportHandler == NULL) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR,
+                            "Not available");
+        return ESP_OK;
+    }
+    if (httpd_req_get_url_query_str(req, query, sizeof query) == ESP_OK &&
+        httpd_query_key_value(query, "reset", value, sizeof value) ==
+            ESP_OK) {
+        reset = strcmp(value, "1") == 0 || strcmp(value, "true") == 0;
+    }
+    latencyReportHandler(reset, report, sizeof report);
+    httpd_resp_send(req, report, HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+}
+
+/**
+ * Answer a macro call: text on success, otherwise the status fitting err.
+ */
+static esp_err_t send_macro_result(httpd_req_t *req, esp_err_t err,
+                                   const char *text) {
+    switch (err) {
+    case ESP_OK:
+        httpd_resp_send(req, text, HTTPD_RESP_USE_STRLEN);
+        break;
+    case ESP_ERR_INVALID_ARG:
+        send_bad_request(req, "Bad parameter");
+        break;
+    case ESP_ERR_NOT_FOUND:
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "No such macro");
+        break;
+    default:
+        httpd_resp_set_status(req, "409 Conflict");
+        httpd_resp_send(req, "Macro busy", HTTPD_RESP_USE_STRLEN);
+        break;
+    }
+    return ESP_OK;
+}
+
+/**
+ * Read ?name= of req into name, empty when absent. query keeps the query
+ * string for further keys, empty when there is none.
+ */
+static void query_macro_name(httpd_req_t *req, char *query, size_t query_len,
+                             char name[MACRO_NAME_MAX_LEN + 1]) {
+    name[0] = '\0';
+    if (httpd_req_get_url_query_str(req, query, query_len) != ESP_OK) {
+        // No query, or too long for query: other keys are looked up in it
+        // next, so leave it empty.
+        query[0] = '\0';
+        return;
+    }
+    if (httpd_query_key_value(query, "name", name, MACRO_NAME_MAX_LEN + 1) !=
+        ESP_OK) {
+        name[0] = '\0';
+    }
+}
+
+/**
+ * GET /macro/record?name=
+ * Records everything sent from now on, from any producer, until
+ * /macro/stop.
+ */
+esp_err_t macro_record_handler(httpd_req_t *req) {
+    char query[32];
+    char name[MACRO_NAME_MAX_LEN + 1];
+
+    query_macro_name(req, query, sizeof query, name);
+    return send_macro_result(req, macro_record_start(name), "Recording");
+}
+
+/**
+ * GET /macro/play?name=&speed=&target=
+ * speed is a whole multiple of the recorded speed, 1 by default.
+ */
+esp_err_t macro_play_handler(httpd_req_t *req) {
+    char query[64];
+    char name[MACRO_NAME_MAX_LEN + 1];
+    char value[8];
+    uint8_t speed = 1;
+    uint8_t target;
+    bool has_target = false;
+
+    query_macro_name(req, query, sizeof query, name);
+    if (httpd_query_key_value(query, "speed", value, sizeof value) ==
+        ESP_OK) {
+        char *end;
+        unsigned long parsed = strtoul(value, &end, 10);
+        if (end == value || *end != '\0' || parsed < 1 ||
+            parsed > MACRO_MAX_SPEED) {
+            return send_macro_result(req, ESP_ERR_INVALID_ARG, NULL);
+        }
+        speed = parsed;
+    }
+    if (httpd_query_key_value(query, "target", value, sizeof value) ==
+        ESP_OK) {
+        if (parse_mouse_target(value, strlen(value), &target) !=
+            MOUSE_QUERY_OK) {
+            return send_macro_result(req, ESP_ERR_INVALID_ARG, NULL);
+        }
+        has_target = true;
+    }
+    return send_macro_result(
+        req, macro_play(name, speed, has_target ? &target : NULL), "Playing");
+}
+
+/**
+ * GET /macro/stop
+ * Ends the recording or the replay and answers events=N.
+ */
+esp_err_t macro_stop_handler(httpd_req_t *req) {
+    char resp[24];
+    uint32_t events = 0;
+
+    esp_err_t err = macro_stop(&events);
+    snprintf(resp, sizeof resp, "events=%u", (unsigned)events);
+    return send_macro_result(req, err, resp);
+}
+
+/**
+ * GET /macro/delete?name=
+ */
+esp_err_t macro_delete_handler(httpd_req_t *req) {
+    char query[32];
+    char name[MACRO_NAME_MAX_LEN + 1];
+
+    query_macro_name(req, query, sizeof query, name);
+    return send_macro_result(req, macro_delete(name), "Deleted");
+}
+
+/**
+ * GET /macro/list
+ */
+esp_err_t macro_list_handler(httpd_req_t *req) {
+    // Kept off the httpd task's stack.
+    static char list[512];
+
+    macro_list(list, sizeof list);
+    httpd_resp_send(req, list, HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+}
+
+// Requests of one registered URI, the user_ctx of its counting wrapper.
+typedef struct {
+    const char *uri;
+    esp_err_t (*handler)(httpd_req_t *req);
+    metrics_counter_t requests;
+} endpoint_t;
+
+static endpoint_t endpoints[WEBSERVER_MAX_URI_HANDLERS];
+static size_t endpoint_count = 0;
+
+static esp_err_t counted_handler(httpd_req_t *req) {
+    endpoint_t *endpoint = (endpoint_t *)req->user_ctx;
+    metrics_counter_inc(&endpoint->requests);
+    return endpoint->handler(req);
+}
+
+/**
+ * Register uri behind a wrapper counting its requests for /metrics.
+ */
+static void register_endpoint(httpd_handle_t server, const httpd_uri_t *uri) {
+    if (endpoint_count == WEBSERVER_MAX_URI_HANDLERS) {
+        httpd_register_uri_handler(server, uri);
+        return;
+    }
+    endpoint_t *endpoint = &endpoints[endpoint_count++];
+    endpoint->uri = uri->uri;
+    endpoint->handler = uri->handler;
+
+    httpd_uri_t counted = *uri;
+    counted.handler = counted_handler;
+    counted.user_ctx = endpoint;
+    httpd_register_uri_handler(server, &counted);
+}
+
+static void send_chunk(void *ctx, const char *data, size_t len) {
+    httpd_resp_send_chunk((httpd_req_t *)ctx, data, len);
+}
+
+/**
+ * /metrics
+ * Prometheus text format, sent in chunks as it is written. Every value is
+ * read without taking a lock, so a scrape never holds up the input path.
+ */
+esp_err_t metrics_get_handler(httpd_req_t *req) {
+    metrics_writer_t writer;
+    char labels[48];
+
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+    metrics_writer_init(&writer, send_chunk, req);
+
+    metrics_family(&writer, "http_requests_total", "counter",
+                   "Requests served, by path.");
+    for (size_t i = 0; i < endpoint_count; i++) {
+        snprintf(labels, sizeof labels, "path=\"%s\"", endpoints[i].uri);
+        metrics_sample(&writer, "http_requests_total", labels,
+                       metrics_counter_sum(&endpoints[i].requests));
+    }
+    metrics_single(&writer, "http_bad_requests_total", "counter",
+                   "Requests or websocket frames rejected as malformed.",
+                   metrics_counter_sum(&bad_requests));
+
+    if (metricsCollector != NULL) {
+        metricsCollector(&writer);
+    }
+    metrics_writer_finish(&writer);
+    httpd_resp_send_chunk(req, NULL, 0);
+    return ESP_OK;
+}
+
+/**
+ * /trace?clear=1
+ * Trace records as Chrome trace event JSON, for Perfetto or
+ * chrome://tracing. clear=1 leaves them out of the next dump.
+ */
+esp_err_t trace_get_handler(httpd_req_t *req) {
+    char query[24];
+    char value[4];
+    bool clear = false;
+
+    if (httpd_req_get_url_query_str(req, query, sizeof query) == ESP_OK &&
+        httpd_query_key_value(query, "clear", value, sizeof value) ==
+            ESP_OK) {
+        clear = strcmp(value, "1") == 0 || strcmp(value, "true") == 0;
+    }
+    httpd_resp_set_type(req, "application/json");
+    trace_dump(send_chunk, req);
+    httpd_resp_send_chunk(req, NULL, 0);
+    if (clear) {
+        trace_clear();
+    }
+    return ESP_OK;
+}
+
 /* URI handler structure for GET /uri */
 httpd_uri_t uri_get = {.uri = "/mouse",
                        .method = HTTP_GET,
                        .handler = get_handler,
                        .user_ctx = NULL};
-                       
+
+httpd_uri_t uri_batch_post = {.uri = "/mouse/batch",
+                              .method = HTTP_POST,
+                              .handler = batch_post_handler,
+                              .user_ctx = NULL};
+
+httpd_uri_t uri_keyboard_type = {.uri = "/keyboard/type",
+                                 .method = HTTP_POST,
+                                 .handler = keyboard_type_handler,
+                                 .user_ctx = NULL};
+
+httpd_uri_t uri_move_get = {.uri = "/mouse/move",
+                            .method = HTTP_GET,
+                            .handler = move_get_handler,
+                            .user_ctx = NULL};
+
+httpd_uri_t uri_cancel_get = {.uri = "/mouse/cancel",
+                              .method = HTTP_GET,
+                              .handler = cancel_get_handler,
+                              .user_ctx = NULL};
+
+httpd_uri_t uri_clock_get = {.uri = "/clock",
+                             .method = HTTP_GET,
+                             .handler = clock_get_handler,
+                             .user_ctx = NULL};
+
+httpd_uri_t uri_latency_get = {.uri = "/latency",
+                               .method = HTTP_GET,
+                               .handler = latency_get_handler,
+                               .user_ctx = NULL};
+
+httpd_uri_t uri_macro_record = {.uri = "/macro/record",
+                                .method = HTTP_GET,
+                                .handler = macro_record_handler,
+                                .user_ctx = NULL};
+
+httpd_uri_t uri_macro_play = {.uri = "/macro/play",
+                              .method = HTTP_GET,
+                              .handler = macro_play_handler,
+                              .user_ctx = NULL};
+
+httpd_uri_t uri_macro_stop = {.uri = "/macro/stop",
+                              .method = HTTP_GET,
+                              .handler = macro_stop_handler,
+                              .user_ctx = NULL};
+
+httpd_uri_t uri_macro_delete = {.uri = "/macro/delete",
+                                .method = HTTP_GET,
+                                .handler = macro_delete_handler,
+                                .user_ctx = NULL};
+
+httpd_uri_t uri_macro_list = {.uri = "/macro/list",
+                              .method = HTTP_GET,
+                              .handler = macro_list_handler,
+                              .user_ctx = NULL};
+
+httpd_uri_t uri_conn_get = {.uri = "/conn",
+                            .method = HTTP_GET,
+                            .handler = conn_get_handler,
+                            .user_ctx = NULL};
+
+httpd_uri_t uri_metrics_get = {.uri = "/metrics",
+                               .method = HTTP_GET,
+                               .handler = metrics_get_handler,
+                               .user_ctx = NULL};
+
+httpd_uri_t uri_trace_get = {.uri = "/trace",
+                             .method = HTTP_GET,
+                             .handler = trace_get_handler,
+                             .user_ctx = NULL};
+
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+// Per socket state of /mouse/ws, set at the handshake.
+typedef struct {
+    uint8_t target;
+    // Tells this session apart from a later one on the same fd.
+    uint32_t session;
+} ws_session_t;
+
+// Last session handed out, only touched by the httpd task.
+static uint32_t ws_last_session;
+
+typedef struct {
+    int fd;
+    uint32_t session;
+    mouse_wire_ack_t ack;
+} ws_ack_work_t;
+
+static void ws_send_ack(void *arg) {
+    ws_ack_work_t *work = (ws_ack_work_t *)arg;
+    // The socket may have closed and its fd gone to another client since
+    // the frame came in; only the session that asked gets the ack.
+    const ws_session_t *ctx =
+        httpd_ws_get_fd_info(server_handle, work->fd) ==
+                HTTPD_WS_CLIENT_WEBSOCKET
+            ? httpd_sess_get_ctx(server_handle, work->fd)
+            : NULL;
+    if (ctx != NULL && ctx->session == work->session) {
+        httpd_ws_frame_t frame = {.type = HTTPD_WS_TYPE_BINARY,
+                                  .payload = (uint8_t *)&work->ack,
+                                  .len = sizeof work->ack};
+        httpd_ws_send_frame_async(server_handle, work->fd, &frame);
+    }
+    free(work);
+}
+
+void webserver_ack_delivery(int fd, uint32_t session, uint16_t frame_id,
+                            int64_t delivered_us) {
+    if (server_handle == NULL) {
+        return;
+    }
+    ws_ack_work_t *work = malloc(sizeof *work);
+    if (work == NULL) {
+        return;
+    }
+    work->fd = fd;
+    work->session = session;
+    work->ack.frame_id = frame_id;
+    work->ack.delivered_us = delivered_us;
+    // Sending has to happen in the httpd task.
+    if (httpd_queue_work(server_handle, ws_send_ack, work) != ESP_OK) {
+        free(work);
+    }
+}
+
+/**
+ * /mouse/ws?target=
+ * Each binary frame is a mouse_wire_frame_header_t followed by
+ * mouse_wire_event_t records, queued as a unit like /mouse/batch.
+ * The target is chosen once for the socket at the handshake.
+ */
+esp_err_t ws_handler(httpd_req_t *req) {
+    if (req->method == HTTP_GET) {
+        // Handshake done, frames follow on this socket.
+        ws_session_t *ctx = malloc(sizeof *ctx);
+        // The handshake is answered already; all that is left is to close.
+        if (ctx == NULL || query_too_long(req) ||
+            !query_target(req, &ctx->target)) {
+            free(ctx);
+            return ESP_FAIL;
+        }
+        // Never 0, so a zeroed context matches no ack.
+        if (++ws_last_session == 0) {
+            ws_last_session = 1;
+        }
+        ctx->session = ws_last_session;
+        req->sess_ctx = ctx;
+        req->free_ctx = free;
+        return ESP_OK;
+    }
+
+    // Off the httpd task's stack, like the buffers of /mouse/batch.
+    static uint8_t buf[sizeof(mouse_wire_frame_header_t) +
+                       MOUSE_BATCH_MAX_EVENTS * sizeof(mouse_wire_event_t)];
+    static mouse_notification_t events[MOUSE_BATCH_MAX_EVENTS];
+    httpd_ws_frame_t frame;
+    memset(&frame, 0, sizeof frame);
+    esp_err_t ret = httpd_ws_recv_frame(req, &frame, 0);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (frame.type != HTTPD_WS_TYPE_BINARY || frame.len > sizeof buf ||
+        frame.len < sizeof(mouse_wire_frame_header_t)) {
+        ESP_LOGW(WEB_SERVER_TAG, "Closing websocket on bad frame");
+        metrics_counter_inc(&bad_requests);
+        return ESP_FAIL;
+    }
+    frame.payload = buf;
+    ret = httpd_ws_recv_frame(req, &frame, frame.len);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    int64_t received_us = esp_timer_get_time();
+
+    mouse_wire_frame_header_t header;
+    memcpy(&header, buf, sizeof header);
+    size_t events_len = frame.len - sizeof header;
+    if (events_len % sizeof(mouse_wire_event_t) != 0) {
+        metrics_counter_inc(&bad_requests);
+        return ESP_FAIL;
+    }
+    size_t count = events_len / sizeof(mouse_wire_event_t);
+    if (!decode_events((const mouse_wire_event_t *)(buf + sizeof header),
+                       count, received_us, events)) {
+        metrics_counter_inc(&bad_requests);
+        return ESP_FAIL;
+    }
+    const ws_session_t *ctx = req->sess_ctx;
+    if (ctx != NULL) {
+        set_target(events, count, ctx->target);
+    }
+
+    bool wants_ack = (header.flags & MOUSE_WIRE_FLAG_ACK) != 0;
+    if (wants_ack && count > 0) {
+        // Acked once the last event of the frame is out.
+        events[count - 1].ack_id = header.frame_id;
+        events[count - 1].ack_fd = httpd_req_to_sockfd(req);
+        events[count - 1].ack_session = ctx != NULL ? ctx->session : 0;
+    }
+    if (!submit_batch(events, count, 0) && wants_ack) {
+        mouse_wire_ack_t nack = {.frame_id = header.frame_id,
+                                 .delivered_us = 0};
+        httpd_ws_frame_t reply = {.type = HTTPD_WS_TYPE_BINARY,
+                                  .payload = (uint8_t *)&nack,
+                                  .len = sizeof nack};
+        httpd_ws_send_frame(req, &reply);
+    }
+    return ESP_OK;
+}
+
+httpd_uri_t uri_ws = {.uri = "/mouse/ws",
+                      .method = HTTP_GET,
+                      .handler = ws_handler,
+                      .user_ctx = NULL,
+                      .is_websocket = true};
+#else
+void webserver_ack_delivery(int fd, uint32_t session, uint16_t frame_id,
+                            int64_t delivered_us) {}
+#endif
+
 /* Function for starting the webserver */
 httpd_handle_t start_webserver(void) {
     /* Generate default configuration */
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    // The default of 8 is too few for every endpoint.
+    config.max_uri_handlers = WEBSERVER_MAX_URI_HANDLERS;
 
     /* Empty handle to esp_http_server */
     httpd_handle_t server = NULL;
 
+    // Scripted motion is summed rather than lost when the lane overflows.
+    // Lanes are never freed, so a restart keeps the one it had.
+    if (http_lane == NULL) {
+        http_lane = mouse_input_register_lane("http", MOUSE_RING_MERGE_TAIL);
+    }
+
     /* Start the httpd server */
     if (httpd_start(&server, &config) == ESP_OK) {
         /* Register URI handlers */
-        httpd_register_uri_handler(server, &uri_get);
+        // Same order on every start, so counters carry over a restart.
+        endpoint_count = 0;
+        register_endpoint(server, &uri_get);
+        register_endpoint(server, &uri_batch_post);
+        register_endpoint(server, &uri_move_get);
+        register_endpoint(server, &uri_cancel_get);
+        register_endpoint(server, &uri_clock_get);
+        register_endpoint(server, &uri_conn_get);
+        register_endpoint(server, &uri_latency_get);
+        register_endpoint(server, &uri_macro_record);
+        register_endpoint(server, &uri_macro_play);
+        register_endpoint(server, &uri_macro_stop);
+        register_endpoint(server, &uri_macro_delete);
+        register_endpoint(server, &uri_macro_list);
+        register_endpoint(server, &uri_metrics_get);
+        register_endpoint(server, &uri_trace_get);
+        register_endpoint(server, &uri_keyboard_type);
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+        register_endpoint(server, &uri_ws);
+#endif
         // httpd_register_uri_handler(server, &uri_post);
     }
+    server_handle = server;
     /* If server failed to start, handle will be NULL */
     return server;
 }
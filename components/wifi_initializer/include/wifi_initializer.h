@@ -1 +1 @@
-void init_wifi_task();
\ No newline at end of file
+void init_wifi_task(void *param);
@@ -1,11 +1,11 @@
 #include "wifi_initializer.h"
+#include "boot.h"
 #include "esp_wifi.h"
 #include <stdio.h>
 // #define LOG_LOCAL_LEVEL ESP_LOG_DEBUG
 #include "esp_log.h"
 
 static const char *TAG = "WifiInitializer";
-static TaskHandle_t *toNotify;
 
 static void event_handler(void *arg, esp_event_base_t event_base,
                           int32_t event_id, void *event_data) {
@@ -21,34 +21,31 @@ static void event_handler(void *arg, esp_event_base_t event_base,
         case WIFI_EVENT_STA_DISCONNECTED:
             ESP_LOGD(TAG, "Disconnected. NOT trying again.");
             esp_wifi_stop();
-            xTaskNotify(*toNotify, 2, eSetValueWithOverwrite);
-            vTaskDelete(NULL);
+            boot_done(BOOT_WIFI_FAILED);
             break;
         }
     } else if (event_base == IP_EVENT) {
         switch (event_id) {
         case IP_EVENT_STA_GOT_IP:
             ESP_LOGD(TAG, "Got IP");
-            xTaskNotify(*toNotify, 1, eSetValueWithOverwrite);
-            // UBaseType_t stacksize = uxTaskGetStackHighWaterMark(NULL);
-            // ESP_LOGD(TAG, "stack size: %d", stacksize);
-            vTaskDelete(NULL);
+            boot_done(BOOT_WIFI_UP);
             break;
         }
     }
 }
 
 /**
- * Initialize wifi and notify.
- * Notify value 1 on success and ready to use wifi.
- * Notify value >1 on any error and can't use wifi.
- * Note that success value is not 0 to distinguish from notify wait timeout.
- * After notification, kills the task by itself.
+ * Initialize wifi once NVS is up, and start connecting.
+ * Sets BOOT_NETIF when sockets can be opened, then BOOT_WIFI_UP once there
+ * is an address, or BOOT_WIFI_FAILED if the connection is lost. Deletes
+ * itself once wifi is started.
  */
-void init_wifi_task(void *taskHandlerToNotify) {
-    toNotify = (TaskHandle_t *)taskHandlerToNotify;
+void init_wifi_task(void *param) {
+    // The driver keeps its calibration and configuration there.
+    boot_wait(BOOT_BIT(BOOT_NVS), true, portMAX_DELAY);
 
     ESP_ERROR_CHECK(esp_netif_init());
+    boot_done(BOOT_NETIF);
     // ESP_ERROR_CHECK(esp_event_loop_create_default());
     esp_netif_t *sta_netif = esp_netif_create_default_wifi_sta();
     assert(sta_netif);
@@ -88,9 +85,6 @@ void init_wifi_task(void *taskHandlerToNotify) {
 
     esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
     esp_wifi_start();
-    while (1) {
-        // Do nothing and let event handler do the job.
-        vTaskDelay(100);
-    }
+    // The event handler, on the event loop task, does the rest.
     vTaskDelete(NULL);
 }
@@ -0,0 +1,300 @@
+/*
+ * Input pipeline benchmark on the host.
+ *
+ * Producer threads parse /mouse queries and submit them on their own
+ * mouse_input lane, as the HTTP handler does. The real dispatcher, coalescer
+ * and hid_service.c turn them into reports for fake_nimble, which carries
+ * them at the simulated connection interval. Prints throughput, the
+ * per-stage latency percentiles and whether every accepted motion reached
+ * every host.
+ */
+#include "esp_timer.h"
+#include "fake_nimble.h"
+#include "freertos/task.h"
+#include "hid_dispatcher.h"
+#include "hid_latency.h"
+#include "keyboard_input.h"
+#include "mouse_input.h"
+#include "mouse_query.h"
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Lanes left for producers; the simulation registers nothing else.
+#define MAX_PRODUCERS MOUSE_INPUT_MAX_LANES
+
+// Time for the pipeline to deliver what is left once producers stop. Full
+// speed input can queue more motion than that takes to send, one report per
+// connection interval.
+#define DRAIN_TIMEOUT_MS 10000
+// Delivery has settled when the hosts saw nothing new for this long.
+#define DRAIN_QUIET_MS 200
+
+typedef struct {
+    int seconds;
+    int producers;
+    // Events per second per producer, 0 for as fast as possible.
+    int rate;
+    int connections;
+    fake_link_t link;
+} bench_config_t;
+
+typedef struct {
+    pthread_t thread;
+    mouse_input_lane_t *lane;
+    char name[16];
+    uint32_t rate;
+    uint64_t submitted;
+    uint64_t accepted;
+    // Motion of the accepted events.
+    int64_t x;
+    int64_t y;
+} producer_t;
+
+static atomic_bool running;
+static hid_control_t control;
+
+// Alternating so merged sums stay small and signs are exercised.
+static const char *const queries[] = {
+    "x=3&y=-2",
+    "x=-1&y=4",
+    "x=2&y=1&target=all",
+    "y=-3",
+};
+
+static void *producer_main(void *arg) {
+    producer_t *producer = arg;
+    struct timespec next;
+    long period_ns = producer->rate > 0 ? 1000000000L / producer->rate : 0;
+    size_t n = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while (atomic_load_explicit(&running, memory_order_relaxed)) {
+        const char *query = queries[n++ % (sizeof queries / sizeof *queries)];
+        mouse_notification_t mouse_ev;
+        mouse_query_error_t err;
+
+        if (parse_mouse_query(query, strlen(query), &mouse_ev, &err) !=
+            MOUSE_QUERY_OK) {
+            fprintf(stderr, "bad query %s\n", query);
+            exit(2);
+        }
+        producer->submitted++;
+        if (mouse_input_submit(producer->lane, &mouse_ev)) {
+            producer->accepted++;
+            producer->x += mouse_ev.x;
+            producer->y += mouse_ev.y;
+        }
+
+        if (period_ns > 0) {
+            next.tv_nsec += period_ns;
+            while (next.tv_nsec >= 1000000000L) {
+                next.tv_sec++;
+                next.tv_nsec -= 1000000000L;
+            }
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        }
+    }
+    return NULL;
+}
+
+static uint64_t host_reports(int connections) {
+    uint64_t reports = 0;
+    for (int i = 0; i < connections; i++) {
+        reports += fake_nimble_get_host_stats(i)->reports;
+    }
+    return reports;
+}
+
+/**
+ * Wait until the hosts stop receiving reports. Returns false if they still
+ * were at DRAIN_TIMEOUT_MS.
+ */
+static bool drain(int connections) {
+    uint64_t last = host_reports(connections);
+    int quiet_ms = 0;
+    for (int waited_ms = 0;
+         waited_ms < DRAIN_TIMEOUT_MS && quiet_ms < DRAIN_QUIET_MS;
+         waited_ms += 10) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+        uint64_t reports = host_reports(connections);
+        quiet_ms = reports == last ? quiet_ms + 10 : 0;
+        last = reports;
+    }
+    return quiet_ms >= DRAIN_QUIET_MS;
+}
+
+static void print_latency(void) {
+    printf("%-9s %9s %8s %8s %8s %8s %8s %8s\n", "stage", "count", "mean",
+           "p50", "p90", "p99", "p99.9", "max");
+    for (int i = 0; i < HID_STAGE_COUNT; i++) {
+        const latency_histogram_t *hist = hid_latency_get(i);
+        printf("%-9s %9" PRIu32 " %8" PRIu32 " %8" PRIu32 " %8" PRIu32
+               " %8" PRIu32 " %8" PRIu32 " %8" PRIu32 "\n",
+               hid_latency_stage_name(i), hist->count,
+               latency_histogram_mean(hist),
+               latency_histogram_percentile(hist, 500),
+               latency_histogram_percentile(hist, 900),
+               latency_histogram_percentile(hist, 990),
+               latency_histogram_percentile(hist, 999), hist->max_us);
+    }
+}
+
+/**
+ * Returns false when a host's totals differ from what producers had
+ * accepted. Without settled, delivery was still going on.
+ */
+static bool print_results(const bench_config_t *config,
+                          const producer_t *producers, double elapsed_s,
+                          bool settled) {
+    uint64_t submitted = 0, accepted = 0, merged = 0, dropped = 0;
+    int64_t x = 0, y = 0;
+    bool conserved = true;
+
+    for (int i = 0; i < config->producers; i++) {
+        const mouse_ring_stats_t *ring = &producers[i].lane->ring.stats;
+        submitted += producers[i].submitted;
+        accepted += producers[i].accepted;
+        merged += ring->merged;
+        dropped += ring->dropped_newest + ring->dropped_oldest;
+        x += producers[i].x;
+        y += producers[i].y;
+    }
+
+    printf("events    submitted %.0f/s, accepted %.0f/s, merged on lane "
+           "%" PRIu64 ", dropped %" PRIu64 "\n",
+           submitted / elapsed_s, accepted / elapsed_s, merged, dropped);
+    const hid_dispatcher_stats_t *dispatcher = hid_dispatcher_get_stats();
+    printf("wakes     input %" PRIu32 ", credit %" PRIu32 ", timer %" PRIu32
+           "\n",
+           dispatcher->wakes_input, dispatcher->wakes_credit,
+           dispatcher->wakes_timer);
+    for (int i = 0; i < config->connections; i++) {
+        const fake_host_stats_t *host = fake_nimble_get_host_stats(i);
+        const hid_delivery_stats_t *delivery = &control.conns[i].delivery;
+        bool match = host->x == x && host->y == y;
+        const char *motion = match ? "ok" : settled ? "LOST" : "still queued";
+        printf("target %d  reports %" PRIu32 ", stalls %" PRIu32
+               ", refused %" PRIu32 ", motion %s\n",
+               i + 1, host->reports, delivery->stalls, host->refused, motion);
+        if (!match) {
+            printf("          host %" PRId64 ",%" PRId64 " sent %" PRId64
+                   ",%" PRId64 "\n",
+                   host->x, host->y, x, y);
+            conserved = !settled;
+        }
+    }
+    print_latency();
+    return conserved;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "usage: %s [-t seconds] [-p producers] [-r events/s per "
+            "producer]\n"
+            "       [-c connections] [-i interval in 1.25 ms] "
+            "[-n packets per event] [-I]\n",
+            name);
+    exit(2);
+}
+
+static void parse_args(int argc, char **argv, bench_config_t *config) {
+    int opt;
+    while ((opt = getopt(argc, argv, "t:p:r:c:i:n:I")) != -1) {
+        switch (opt) {
+        case 't':
+            config->seconds = atoi(optarg);
+            break;
+        case 'p':
+            config->producers = atoi(optarg);
+            break;
+        case 'r':
+            config->rate = atoi(optarg);
+            break;
+        case 'c':
+            config->connections = atoi(optarg);
+            break;
+        case 'i':
+            config->link.conn_itvl = atoi(optarg);
+            break;
+        case 'n':
+            config->link.packets_per_event = atoi(optarg);
+            break;
+        case 'I':
+            config->link.indicate = true;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (config->seconds < 1 || config->producers < 1 ||
+        config->producers > MAX_PRODUCERS || config->rate < 0 ||
+        config->connections < 1 || config->connections > HID_MAX_CONNECTIONS ||
+        config->link.conn_itvl < 6 || config->link.packets_per_event < 1) {
+        usage(argv[0]);
+    }
+}
+
+int main(int argc, char **argv) {
+    bench_config_t config = {
+        .seconds = 5,
+        .producers = 2,
+        .rate = 1000,
+        .connections = 1,
+        // 7.5 ms, what low_latency asks for.
+        .link = {.conn_itvl = 6, .packets_per_event = 4, .indicate = false},
+    };
+    producer_t producers[MAX_PRODUCERS];
+
+    parse_args(argc, argv, &config);
+    memset(producers, 0, sizeof producers);
+
+    fake_nimble_start(&control);
+    mouse_input_init();
+    keyboard_input_init();
+    for (int i = 0; i < config.producers; i++) {
+        snprintf(producers[i].name, sizeof producers[i].name, "bench%d", i);
+        // Same policy as the HTTP lane.
+        producers[i].lane = mouse_input_register_lane(producers[i].name,
+                                                      MOUSE_RING_MERGE_TAIL);
+        producers[i].rate = config.rate;
+    }
+    start_hid_dispatcher(&control);
+    for (int i = 0; i < config.connections; i++) {
+        fake_nimble_connect(i, &config.link);
+    }
+    // Let the dispatcher see the subscriptions before input arrives.
+    vTaskDelay(pdMS_TO_TICKS(50));
+
+    atomic_store(&running, true);
+    int64_t start_us = esp_timer_get_time();
+    for (int i = 0; i < config.producers; i++) {
+        pthread_create(&producers[i].thread, NULL, producer_main,
+                       &producers[i]);
+    }
+    vTaskDelay(pdMS_TO_TICKS(config.seconds * 1000));
+    atomic_store(&running, false);
+    for (int i = 0; i < config.producers; i++) {
+        pthread_join(producers[i].thread, NULL);
+    }
+    double elapsed_s = (esp_timer_get_time() - start_us) / 1e6;
+    bool settled = drain(config.connections);
+
+    char rate[16];
+    if (config.rate > 0) {
+        snprintf(rate, sizeof rate, "%d/s", config.rate);
+    } else {
+        snprintf(rate, sizeof rate, "full speed");
+    }
+    printf("%d producer(s) at %s, %d host(s), interval %.2f ms, "
+           "%d packets/event, %s\n",
+           config.producers, rate,
+           config.connections, config.link.conn_itvl * 1.25,
+           config.link.packets_per_event,
+           config.link.indicate ? "indications" : "notifications");
+    return print_results(&config, producers, elapsed_s, settled) ? 0 : 1;
+}
@@ -0,0 +1,223 @@
+/*
+ * /mouse query parser benchmark on the host.
+ *
+ * Times parse_mouse_query against the parser it replaced: the query copied
+ * to the heap, as httpd_req_get_url_query_str needs, then one
+ * httpd_query_key_value scan per key and atoi. The original handler only
+ * looked up x, y and click; the same approach looking up every key
+ * parse_mouse_query knows is timed too, as what it would cost today.
+ * Prints nanoseconds per query and checks that both agree on x and y; the
+ * exit status is 1 if not.
+ */
+#include "mouse_notification.h"
+#include "mouse_query.h"
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+// Size of the original handler's value buffer.
+#define LEGACY_PARAM_LEN 8
+
+typedef enum {
+    LEGACY_OK = 0,
+    LEGACY_NOT_FOUND,
+    LEGACY_TRUNC,
+} legacy_status_t;
+
+// What the original handler looked up.
+static const char *const original_keys[] = {"x", "y", "click"};
+#define ORIGINAL_KEY_COUNT (sizeof original_keys / sizeof original_keys[0])
+
+// Every key parse_mouse_query knows.
+static const char *const all_keys[] = {
+    "x",    "y",   "wheel",  "scroll", "button", "click", "action",
+    "hold", "gap", "target", "ax",     "ay",     "at",
+};
+#define ALL_KEY_COUNT (sizeof all_keys / sizeof all_keys[0])
+
+// Relative moves as sent by tools/loadgen.py and the macro player, then the
+// less common keys.
+static const char *const queries[] = {
+    "x=10&y=-5",
+    "x=3&y=4&click=true",
+    "x=-120&y=87&wheel=1&button=2",
+    "x=1&y=1&target=all&at=123456789",
+    "ax=16384&ay=8192&target=2",
+    "action=double&button=1&hold=40&gap=60",
+};
+#define QUERY_COUNT (sizeof queries / sizeof queries[0])
+
+/**
+ * httpd_query_key_value of esp_http_server (IDF 4.3): find key= in a NUL
+ * terminated query and copy its value into val, truncated to val_size.
+ */
+static legacy_status_t legacy_key_value(const char *query, const char *key,
+                                        char *val, size_t val_size) {
+    const char *ptr = query;
+    size_t key_len = strlen(key);
+    while (strlen(ptr)) {
+        const char *val_ptr = strchr(ptr, '=');
+        if (val_ptr == NULL) {
+            break;
+        }
+        size_t offset = val_ptr - ptr;
+        if (offset != key_len || strncasecmp(ptr, key, offset) != 0) {
+            ptr = strchr(val_ptr, '&');
+            if (ptr == NULL) {
+                break;
+            }
+            ptr++;
+            continue;
+        }
+        val_ptr++;
+        ptr = strchr(val_ptr, '&');
+        if (ptr == NULL) {
+            ptr = val_ptr + strlen(val_ptr);
+        }
+        size_t len = ptr - val_ptr;
+        size_t copied = len < val_size ? len : val_size - 1;
+        memcpy(val, val_ptr, copied);
+        val[copied] = '\0';
+        return len < val_size ? LEGACY_OK : LEGACY_TRUNC;
+    }
+    return LEGACY_NOT_FOUND;
+}
+
+/**
+ * The original get_handler, looking up keys; a truncated or missing value
+ * falls back to 0 as it did.
+ */
+static void legacy_parse(const char *query, size_t len,
+                         const char *const *keys, size_t key_count,
+                         mouse_notification_t *mouse_ev) {
+    char *buf = malloc(len + 1);
+    if (buf == NULL) {
+        exit(2);
+    }
+    memcpy(buf, query, len);
+    buf[len] = '\0';
+    memset(mouse_ev, 0, sizeof *mouse_ev);
+    char param[LEGACY_PARAM_LEN];
+    for (size_t i = 0; i < key_count; i++) {
+        if (legacy_key_value(buf, keys[i], param, sizeof param) !=
+            LEGACY_OK) {
+            continue;
+        }
+        if (strcmp(keys[i], "x") == 0) {
+            mouse_ev->x = atoi(param);
+        } else if (strcmp(keys[i], "y") == 0) {
+            mouse_ev->y = atoi(param);
+        } else if (strcmp(keys[i], "click") == 0) {
+            if (strcmp(param, "true") == 0) {
+                mouse_ev->button = 0x01;
+            }
+        } else {
+            // The rest only has to be read, not applied.
+            mouse_ev->wheel += atoi(param);
+        }
+    }
+    free(buf);
+}
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Keeps the compiler from dropping parses whose result is unused.
+static volatile int32_t sink;
+
+static double time_new(const char *query, size_t len, long iterations) {
+    mouse_notification_t mouse_ev;
+    mouse_query_error_t err;
+    int64_t start_ns = now_ns();
+    for (long i = 0; i < iterations; i++) {
+        memset(&mouse_ev, 0, sizeof mouse_ev);
+        parse_mouse_query(query, len, &mouse_ev, &err);
+        sink = mouse_ev.x;
+    }
+    return (double)(now_ns() - start_ns) / iterations;
+}
+
+static double time_legacy(const char *query, size_t len,
+                          const char *const *keys, size_t key_count,
+                          long iterations) {
+    mouse_notification_t mouse_ev;
+    int64_t start_ns = now_ns();
+    for (long i = 0; i < iterations; i++) {
+        legacy_parse(query, len, keys, key_count, &mouse_ev);
+        sink = mouse_ev.x;
+    }
+    return (double)(now_ns() - start_ns) / iterations;
+}
+
+/**
+ * Returns false if the parsers disagree on query.
+ */
+static bool check_query(const char *query, size_t len) {
+    mouse_notification_t parsed, legacy;
+    mouse_query_error_t err;
+    memset(&parsed, 0, sizeof parsed);
+    if (parse_mouse_query(query, len, &parsed, &err) != MOUSE_QUERY_OK) {
+        printf("%s: %s\n", query, mouse_query_status_str(err.status));
+        return false;
+    }
+    legacy_parse(query, len, original_keys, ORIGINAL_KEY_COUNT, &legacy);
+    if (parsed.x != legacy.x || parsed.y != legacy.y) {
+        printf("%s: x/y %d/%d, was %d/%d\n", query, parsed.x, parsed.y,
+               legacy.x, legacy.y);
+        return false;
+    }
+    return true;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-n iterations per query]\n", name);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    long iterations = 1000000;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+        case 'n':
+            iterations = strtol(optarg, NULL, 10);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (iterations < 1) {
+        usage(argv[0]);
+    }
+
+    bool ok = true;
+    double total_new = 0, total_original = 0, total_all = 0;
+
+    printf("ns per query, %ld iterations each\n", iterations);
+    printf("%-40s %8s %8s %8s\n", "query", "new", "x/y/clk", "all keys");
+    for (size_t i = 0; i < QUERY_COUNT; i++) {
+        const char *query = queries[i];
+        size_t len = strlen(query);
+        ok &= check_query(query, len);
+        double parsed_ns = time_new(query, len, iterations);
+        double original_ns = time_legacy(query, len, original_keys,
+                                         ORIGINAL_KEY_COUNT, iterations);
+        double all_ns =
+            time_legacy(query, len, all_keys, ALL_KEY_COUNT, iterations);
+        printf("%-40s %8.1f %8.1f %8.1f\n", query, parsed_ns, original_ns,
+               all_ns);
+        total_new += parsed_ns;
+        total_original += original_ns;
+        total_all += all_ns;
+    }
+    printf("%-40s %8.1f %8.1f %8.1f\n", "mean", total_new / QUERY_COUNT,
+           total_original / QUERY_COUNT, total_all / QUERY_COUNT);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,287 @@
+/*
+ * mouse_ring benchmark on the host.
+ *
+ * Runs one producer and one consumer thread against a ring for each policy,
+ * both busy looping between events and the consumer a little slower, so the
+ * ring keeps filling up while the consumer is popping and every drop and
+ * merge path, including drop-oldest reusing the slot the consumer is about
+ * to claim, is hit while both sides run. The producer yields after bursts
+ * of random length and the consumer whenever it finds nothing, so the two
+ * also take turns on a single CPU. Every event carries its sequence
+ * number and motion derived from it, so a lost, repeated, reordered or torn
+ * event shows as a mismatch. Prints the rates and the ring's stats; the exit
+ * status is 1 if any policy mismatched.
+ */
+#include "mouse_ring.h"
+#include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Consecutive events with the same button, so merge-tail also falls back to
+// dropping when the button changes at a full ring.
+#define MERGE_RUN_LEN 1000
+
+typedef struct {
+    uint32_t events;
+    // Busy loop iterations after each push and each pop.
+    uint32_t producer_work;
+    uint32_t consumer_work;
+    // Longest run of pushes between two yields of the producer.
+    uint32_t burst;
+} bench_config_t;
+
+typedef struct {
+    mouse_ring_t ring;
+    const bench_config_t *config;
+    // Set by the producer once it pushed its last event.
+    atomic_bool done;
+    // Events the ring accepted, by the producer.
+    uint32_t accepted;
+    // By the consumer.
+    uint32_t popped;
+    // Pops that came back empty with events queued, mostly because the
+    // producer held the next slot.
+    uint32_t busy_misses;
+    // Motion summed over what was popped.
+    int64_t sum_x;
+    // First inconsistency, NULL while none.
+    const char *error;
+    uint64_t error_seq;
+} bench_run_t;
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static const char *policy_name(mouse_ring_policy_t policy) {
+    switch (policy) {
+    case MOUSE_RING_DROP_NEWEST:
+        return "drop-newest";
+    case MOUSE_RING_DROP_OLDEST:
+        return "drop-oldest";
+    case MOUSE_RING_MERGE_TAIL:
+        return "merge-tail";
+    }
+    return "?";
+}
+
+/**
+ * Event number seq, 1 based. Merged events only add up their motion, so
+ * merge-tail gets unit steps; the others carry seq in their motion too.
+ */
+static void make_event(mouse_ring_policy_t policy, uint32_t seq,
+                       mouse_notification_t *event) {
+    memset(event, 0, sizeof *event);
+    event->received_us = seq;
+    if (policy == MOUSE_RING_MERGE_TAIL) {
+        event->button = (seq / MERGE_RUN_LEN) & 1;
+        event->x = 1;
+        event->y = -1;
+    } else {
+        event->x = seq & 0x7fff;
+        event->y = -event->x;
+        event->wheel = (seq >> 15) & 0x7fff;
+    }
+}
+
+static void fail(bench_run_t *run, const char *error, uint64_t seq) {
+    if (run->error == NULL) {
+        run->error = error;
+        run->error_seq = seq;
+    }
+}
+
+static void check_event(bench_run_t *run, const mouse_notification_t *event,
+                        uint64_t *last_seq) {
+    uint64_t seq = event->received_us;
+    if (seq <= *last_seq) {
+        fail(run, "repeated or out of order", seq);
+    }
+    *last_seq = seq;
+    if (run->ring.policy == MOUSE_RING_MERGE_TAIL) {
+        // A merge keeps the oldest event's stamp and button.
+        if (event->x < 1 || event->y != -event->x || event->wheel != 0 ||
+            event->button != ((seq / MERGE_RUN_LEN) & 1)) {
+            fail(run, "torn merge", seq);
+        }
+    } else if (event->x != (int16_t)(seq & 0x7fff) || event->y != -event->x ||
+               event->wheel != (int16_t)((seq >> 15) & 0x7fff)) {
+        fail(run, "torn event", seq);
+    }
+    run->sum_x += event->x;
+}
+
+static void spin(uint32_t iterations) {
+    for (volatile uint32_t i = 0; i < iterations; i++) {
+    }
+}
+
+static void *producer(void *arg) {
+    bench_run_t *run = arg;
+    mouse_notification_t event;
+    unsigned int seed = 1;
+    uint32_t burst = 0;
+    for (uint32_t seq = 1; seq <= run->config->events; seq++) {
+        make_event(run->ring.policy, seq, &event);
+        if (mouse_ring_push(&run->ring, &event)) {
+            run->accepted++;
+        }
+        spin(run->config->producer_work);
+        if (burst-- == 0) {
+            burst = rand_r(&seed) % run->config->burst;
+            sched_yield();
+        }
+    }
+    atomic_store(&run->done, true);
+    return NULL;
+}
+
+static void *consumer(void *arg) {
+    bench_run_t *run = arg;
+    mouse_notification_t event;
+    uint64_t last_seq = 0;
+    while (1) {
+        // Read before popping: once set, an empty ring stays empty.
+        bool done = atomic_load(&run->done);
+        if (mouse_ring_pop(&run->ring, &event)) {
+            run->popped++;
+            check_event(run, &event, &last_seq);
+            spin(run->config->consumer_work);
+        } else if (mouse_ring_occupancy(&run->ring) != 0) {
+            run->busy_misses++;
+            sched_yield();
+        } else if (done) {
+            return NULL;
+        } else {
+            sched_yield();
+        }
+    }
+}
+
+/**
+ * Whether what came out of the ring adds up with what went in.
+ */
+static void check_totals(bench_run_t *run) {
+    const mouse_ring_stats_t *stats = &run->ring.stats;
+    if (stats->pushed + stats->merged != run->accepted ||
+        stats->pushed + stats->merged + stats->dropped_newest !=
+            run->config->events) {
+        fail(run, "stats do not add up", 0);
+    }
+    switch (run->ring.policy) {
+    case MOUSE_RING_DROP_NEWEST:
+        if (run->popped != run->accepted || stats->dropped_oldest != 0) {
+            fail(run, "accepted event lost", 0);
+        }
+        break;
+    case MOUSE_RING_DROP_OLDEST:
+        if (run->popped + stats->dropped_oldest != run->accepted) {
+            fail(run, "event lost or duplicated", 0);
+        }
+        break;
+    case MOUSE_RING_MERGE_TAIL:
+        // Each accepted step is in a popped event, merged or not.
+        if (run->sum_x != run->accepted) {
+            fail(run, "merged motion lost", 0);
+        }
+        break;
+    }
+}
+
+/**
+ * Returns false on a mismatch.
+ */
+static bool run_policy(const bench_config_t *config,
+                       mouse_ring_policy_t policy) {
+    bench_run_t *run = calloc(1, sizeof *run);
+    if (run == NULL) {
+        exit(2);
+    }
+    mouse_ring_init(&run->ring, policy);
+    run->config = config;
+    atomic_init(&run->done, false);
+
+    double start_s = now_s();
+    pthread_t producer_thread, consumer_thread;
+    pthread_create(&consumer_thread, NULL, consumer, run);
+    pthread_create(&producer_thread, NULL, producer, run);
+    pthread_join(producer_thread, NULL);
+    pthread_join(consumer_thread, NULL);
+    double elapsed_s = now_s() - start_s;
+    check_totals(run);
+
+    const mouse_ring_stats_t *stats = &run->ring.stats;
+    printf("%-12s %6.2f M/s  pushed %" PRIu32 ", popped %" PRIu32
+           ", dropped newest %" PRIu32 " oldest %" PRIu32 ", merged %" PRIu32
+           ", busy misses %" PRIu32 ", high watermark %" PRIu32 ", %s\n",
+           policy_name(policy), config->events / elapsed_s / 1e6,
+           stats->pushed, run->popped, stats->dropped_newest,
+           stats->dropped_oldest, stats->merged, run->busy_misses,
+           stats->high_watermark, run->error == NULL ? "ok" : "MISMATCH");
+    bool ok = run->error == NULL;
+    if (!ok) {
+        printf("             %s at event %" PRIu64 "\n", run->error,
+               run->error_seq);
+    }
+    free(run);
+    return ok;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "usage: %s [-n events per policy] [-p producer work] "
+            "[-w consumer work]\n"
+            "       [-b longest producer burst]\n",
+            name);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    bench_config_t config = {
+        .events = 2000000,
+        .producer_work = 40,
+        .consumer_work = 50,
+        .burst = 2 * MOUSE_RING_CAPACITY,
+    };
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:p:w:b:")) != -1) {
+        switch (opt) {
+        case 'n':
+            config.events = strtoul(optarg, NULL, 10);
+            break;
+        case 'p':
+            config.producer_work = strtoul(optarg, NULL, 10);
+            break;
+        case 'w':
+            config.consumer_work = strtoul(optarg, NULL, 10);
+            break;
+        case 'b':
+            config.burst = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (config.events < 1 || config.burst < 1) {
+        usage(argv[0]);
+    }
+
+    printf("%" PRIu32 " events per policy, producer work %" PRIu32
+           ", consumer work %" PRIu32 ", bursts up to %" PRIu32 "\n",
+           config.events, config.producer_work, config.consumer_work,
+           config.burst);
+    bool ok = true;
+    ok &= run_policy(&config, MOUSE_RING_DROP_NEWEST);
+    ok &= run_policy(&config, MOUSE_RING_DROP_OLDEST);
+    ok &= run_policy(&config, MOUSE_RING_MERGE_TAIL);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,225 @@
+/*
+ * Typing benchmark on the host.
+ *
+ * Queues text through keyboard_input in /keyboard/type sized pieces, as the
+ * HTTP handler does. The real dispatcher, key packer and hid_service.c turn
+ * it into keyboard reports for fake_nimble, whose hosts read the key
+ * presses back into text. Prints the characters per second each host
+ * typed, and whether its text matches what was sent: a key lost or typed
+ * twice shows as a mismatch.
+ */
+#include "esp_timer.h"
+#include "fake_nimble.h"
+#include "freertos/task.h"
+#include "hid_dispatcher.h"
+#include "keyboard_input.h"
+#include "mouse_input.h"
+#include "mouse_notification.h"
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Text per keyboard_input_type call, KEYBOARD_TYPE_MAX_LEN of webserver.h,
+// which needs esp_http_server.
+#define TYPE_CHUNK_LEN 512
+
+// Hosts that typed nothing new for this long are done, or stuck.
+#define SETTLE_QUIET_MS 1000
+
+typedef struct {
+    size_t length;
+    int connections;
+    fake_link_t link;
+} bench_config_t;
+
+static hid_control_t control;
+
+// Repeated letters, case changes, digits, symbols and line breaks, so runs
+// end for every reason the packer has.
+static const char sample[] =
+    "The quick brown fox jumps over the lazy dog. Pack my box with five "
+    "dozen liquor jugs!\n"
+    "Mississippi bookkeepers committee: 1,234 balloons (approx. 99%) said "
+    "\"hello\" to ALL CAPS and MiXeD cAsE;\ttabs, {braces} [brackets] "
+    "<angles> ~tilde `tick` #hash $dollar ^caret &and *star _under +plus "
+    "=equals |pipe \\back /slash ?ask\n";
+
+static char *make_text(size_t length) {
+    char *text = malloc(length);
+    if (text == NULL) {
+        exit(2);
+    }
+    for (size_t i = 0; i < length; i++) {
+        text[i] = sample[i % (sizeof sample - 1)];
+    }
+    return text;
+}
+
+static uint64_t typed_total(int connections) {
+    uint64_t typed = 0;
+    for (int i = 0; i < connections; i++) {
+        typed += fake_nimble_get_host_stats(i)->typed;
+    }
+    return typed;
+}
+
+/**
+ * Queue text a chunk at a time, waiting whenever the queue is full.
+ */
+static void type_text(const char *text, size_t length) {
+    size_t pos = 0;
+    while (pos < length) {
+        size_t len = length - pos;
+        if (len > TYPE_CHUNK_LEN) {
+            len = TYPE_CHUNK_LEN;
+        }
+        size_t strokes, error_at;
+        keyboard_type_status_t status = keyboard_input_type(
+            text + pos, len, MOUSE_TARGET_ALL, &strokes, &error_at);
+        if (status == KEYBOARD_TYPE_FULL) {
+            vTaskDelay(1);
+            continue;
+        }
+        if (status != KEYBOARD_TYPE_OK) {
+            fprintf(stderr, "byte %zu: %s\n", pos + error_at,
+                    keyboard_type_status_str(status));
+            exit(2);
+        }
+        pos += len;
+    }
+}
+
+/**
+ * Wait until the hosts stop typing, at most timeout_ms.
+ */
+static void settle(int connections, int timeout_ms) {
+    uint64_t last = typed_total(connections);
+    int quiet_ms = 0;
+    for (int waited_ms = 0;
+         waited_ms < timeout_ms && quiet_ms < SETTLE_QUIET_MS;
+         waited_ms += 10) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+        uint64_t typed = typed_total(connections);
+        quiet_ms = typed == last ? quiet_ms + 10 : 0;
+        last = typed;
+    }
+}
+
+/**
+ * Returns false when a host's text differs from what was sent.
+ */
+static bool print_results(const bench_config_t *config, const char *text,
+                          int64_t start_us) {
+    double interval_ms = config->link.conn_itvl * 1.25;
+    bool all_match = true;
+
+    for (int i = 0; i < config->connections; i++) {
+        const fake_host_stats_t *host = fake_nimble_get_host_stats(i);
+        size_t compared = host->typed < FAKE_HOST_TEXT_LEN ? host->typed
+                                                           : FAKE_HOST_TEXT_LEN;
+        if (compared > config->length) {
+            compared = config->length;
+        }
+        size_t mismatch = 0;
+        while (mismatch < compared && host->text[mismatch] == text[mismatch]) {
+            mismatch++;
+        }
+        bool match = host->typed == config->length && mismatch == compared;
+        double elapsed_s = (host->typed_us - start_us) / 1e6;
+        printf("target %d  typed %" PRIu32 " in %.2f s, %.0f chars/s, "
+               "%" PRIu32 " reports, %.2f chars/report, text %s\n",
+               i + 1, host->typed, elapsed_s,
+               elapsed_s > 0 ? host->typed / elapsed_s : 0.0,
+               host->key_reports,
+               host->key_reports > 0 ? (double)host->typed / host->key_reports
+                                     : 0.0,
+               match ? "ok" : "MISMATCH");
+        if (!match) {
+            printf("          first difference at %zu of %zu sent\n",
+                   mismatch, config->length);
+            all_match = false;
+        }
+    }
+    // A press and a release report per character, one report per event.
+    printf("one key per report would type %.0f chars/s\n",
+           1000.0 / (2 * interval_ms));
+    return all_match;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "usage: %s [-l characters] [-c connections] "
+            "[-i interval in 1.25 ms]\n"
+            "       [-n packets per event] [-I]\n",
+            name);
+    exit(2);
+}
+
+static void parse_args(int argc, char **argv, bench_config_t *config) {
+    int opt;
+    while ((opt = getopt(argc, argv, "l:c:i:n:I")) != -1) {
+        switch (opt) {
+        case 'l':
+            config->length = strtoul(optarg, NULL, 10);
+            break;
+        case 'c':
+            config->connections = atoi(optarg);
+            break;
+        case 'i':
+            config->link.conn_itvl = atoi(optarg);
+            break;
+        case 'n':
+            config->link.packets_per_event = atoi(optarg);
+            break;
+        case 'I':
+            config->link.indicate = true;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (config->length < 1 || config->length > FAKE_HOST_TEXT_LEN ||
+        config->connections < 1 || config->connections > HID_MAX_CONNECTIONS ||
+        config->link.conn_itvl < 6 || config->link.packets_per_event < 1) {
+        usage(argv[0]);
+    }
+}
+
+int main(int argc, char **argv) {
+    bench_config_t config = {
+        .length = 5000,
+        .connections = 1,
+        // 7.5 ms, what low_latency asks for.
+        .link = {.conn_itvl = 6, .packets_per_event = 4, .indicate = false},
+    };
+
+    parse_args(argc, argv, &config);
+    char *text = make_text(config.length);
+
+    fake_nimble_start(&control);
+    mouse_input_init();
+    keyboard_input_init();
+    start_hid_dispatcher(&control);
+    for (int i = 0; i < config.connections; i++) {
+        fake_nimble_connect(i, &config.link);
+    }
+    // Let the dispatcher see the subscriptions before input arrives.
+    vTaskDelay(pdMS_TO_TICKS(50));
+
+    int64_t start_us = esp_timer_get_time();
+    type_text(text, config.length);
+    // Generous: every character in a report pair of its own.
+    int timeout_ms = config.length * config.link.conn_itvl * 5 / 2 + 2000;
+    settle(config.connections, timeout_ms);
+
+    printf("%zu characters, %d host(s), interval %.2f ms, %d packets/event, "
+           "%s\n",
+           config.length, config.connections, config.link.conn_itvl * 1.25,
+           config.link.packets_per_event,
+           config.link.indicate ? "indications" : "notifications");
+    bool ok = print_results(&config, text, start_us);
+    free(text);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,584 @@
+/*
+ * The input pipeline behind loopback sockets, for tools/loadgen.py.
+ *
+ * Serves GET /mouse, POST /mouse/batch, POST /keyboard/type, GET /metrics
+ * and GET /trace over HTTP/1.1 with keep-alive, and the UDP datagram
+ * protocol through udp_listener_serve. Like esp_http_server, one thread
+ * handles every HTTP connection, so all of them share the single "http"
+ * lane. Reports go to fake_nimble hosts.
+ */
+#include "esp_timer.h"
+#include "fake_nimble.h"
+#include "freertos/task.h"
+#include "hid_dispatcher.h"
+#include "hid_latency.h"
+#include "keyboard_input.h"
+#include "metrics.h"
+#include "mouse_input.h"
+#include "mouse_query.h"
+#include "mouse_wire.h"
+#include "trace.h"
+#include "udp_listener.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// As in webserver.h, which needs esp_http_server.
+#define MOUSE_BATCH_MAX_EVENTS 32
+#define KEYBOARD_TYPE_MAX_LEN 512
+// Sockets open at once, as CONFIG_LWIP_MAX_SOCKETS allows on the device.
+#define MAX_CLIENTS 16
+// Request line, headers and the longest body, a full text to type.
+#define REQUEST_BUF_LEN (1024 + KEYBOARD_TYPE_MAX_LEN)
+
+typedef struct {
+    int fd;
+    char buf[REQUEST_BUF_LEN];
+    size_t used;
+} client_t;
+
+// Growing buffer a /metrics page is written into before it is sent.
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} page_t;
+
+typedef struct {
+    const char *path;
+    metrics_counter_t requests;
+} endpoint_t;
+
+enum {
+    ENDPOINT_MOUSE,
+    ENDPOINT_BATCH,
+    ENDPOINT_KEYBOARD,
+    ENDPOINT_METRICS,
+    ENDPOINT_TRACE,
+    ENDPOINT_COUNT,
+};
+
+typedef struct {
+    const char *name;
+    const char *help;
+    size_t offset;
+} lane_family_t;
+
+// The lane counters loadgen.py reads, named as in main/device_metrics.c.
+static const lane_family_t lane_families[] = {
+    {"mouse_input_pushed_total", "Events queued on the lane.",
+     offsetof(mouse_ring_stats_t, pushed)},
+    {"mouse_input_dropped_newest_total",
+     "Events refused because the lane was full.",
+     offsetof(mouse_ring_stats_t, dropped_newest)},
+    {"mouse_input_dropped_oldest_total",
+     "Queued events lost to make room for a new one.",
+     offsetof(mouse_ring_stats_t, dropped_oldest)},
+    {"mouse_input_merged_total",
+     "Events summed into the newest queued event.",
+     offsetof(mouse_ring_stats_t, merged)},
+};
+
+static hid_control_t control;
+static mouse_input_lane_t *http_lane;
+static udp_listener_state_t udp_state;
+static int connections;
+static endpoint_t endpoints[ENDPOINT_COUNT] = {
+    [ENDPOINT_MOUSE] = {.path = "/mouse"},
+    [ENDPOINT_BATCH] = {.path = "/mouse/batch"},
+    [ENDPOINT_KEYBOARD] = {.path = "/keyboard/type"},
+    [ENDPOINT_METRICS] = {.path = "/metrics"},
+    [ENDPOINT_TRACE] = {.path = "/trace"},
+};
+static metrics_counter_t bad_requests;
+
+static void send_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t sent = send(fd, data, len, MSG_NOSIGNAL);
+        if (sent <= 0) {
+            if (sent < 0 && errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        data += sent;
+        len -= sent;
+    }
+}
+
+static void respond(int fd, const char *status, const char *type,
+                    const char *body, size_t body_len) {
+    char head[160];
+    int head_len = snprintf(head, sizeof head,
+                            "HTTP/1.1 %s\r\nContent-Type: %s\r\n"
+                            "Content-Length: %zu\r\n\r\n",
+                            status, type, body_len);
+    // One segment, or Nagle holds the body back for the client's delayed ACK.
+    char *response = malloc(head_len + body_len);
+    memcpy(response, head, head_len);
+    memcpy(response + head_len, body, body_len);
+    send_all(fd, response, head_len + body_len);
+    free(response);
+}
+
+static void respond_text(int fd, const char *status, const char *body) {
+    respond(fd, status, "text/html", body, strlen(body));
+}
+
+static void respond_bad_request(int fd, const char *msg) {
+    metrics_counter_inc(&bad_requests);
+    respond_text(fd, "400 Bad Request", msg);
+}
+
+/**
+ * Value of key in query, copied into value. Like httpd_query_key_value.
+ */
+static bool query_value(const char *query, const char *key, char *value,
+                        size_t value_len) {
+    size_t key_len = strlen(key);
+    for (const char *p = query; p != NULL && *p != '\0';) {
+        const char *end = strchr(p, '&');
+        size_t pair_len = end != NULL ? (size_t)(end - p) : strlen(p);
+        if (pair_len > key_len && strncmp(p, key, key_len) == 0 &&
+            p[key_len] == '=') {
+            size_t len = pair_len - key_len - 1;
+            if (len >= value_len) {
+                return false;
+            }
+            memcpy(value, p + key_len + 1, len);
+            value[len] = '\0';
+            return true;
+        }
+        p = end != NULL ? end + 1 : NULL;
+    }
+    return false;
+}
+
+static void handle_mouse(int fd, const char *query) {
+    int64_t received_us = esp_timer_get_time();
+    mouse_notification_t mouse_ev;
+    mouse_query_error_t err;
+
+    if (parse_mouse_query(query, strlen(query), &mouse_ev, &err) !=
+        MOUSE_QUERY_OK) {
+        char msg[48];
+        snprintf(msg, sizeof msg, "%.*s: %s", (int)err.key_len, err.key,
+                 mouse_query_status_str(err.status));
+        respond_bad_request(fd, msg);
+        return;
+    }
+    if (mouse_ev.at_us != 0) {
+        // There is no scheduler here.
+        respond_text(fd, "501 Not Implemented", "No at= on the simulation");
+        return;
+    }
+    mouse_ev.received_us = received_us;
+    TRACE_D(TRACE_HTTP_MOUSE, mouse_ev.x, mouse_ev.y, mouse_ev.wheel,
+            mouse_ev.target);
+    if (!mouse_input_submit(http_lane, &mouse_ev)) {
+        respond_text(fd, "503 Service Unavailable", "Queue full");
+        return;
+    }
+    respond_text(fd, "200 OK", "URI GET Response");
+}
+
+static void handle_batch(int fd, const char *query, const char *body,
+                         size_t body_len) {
+    int64_t received_us = esp_timer_get_time();
+    mouse_wire_event_t events[MOUSE_BATCH_MAX_EVENTS];
+    mouse_notification_t batch[MOUSE_BATCH_MAX_EVENTS];
+    uint8_t target = MOUSE_TARGET_ALL;
+    char value[8];
+
+    if (query_value(query, "target", value, sizeof value) &&
+        parse_mouse_target(value, strlen(value), &target) != MOUSE_QUERY_OK) {
+        respond_bad_request(fd, "Bad target");
+        return;
+    }
+    if (body_len == 0 || body_len % sizeof(mouse_wire_event_t) != 0 ||
+        body_len > sizeof events) {
+        respond_bad_request(fd, "Bad batch length");
+        return;
+    }
+    memcpy(events, body, body_len);
+    size_t count = body_len / sizeof(mouse_wire_event_t);
+    for (size_t i = 0; i < count; i++) {
+        if (!mouse_wire_decode(&events[i], &batch[i])) {
+            respond_bad_request(fd, "Event value out of range");
+            return;
+        }
+        batch[i].received_us = received_us;
+        batch[i].target = target;
+        if (batch[i].delay_ms != 0) {
+            // The device waits for delays in its scheduler.
+            respond_text(fd, "501 Not Implemented",
+                         "No delays on the simulation");
+            return;
+        }
+    }
+    if (!mouse_input_submit_all(http_lane, batch, count)) {
+        respond_text(fd, "503 Service Unavailable", "Queue full");
+        return;
+    }
+    respond_text(fd, "200 OK", "Batch queued");
+}
+
+static void handle_keyboard(int fd, const char *query, const char *body,
+                            size_t body_len) {
+    uint8_t target = MOUSE_TARGET_ALL;
+    size_t strokes, error_at;
+    char value[8];
+    char resp[48];
+
+    if (query_value(query, "target", value, sizeof value) &&
+        parse_mouse_target(value, strlen(value), &target) != MOUSE_QUERY_OK) {
+        respond_bad_request(fd, "Bad target");
+        return;
+    }
+    if (body_len == 0 || body_len > KEYBOARD_TYPE_MAX_LEN) {
+        respond_bad_request(fd, "Bad text length");
+        return;
+    }
+    keyboard_type_status_t status =
+        keyboard_input_type(body, body_len, target, &strokes, &error_at);
+    if (status == KEYBOARD_TYPE_FULL) {
+        respond_text(fd, "503 Service Unavailable", "Queue full");
+        return;
+    }
+    if (status != KEYBOARD_TYPE_OK) {
+        snprintf(resp, sizeof resp, "At byte %zu: %s", error_at,
+                 keyboard_type_status_str(status));
+        respond_bad_request(fd, resp);
+        return;
+    }
+    snprintf(resp, sizeof resp, "queued=%zu", strokes);
+    respond_text(fd, "200 OK", resp);
+}
+
+static uint32_t stat_at(const void *stats, size_t offset) {
+    return *(const uint32_t *)((const uint8_t *)stats + offset);
+}
+
+static void page_append(void *ctx, const char *data, size_t len) {
+    page_t *page = ctx;
+    if (page->len + len > page->cap) {
+        page->cap = (page->len + len) * 2;
+        page->data = realloc(page->data, page->cap);
+    }
+    memcpy(page->data + page->len, data, len);
+    page->len += len;
+}
+
+/**
+ * Same names as the device's /metrics, for what the simulation has.
+ */
+static void handle_metrics(int fd) {
+    page_t page = {0};
+    metrics_writer_t writer;
+    char labels[48];
+
+    metrics_writer_init(&writer, page_append, &page);
+    metrics_family(&writer, "http_requests_total", "counter",
+                   "Requests served, by path.");
+    for (int i = 0; i < ENDPOINT_COUNT; i++) {
+        snprintf(labels, sizeof labels, "path=\"%s\"", endpoints[i].path);
+        metrics_sample(&writer, "http_requests_total", labels,
+                       metrics_counter_sum(&endpoints[i].requests));
+    }
+    metrics_single(&writer, "http_bad_requests_total", "counter",
+                   "Requests or websocket frames rejected as malformed.",
+                   metrics_counter_sum(&bad_requests));
+
+    for (size_t f = 0; f < sizeof lane_families / sizeof *lane_families;
+         f++) {
+        const lane_family_t *family = &lane_families[f];
+        metrics_family(&writer, family->name, "counter", family->help);
+        for (size_t i = 0; i < mouse_input_lane_count(); i++) {
+            mouse_input_lane_t *lane = mouse_input_get_lane(i);
+            snprintf(labels, sizeof labels, "lane=\"%s\"", lane->name);
+            metrics_sample(&writer, family->name, labels,
+                           stat_at(&lane->ring.stats, family->offset));
+        }
+    }
+
+    metrics_family(&writer, "hid_reports_sent_total", "counter",
+                   "Reports handed to NimBLE.");
+    for (int i = 0; i < connections; i++) {
+        snprintf(labels, sizeof labels, "target=\"%d\"", i + 1);
+        metrics_sample(&writer, "hid_reports_sent_total", labels,
+                       control.conns[i].delivery.sent);
+    }
+    metrics_single(&writer, "keyboard_strokes_total", "counter",
+                   "Characters queued by /keyboard/type.",
+                   keyboard_input_get_stats()->strokes);
+    metrics_single(&writer, "hid_keyboard_reports_total", "counter",
+                   "Keyboard reports sent, over every host.",
+                   hid_dispatcher_get_stats()->key_reports);
+
+    metrics_single(&writer, "udp_datagrams_total", "counter",
+                   "Datagrams received.", udp_state.stats.received);
+    metrics_family(&writer, "udp_datagrams_rejected_total", "counter",
+                   "Datagrams not turned into input, by reason.");
+    metrics_sample(&writer, "udp_datagrams_rejected_total",
+                   "reason=\"duplicate\"", udp_state.stats.duplicates);
+    metrics_sample(&writer, "udp_datagrams_rejected_total",
+                   "reason=\"stale\"", udp_state.stats.stale);
+    metrics_sample(&writer, "udp_datagrams_rejected_total",
+                   "reason=\"malformed\"", udp_state.stats.malformed);
+    metrics_sample(&writer, "udp_datagrams_rejected_total",
+                   "reason=\"queue_full\"", udp_state.stats.queue_full);
+
+    metrics_family(&writer, "hid_latency_us", "summary",
+                   "Input latency by stage, since the last reset.");
+    for (int i = 0; i < HID_STAGE_COUNT; i++) {
+        const latency_histogram_t *hist = hid_latency_get(i);
+        const char *stage = hid_latency_stage_name(i);
+        snprintf(labels, sizeof labels, "stage=\"%s\",quantile=\"0.99\"",
+                 stage);
+        metrics_sample(&writer, "hid_latency_us", labels,
+                       latency_histogram_percentile(hist, 990));
+        snprintf(labels, sizeof labels, "stage=\"%s\"", stage);
+        metrics_sample(&writer, "hid_latency_us_count", labels, hist->count);
+    }
+    metrics_writer_finish(&writer);
+
+    respond(fd, "200 OK", "text/plain; version=0.0.4", page.data, page.len);
+    free(page.data);
+}
+
+static void handle_trace(int fd, const char *query) {
+    page_t page = {0};
+    char value[8];
+
+    trace_dump(page_append, &page);
+    respond(fd, "200 OK", "application/json", page.data, page.len);
+    free(page.data);
+    if (query_value(query, "clear", value, sizeof value) &&
+        (strcmp(value, "1") == 0 || strcmp(value, "true") == 0)) {
+        trace_clear();
+    }
+}
+
+static void route(int fd, const char *method, char *target, const char *body,
+                  size_t body_len) {
+    char *query = strchr(target, '?');
+    if (query != NULL) {
+        *query++ = '\0';
+    } else {
+        query = "";
+    }
+
+    if (strcmp(method, "GET") == 0 && strcmp(target, "/mouse") == 0) {
+        metrics_counter_inc(&endpoints[ENDPOINT_MOUSE].requests);
+        handle_mouse(fd, query);
+    } else if (strcmp(method, "POST") == 0 &&
+               strcmp(target, "/mouse/batch") == 0) {
+        metrics_counter_inc(&endpoints[ENDPOINT_BATCH].requests);
+        handle_batch(fd, query, body, body_len);
+    } else if (strcmp(method, "POST") == 0 &&
+               strcmp(target, "/keyboard/type") == 0) {
+        metrics_counter_inc(&endpoints[ENDPOINT_KEYBOARD].requests);
+        handle_keyboard(fd, query, body, body_len);
+    } else if (strcmp(method, "GET") == 0 && strcmp(target, "/metrics") == 0) {
+        metrics_counter_inc(&endpoints[ENDPOINT_METRICS].requests);
+        handle_metrics(fd);
+    } else if (strcmp(method, "GET") == 0 && strcmp(target, "/trace") == 0) {
+        metrics_counter_inc(&endpoints[ENDPOINT_TRACE].requests);
+        handle_trace(fd, query);
+    } else {
+        respond_text(fd, "404 Not Found", "Nothing matches the given URI");
+    }
+}
+
+static size_t content_length(const char *headers) {
+    for (const char *line = strstr(headers, "\r\n"); line != NULL;
+         line = strstr(line + 2, "\r\n")) {
+        if (strncasecmp(line + 2, "Content-Length:", 15) == 0) {
+            return strtoul(line + 2 + 15, NULL, 10);
+        }
+    }
+    return 0;
+}
+
+/**
+ * Handle every complete request in the client's buffer. Returns false when
+ * the connection has to be closed.
+ */
+static bool serve_requests(client_t *client) {
+    while (1) {
+        client->buf[client->used] = '\0';
+        char *end = strstr(client->buf, "\r\n\r\n");
+        if (end == NULL) {
+            // The device closes on headers its buffer can't take as well.
+            return client->used < sizeof client->buf - 1;
+        }
+        size_t head_len = end + 4 - client->buf;
+        size_t body_len = content_length(client->buf);
+        if (head_len + body_len > sizeof client->buf - 1) {
+            return false;
+        }
+        if (client->used < head_len + body_len) {
+            return true;
+        }
+
+        char method[8];
+        char target[512];
+        if (sscanf(client->buf, "%7s %511s", method, target) != 2) {
+            return false;
+        }
+        route(client->fd, method, target, client->buf + head_len, body_len);
+
+        size_t consumed = head_len + body_len;
+        memmove(client->buf, client->buf + consumed, client->used - consumed);
+        client->used -= consumed;
+    }
+}
+
+static int listen_tcp(uint16_t port) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+    struct sockaddr_in addr = {.sin_family = AF_INET,
+                               .sin_port = htons(port),
+                               .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    if (bind(sock, (struct sockaddr *)&addr, sizeof addr) < 0 ||
+        listen(sock, MAX_CLIENTS) < 0) {
+        perror("http socket");
+        exit(1);
+    }
+    return sock;
+}
+
+static void udp_task(void *arg) {
+    uint16_t port = *(uint16_t *)arg;
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr = {.sin_family = AF_INET,
+                               .sin_port = htons(port),
+                               .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    if (bind(sock, (struct sockaddr *)&addr, sizeof addr) < 0) {
+        perror("udp socket");
+        exit(1);
+    }
+    mouse_input_lane_t *lane =
+        mouse_input_register_lane("udp", MOUSE_RING_DROP_OLDEST);
+    udp_listener_serve(sock, lane, &udp_state);
+}
+
+static void serve_http(int listener) {
+    struct pollfd fds[MAX_CLIENTS + 1];
+    static client_t clients[MAX_CLIENTS];
+
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        clients[i].fd = -1;
+    }
+    while (1) {
+        fds[0] = (struct pollfd){.fd = listener, .events = POLLIN};
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            fds[i + 1] = (struct pollfd){.fd = clients[i].fd, .events = POLLIN};
+        }
+        if (poll(fds, MAX_CLIENTS + 1, -1) < 0) {
+            continue;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int fd = accept(listener, NULL, NULL);
+            int slot = -1;
+            for (int i = 0; i < MAX_CLIENTS && slot < 0; i++) {
+                slot = clients[i].fd < 0 ? i : -1;
+            }
+            if (fd >= 0 && slot < 0) {
+                close(fd);
+            } else if (fd >= 0) {
+                clients[slot].fd = fd;
+                clients[slot].used = 0;
+            }
+        }
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            client_t *client = &clients[i];
+            if (client->fd < 0 || fds[i + 1].revents == 0) {
+                continue;
+            }
+            ssize_t len = recv(client->fd, client->buf + client->used,
+                               sizeof client->buf - 1 - client->used, 0);
+            if (len > 0) {
+                client->used += len;
+            }
+            if (len <= 0 || !serve_requests(client)) {
+                close(client->fd);
+                client->fd = -1;
+            }
+        }
+    }
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "usage: %s [-p http port] [-u udp port] [-c connections]\n"
+            "       [-i interval in 1.25 ms] [-n packets per event] [-I]\n",
+            name);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    uint16_t http_port = 8080;
+    uint16_t udp_port = 3333;
+    fake_link_t link = {.conn_itvl = 6, .packets_per_event = 4};
+    int opt;
+
+    connections = 1;
+    while ((opt = getopt(argc, argv, "p:u:c:i:n:I")) != -1) {
+        switch (opt) {
+        case 'p':
+            http_port = atoi(optarg);
+            break;
+        case 'u':
+            udp_port = atoi(optarg);
+            break;
+        case 'c':
+            connections = atoi(optarg);
+            break;
+        case 'i':
+            link.conn_itvl = atoi(optarg);
+            break;
+        case 'n':
+            link.packets_per_event = atoi(optarg);
+            break;
+        case 'I':
+            link.indicate = true;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (connections < 1 || connections > HID_MAX_CONNECTIONS ||
+        link.conn_itvl < 6 || link.packets_per_event < 1) {
+        usage(argv[0]);
+    }
+
+    fake_nimble_start(&control);
+    mouse_input_init();
+    keyboard_input_init();
+    // Scripted motion is summed rather than lost, as on the device.
+    http_lane = mouse_input_register_lane("http", MOUSE_RING_MERGE_TAIL);
+    start_hid_dispatcher(&control);
+    for (int i = 0; i < connections; i++) {
+        fake_nimble_connect(i, &link);
+    }
+    xTaskCreate(&udp_task, "udp_listener", 4096, &udp_port, 5, NULL);
+
+    int listener = listen_tcp(http_port);
+    printf("Serving http://127.0.0.1:%u and udp 127.0.0.1:%u\n", http_port,
+           udp_port);
+    fflush(stdout);
+    serve_http(listener);
+    return 0;
+}
@@ -0,0 +1,23 @@
+#include "esp_timer.h"
+#include <pthread.h>
+#include <time.h>
+
+static pthread_once_t boot_once = PTHREAD_ONCE_INIT;
+static int64_t boot_us;
+
+static int64_t monotonic_us(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static void boot(void) {
+    // Like on the device, time starts near zero but never at it, so a
+    // received_us of 0 still reads as unknown.
+    boot_us = monotonic_us() - 1;
+}
+
+int64_t esp_timer_get_time(void) {
+    pthread_once(&boot_once, boot);
+    return monotonic_us() - boot_us;
+}
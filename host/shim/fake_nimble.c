@@ -0,0 +1,304 @@
+#include "fake_nimble.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+#include "hid_service.h"
+#include "host/ble_hs.h"
+#include "keyboard_layout.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Longest the link task sleeps while no connection event is due.
+#define IDLE_WAIT_US 10000
+
+typedef struct {
+    uint8_t data[HID_REPORT_MAX_LEN];
+    uint8_t len;
+    bool indication;
+} queued_report_t;
+
+typedef struct {
+    bool connected;
+    uint16_t conn_handle;
+    fake_link_t link;
+    int64_t next_event_us;
+    queued_report_t queue[FAKE_NIMBLE_QUEUE_LEN];
+    uint8_t head;
+    uint8_t count;
+    // An indication went out and waits for the host's confirmation.
+    bool awaiting_confirm;
+    fake_host_stats_t host;
+} fake_conn_t;
+
+static hid_control_t *hid_control = NULL;
+static fake_conn_t conns[HID_MAX_CONNECTIONS];
+// Guards conns against the dispatcher sending while the link task runs an
+// event.
+static pthread_mutex_t conns_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+uint16_t ble_uuid_u16(const ble_uuid_t *uuid) { return 0; }
+
+int os_mbuf_append(struct os_mbuf *om, const void *data, uint16_t len) {
+    return BLE_HS_ENOMEM;
+}
+
+int os_mbuf_copydata(const struct os_mbuf *om, int off, int len, void *dst) {
+    if (off + len > om->om_len) {
+        return -1;
+    }
+    memcpy(dst, om->om_data + off, len);
+    return 0;
+}
+
+struct os_mbuf *ble_hs_mbuf_from_flat(const void *buf, uint16_t len) {
+    struct os_mbuf *om = malloc(sizeof *om + len);
+    if (om == NULL) {
+        return NULL;
+    }
+    om->om_data = (uint8_t *)(om + 1);
+    om->om_len = len;
+    memcpy(om->om_data, buf, len);
+    return om;
+}
+
+static fake_conn_t *find_conn(uint16_t conn_handle) {
+    for (int i = 0; i < HID_MAX_CONNECTIONS; i++) {
+        if (conns[i].connected && conns[i].conn_handle == conn_handle) {
+            return &conns[i];
+        }
+    }
+    return NULL;
+}
+
+static int enqueue(uint16_t conn_handle, struct os_mbuf *om,
+                   bool indication) {
+    int rc = 0;
+
+    pthread_mutex_lock(&conns_mutex);
+    fake_conn_t *conn = find_conn(conn_handle);
+    if (conn == NULL) {
+        rc = BLE_HS_ENOTCONN;
+    } else if (conn->count == FAKE_NIMBLE_QUEUE_LEN ||
+               om->om_len > HID_REPORT_MAX_LEN) {
+        conn->host.refused++;
+        rc = BLE_HS_ENOMEM;
+    } else {
+        queued_report_t *report =
+            &conn->queue[(conn->head + conn->count) % FAKE_NIMBLE_QUEUE_LEN];
+        memcpy(report->data, om->om_data, om->om_len);
+        report->len = om->om_len;
+        report->indication = indication;
+        conn->count++;
+    }
+    pthread_mutex_unlock(&conns_mutex);
+    // NimBLE consumes the mbuf whether it queues the report or not.
+    free(om);
+    // Like NimBLE, raise NOTIFY_TX from within the call, before the report
+    // has gone anywhere, with the call's own rc if it failed.
+    hid_conn_t *hid_conn = hid_control_find_conn(hid_control, conn_handle);
+    if (hid_conn != NULL) {
+        hid_report_tx_done(hid_control, hid_conn, rc, indication);
+    }
+    return rc;
+}
+
+int ble_gattc_notify_custom(uint16_t conn_handle, uint16_t chr_val_handle,
+                            struct os_mbuf *om) {
+    return enqueue(conn_handle, om, false);
+}
+
+int ble_gattc_indicate_custom(uint16_t conn_handle, uint16_t chr_val_handle,
+                              struct os_mbuf *om) {
+    return enqueue(conn_handle, om, true);
+}
+
+#ifdef CONFIG_BLE_HID_HIGH_RES_REPORT
+static int16_t read_le16(const uint8_t *data) {
+    return (int16_t)(data[0] | data[1] << 8);
+}
+#endif
+
+static bool holds_key(const uint8_t keys[HID_KEYBOARD_KEYS], uint8_t usage) {
+    for (int i = 0; i < HID_KEYBOARD_KEYS; i++) {
+        if (keys[i] == usage) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Character a US layout host types for usage with modifiers, found by
+ * asking keyboard_layout.c the other way round. '?' when none.
+ */
+static char key_char(uint8_t usage, uint8_t modifiers) {
+    // One entry per usage, unshifted and shifted.
+    static char chars[KEYBOARD_USAGE_MAX + 1][2];
+    static bool built = false;
+
+    if (!built) {
+        for (uint32_t c = 0; c < 0x80; c++) {
+            uint8_t u, m;
+            // Enter reads back as '\n'.
+            if (c != '\r' && keyboard_layout_stroke(c, &u, &m) &&
+                u <= KEYBOARD_USAGE_MAX) {
+                chars[u][m & KEYBOARD_MOD_LEFT_SHIFT ? 1 : 0] = c;
+            }
+        }
+        built = true;
+    }
+    char c = '\0';
+    if (usage <= KEYBOARD_USAGE_MAX) {
+        c = chars[usage][modifiers & KEYBOARD_MOD_LEFT_SHIFT ? 1 : 0];
+    }
+    return c != '\0' ? c : '?';
+}
+
+/**
+ * Type the keys report presses that were not down before, in report order
+ * and with the report's modifiers, as the host's keyboard driver does.
+ */
+static void receive_keys(fake_host_stats_t *host,
+                         const queued_report_t *report) {
+    const uint8_t *keys = &report->data[2];
+    host->key_reports++;
+    for (int i = 0; i < HID_KEYBOARD_KEYS; i++) {
+        if (keys[i] == 0 || holds_key(host->keys, keys[i])) {
+            continue;
+        }
+        if (host->typed < FAKE_HOST_TEXT_LEN) {
+            host->text[host->typed] = key_char(keys[i], report->data[0]);
+        }
+        host->typed++;
+        host->typed_us = esp_timer_get_time();
+    }
+    host->modifiers = report->data[0];
+    memcpy(host->keys, keys, HID_KEYBOARD_KEYS);
+}
+
+/**
+ * Add what the host would make of report to its totals.
+ */
+static void receive(fake_host_stats_t *host, const queued_report_t *report) {
+    if (report->len == HID_KEYBOARD_REPORT_LEN) {
+        receive_keys(host, report);
+        return;
+    }
+    uint8_t pressed = report->data[0] & ~host->buttons;
+    for (; pressed != 0; pressed &= pressed - 1) {
+        host->presses++;
+    }
+    host->buttons = report->data[0];
+    if (report->len == HID_ABS_REPORT_LEN) {
+        host->abs_reports++;
+        return;
+    }
+    host->reports++;
+#ifdef CONFIG_BLE_HID_HIGH_RES_REPORT
+    host->x += read_le16(&report->data[1]);
+    host->y += read_le16(&report->data[3]);
+    host->wheel += read_le16(&report->data[5]);
+#else
+    host->x += (int8_t)report->data[1];
+    host->y += (int8_t)report->data[2];
+    host->wheel += (int8_t)report->data[3];
+#endif
+}
+
+/**
+ * Run one connection event of conn. Returns whether an indication was
+ * confirmed, the only NOTIFY_TX that comes later than the send.
+ */
+static bool run_event(fake_conn_t *conn) {
+    bool confirmed = conn->awaiting_confirm;
+
+    conn->awaiting_confirm = false;
+    for (int sent = 0; sent < conn->link.packets_per_event && conn->count > 0;
+         sent++) {
+        queued_report_t *report = &conn->queue[conn->head];
+        conn->head = (conn->head + 1) % FAKE_NIMBLE_QUEUE_LEN;
+        conn->count--;
+        receive(&conn->host, report);
+        if (report->indication) {
+            // ATT allows one unconfirmed indication at a time.
+            conn->awaiting_confirm = true;
+            break;
+        }
+    }
+    return confirmed;
+}
+
+static void link_task(void *arg) {
+    while (1) {
+        int64_t now_us = esp_timer_get_time();
+        int64_t next_us = now_us + IDLE_WAIT_US;
+
+        for (int i = 0; i < HID_MAX_CONNECTIONS; i++) {
+            fake_conn_t *conn = &conns[i];
+            bool confirmed = false;
+
+            pthread_mutex_lock(&conns_mutex);
+            if (conn->connected && now_us >= conn->next_event_us) {
+                confirmed = run_event(conn);
+                int64_t interval_us = conn->link.conn_itvl * 1250;
+                conn->next_event_us += interval_us;
+                if (conn->next_event_us <= now_us) {
+                    // Fell behind; the radio does not make up for it.
+                    conn->next_event_us = now_us + interval_us;
+                }
+            }
+            if (conn->connected && conn->next_event_us < next_us) {
+                next_us = conn->next_event_us;
+            }
+            pthread_mutex_unlock(&conns_mutex);
+
+            if (confirmed) {
+                hid_report_tx_done(hid_control, &hid_control->conns[i],
+                                   BLE_HS_EDONE, true);
+            }
+        }
+
+        int64_t wait_us = next_us - esp_timer_get_time();
+        if (wait_us > 0) {
+            usleep(wait_us);
+        }
+    }
+}
+
+void fake_nimble_start(hid_control_t *control) {
+    hid_control = control;
+    init_hid_control(control);
+    xTaskCreate(&link_task, "fake_nimble", 4096, NULL, 5, NULL);
+}
+
+void fake_nimble_connect(int index, const fake_link_t *link) {
+    fake_conn_t *conn = &conns[index];
+    hid_conn_t *hid_conn = &hid_control->conns[index];
+
+    pthread_mutex_lock(&conns_mutex);
+    memset(conn, 0, sizeof *conn);
+    conn->connected = true;
+    conn->conn_handle = index + 1;
+    conn->link = *link;
+    if (conn->link.packets_per_event > FAKE_NIMBLE_QUEUE_LEN) {
+        conn->link.packets_per_event = FAKE_NIMBLE_QUEUE_LEN;
+    }
+    conn->next_event_us = esp_timer_get_time();
+    pthread_mutex_unlock(&conns_mutex);
+
+    // Until subscribed below, the dispatcher leaves the entry alone.
+    hid_report_init_conn(hid_conn, conn->conn_handle);
+    hid_conn->conn_itvl = link->conn_itvl;
+    hid_conn->supervision_timeout = 400;
+    hid_conn->is_notifiable = !link->indicate;
+    hid_conn->is_indicatable = link->indicate;
+    hid_conn->abs_is_notifiable = !link->indicate;
+    hid_conn->abs_is_indicatable = link->indicate;
+    hid_conn->key_is_notifiable = !link->indicate;
+    hid_conn->key_is_indicatable = link->indicate;
+}
+
+const fake_host_stats_t *fake_nimble_get_host_stats(int index) {
+    return &conns[index].host;
+}
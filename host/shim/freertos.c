@@ -0,0 +1,220 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+
+struct host_semaphore {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    unsigned int count;
+    unsigned int max;
+    struct host_queue_set *set;
+};
+
+// Like FreeRTOS, a set queues the handle of a member on every successful
+// give, and select hands them out in that order.
+struct host_queue_set {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    struct host_semaphore **ready;
+    UBaseType_t length;
+    UBaseType_t head;
+    UBaseType_t count;
+};
+
+typedef struct {
+    TaskFunction_t task;
+    void *arg;
+} task_start_t;
+
+void portENTER_CRITICAL(portMUX_TYPE *mux) { pthread_mutex_lock(&mux->mutex); }
+
+void portEXIT_CRITICAL(portMUX_TYPE *mux) { pthread_mutex_unlock(&mux->mutex); }
+
+/**
+ * Absolute CLOCK_MONOTONIC time ticks from now, for the timed waits.
+ */
+static struct timespec deadline_after(TickType_t ticks) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += ticks / 1000;
+    deadline.tv_nsec += (long)(ticks % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    return deadline;
+}
+
+static void init_cond(pthread_cond_t *cond) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+/**
+ * Wait on cond until ready() or the ticks run out. mutex is held.
+ */
+static bool wait_until(pthread_cond_t *cond, pthread_mutex_t *mutex,
+                       TickType_t ticks, bool (*ready)(void *), void *arg) {
+    if (ticks == portMAX_DELAY) {
+        while (!ready(arg)) {
+            pthread_cond_wait(cond, mutex);
+        }
+        return true;
+    }
+    struct timespec deadline = deadline_after(ticks);
+    while (!ready(arg)) {
+        if (pthread_cond_timedwait(cond, mutex, &deadline) == ETIMEDOUT) {
+            return ready(arg);
+        }
+    }
+    return true;
+}
+
+static SemaphoreHandle_t create_semaphore(unsigned int count,
+                                          unsigned int max) {
+    struct host_semaphore *semaphore = calloc(1, sizeof *semaphore);
+    pthread_mutex_init(&semaphore->mutex, NULL);
+    init_cond(&semaphore->cond);
+    semaphore->count = count;
+    semaphore->max = max;
+    return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+    return create_semaphore(0, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    return create_semaphore(1, 1);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    pthread_mutex_lock(&semaphore->mutex);
+    bool given = semaphore->count < semaphore->max;
+    if (given) {
+        semaphore->count++;
+        pthread_cond_signal(&semaphore->cond);
+    }
+    struct host_queue_set *set = semaphore->set;
+    pthread_mutex_unlock(&semaphore->mutex);
+
+    if (given && set != NULL) {
+        pthread_mutex_lock(&set->mutex);
+        // Sized for every member being full, so there is always room.
+        set->ready[(set->head + set->count) % set->length] = semaphore;
+        set->count++;
+        pthread_cond_signal(&set->cond);
+        pthread_mutex_unlock(&set->mutex);
+    }
+    return given ? pdTRUE : pdFALSE;
+}
+
+static bool semaphore_ready(void *arg) {
+    return ((struct host_semaphore *)arg)->count > 0;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks) {
+    pthread_mutex_lock(&semaphore->mutex);
+    bool taken = wait_until(&semaphore->cond, &semaphore->mutex, ticks,
+                            semaphore_ready, semaphore);
+    if (taken) {
+        semaphore->count--;
+    }
+    pthread_mutex_unlock(&semaphore->mutex);
+    return taken ? pdTRUE : pdFALSE;
+}
+
+QueueSetHandle_t xQueueCreateSet(UBaseType_t length) {
+    struct host_queue_set *set = calloc(1, sizeof *set);
+    pthread_mutex_init(&set->mutex, NULL);
+    init_cond(&set->cond);
+    set->ready = calloc(length, sizeof *set->ready);
+    set->length = length;
+    return set;
+}
+
+BaseType_t xQueueAddToSet(QueueSetMemberHandle_t member,
+                          QueueSetHandle_t set) {
+    pthread_mutex_lock(&member->mutex);
+    // FreeRTOS refuses members that already hold something.
+    bool added = member->set == NULL && member->count == 0;
+    if (added) {
+        member->set = set;
+    }
+    pthread_mutex_unlock(&member->mutex);
+    return added ? pdPASS : pdFALSE;
+}
+
+static bool set_ready(void *arg) {
+    return ((struct host_queue_set *)arg)->count > 0;
+}
+
+QueueSetMemberHandle_t xQueueSelectFromSet(QueueSetHandle_t set,
+                                           TickType_t ticks) {
+    QueueSetMemberHandle_t member = NULL;
+    pthread_mutex_lock(&set->mutex);
+    if (wait_until(&set->cond, &set->mutex, ticks, set_ready, set)) {
+        member = set->ready[set->head];
+        set->head = (set->head + 1) % set->length;
+        set->count--;
+    }
+    pthread_mutex_unlock(&set->mutex);
+    return member;
+}
+
+static void *run_task(void *arg) {
+    task_start_t start = *(task_start_t *)arg;
+    free(arg);
+    start.task(start.arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char *name,
+                                   uint32_t stack_depth, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *handle,
+                                   BaseType_t core) {
+    pthread_t thread;
+    task_start_t *start = malloc(sizeof *start);
+    start->task = task;
+    start->arg = arg;
+    if (pthread_create(&thread, NULL, run_task, start) != 0) {
+        free(start);
+        return pdFALSE;
+    }
+    pthread_detach(thread);
+    if (handle != NULL) {
+        *handle = NULL;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t task, const char *name,
+                       uint32_t stack_depth, void *arg, UBaseType_t priority,
+                       TaskHandle_t *handle) {
+    return xTaskCreatePinnedToCore(task, name, stack_depth, arg, priority,
+                                   handle, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (task == NULL) {
+        pthread_exit(NULL);
+    }
+}
+
+void vTaskDelay(TickType_t ticks) {
+    struct timespec delay = {.tv_sec = ticks / 1000,
+                             .tv_nsec = (long)(ticks % 1000) * 1000000};
+    while (nanosleep(&delay, &delay) != 0 && errno == EINTR) {
+    }
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return (TickType_t)(esp_timer_get_time() / 1000);
+}
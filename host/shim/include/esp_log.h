@@ -0,0 +1,25 @@
+#ifndef HOST_ESP_LOG_H
+#define HOST_ESP_LOG_H
+
+#include <stdio.h>
+
+// Debug and info logs sit on the paths being measured, so only warnings and
+// errors are printed.
+#define ESP_LOGD(tag, format, ...)                                             \
+    do {                                                                       \
+        if (0) {                                                               \
+            fprintf(stderr, "D %s: " format "\n", tag, ##__VA_ARGS__);         \
+        }                                                                      \
+    } while (0)
+#define ESP_LOGI(tag, format, ...)                                             \
+    do {                                                                       \
+        if (0) {                                                               \
+            fprintf(stderr, "I %s: " format "\n", tag, ##__VA_ARGS__);         \
+        }                                                                      \
+    } while (0)
+#define ESP_LOGW(tag, format, ...)                                             \
+    fprintf(stderr, "W %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGE(tag, format, ...)                                             \
+    fprintf(stderr, "E %s: " format "\n", tag, ##__VA_ARGS__)
+
+#endif // HOST_ESP_LOG_H
@@ -0,0 +1,72 @@
+#ifndef FAKE_NIMBLE_H
+#define FAKE_NIMBLE_H
+
+#include "ble_hid_component.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Reports NimBLE buffers per connection before refusing with BLE_HS_ENOMEM.
+#define FAKE_NIMBLE_QUEUE_LEN 12
+
+// Characters the simulated host keeps of what it was typed.
+#define FAKE_HOST_TEXT_LEN 65536
+
+/**
+ * How the simulated host and radio treat one connection.
+ */
+typedef struct {
+    // Connection interval in 1.25 ms units, as granted.
+    uint16_t conn_itvl;
+    // Notifications the link carries per connection event.
+    uint8_t packets_per_event;
+    // Subscribe to indications instead of notifications. Each one is
+    // confirmed at the connection event after it went out.
+    bool indicate;
+} fake_link_t;
+
+/**
+ * What the simulated host received on one connection.
+ */
+typedef struct {
+    uint32_t reports;
+    uint32_t abs_reports;
+    // Sum of the relative reports, in report units.
+    int64_t x;
+    int64_t y;
+    int64_t wheel;
+    // Buttons held as of the last report, and button presses seen.
+    uint8_t buttons;
+    uint32_t presses;
+    uint32_t key_reports;
+    // Keys held as of the last keyboard report.
+    uint8_t modifiers;
+    uint8_t keys[HID_KEYBOARD_KEYS];
+    // Characters typed, as a US layout host reads the key presses. text
+    // keeps the first FAKE_HOST_TEXT_LEN of them; presses of keys without
+    // a character count in typed as '?'.
+    uint32_t typed;
+    char text[FAKE_HOST_TEXT_LEN];
+    // When the last character was typed.
+    int64_t typed_us;
+    // Reports refused because the queue was full.
+    uint32_t refused;
+} fake_host_stats_t;
+
+/**
+ * Start the thread standing in for the NimBLE host task. It runs the
+ * connection events. Like NimBLE, ble_gattc_notify_custom and
+ * ble_gattc_indicate_custom call hid_report_tx_done from within, with 0 or
+ * the failure rc, and the thread calls it again only to confirm an
+ * indication.
+ */
+void fake_nimble_start(hid_control_t *control);
+
+/**
+ * Connect and subscribe a host on hid_control_t.conns[index], as
+ * gap_handler does on CONNECT and SUBSCRIBE.
+ */
+void fake_nimble_connect(int index, const fake_link_t *link);
+
+const fake_host_stats_t *fake_nimble_get_host_stats(int index);
+
+#endif // FAKE_NIMBLE_H
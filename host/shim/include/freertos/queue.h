@@ -0,0 +1,21 @@
+#ifndef HOST_QUEUE_H
+#define HOST_QUEUE_H
+
+#include "freertos/FreeRTOS.h"
+
+// Only semaphores are ever put in a queue set here.
+typedef struct host_semaphore *QueueHandle_t;
+typedef struct host_queue_set *QueueSetHandle_t;
+typedef QueueHandle_t QueueSetMemberHandle_t;
+
+QueueSetHandle_t xQueueCreateSet(UBaseType_t length);
+
+BaseType_t xQueueAddToSet(QueueSetMemberHandle_t member, QueueSetHandle_t set);
+
+/**
+ * Returns a member that can be taken without blocking, or NULL on timeout.
+ */
+QueueSetMemberHandle_t xQueueSelectFromSet(QueueSetHandle_t set,
+                                           TickType_t ticks);
+
+#endif // HOST_QUEUE_H
@@ -0,0 +1,9 @@
+#ifndef HOST_BLE_ATT_H
+#define HOST_BLE_ATT_H
+
+#define BLE_ATT_ERR_INVAL_ATTR_VALUE_LEN 0x0d
+#define BLE_ATT_ERR_UNLIKELY 0x0e
+#define BLE_ATT_ERR_REQ_NOT_SUPPORTED 0x06
+#define BLE_ATT_ERR_INSUFFICIENT_RES 0x11
+
+#endif // HOST_BLE_ATT_H
@@ -0,0 +1,41 @@
+#ifndef HOST_BLE_GATT_H
+#define HOST_BLE_GATT_H
+
+#include <stdint.h>
+
+// Just enough of the GATT types for the access callbacks in hid_service.c to
+// compile. The simulation never calls them.
+
+typedef struct {
+    uint8_t type;
+} ble_uuid_t;
+
+struct os_mbuf {
+    uint8_t *om_data;
+    uint16_t om_len;
+};
+
+#define OS_MBUF_PKTLEN(om) ((om)->om_len)
+
+struct ble_gatt_chr_def {
+    const ble_uuid_t *uuid;
+};
+
+#define BLE_GATT_ACCESS_OP_READ_CHR 0
+#define BLE_GATT_ACCESS_OP_WRITE_CHR 1
+
+struct ble_gatt_access_ctxt {
+    uint8_t op;
+    struct os_mbuf *om;
+    const struct ble_gatt_chr_def *chr;
+};
+
+struct ble_gatt_register_ctxt;
+
+uint16_t ble_uuid_u16(const ble_uuid_t *uuid);
+
+int os_mbuf_append(struct os_mbuf *om, const void *data, uint16_t len);
+
+int os_mbuf_copydata(const struct os_mbuf *om, int off, int len, void *dst);
+
+#endif // HOST_BLE_GATT_H
@@ -0,0 +1,22 @@
+#ifndef HOST_BLE_HS_H
+#define HOST_BLE_HS_H
+
+#include "host/ble_att.h"
+#include "host/ble_gatt.h"
+#include <assert.h>
+#include <stdint.h>
+
+#define BLE_HS_ENOMEM 6
+#define BLE_HS_ENOTCONN 7
+#define BLE_HS_EDONE 14
+#define BLE_HS_EBUSY 15
+
+struct os_mbuf *ble_hs_mbuf_from_flat(const void *buf, uint16_t len);
+
+int ble_gattc_notify_custom(uint16_t conn_handle, uint16_t chr_val_handle,
+                            struct os_mbuf *om);
+
+int ble_gattc_indicate_custom(uint16_t conn_handle, uint16_t chr_val_handle,
+                              struct os_mbuf *om);
+
+#endif // HOST_BLE_HS_H
@@ -0,0 +1,7 @@
+#ifndef HOST_NIMBLE_BLE_H
+#define HOST_NIMBLE_BLE_H
+
+#include "sdkconfig.h"
+#include <stdint.h>
+
+#endif // HOST_NIMBLE_BLE_H
@@ -0,0 +1,17 @@
+#ifndef HOST_SDKCONFIG_H
+#define HOST_SDKCONFIG_H
+
+// Defaults of sdkconfig.example and main/Kconfig.projbuild.
+// CONFIG_BLE_HID_HIGH_RES_REPORT comes from the CMake option of that name.
+
+#define CONFIG_BT_NIMBLE_MAX_CONNECTIONS 3
+#define CONFIG_BLE_HID_MAX_IN_FLIGHT 4
+#define CONFIG_BLE_HID_CLICK_HOLD_MS 50
+#define CONFIG_BLE_HID_DOUBLE_CLICK_GAP_MS 80
+#define CONFIG_HID_DISPATCHER_PRIORITY 6
+#define CONFIG_HID_DISPATCHER_CORE -1
+// Debug rather than the default, so sim_server's /trace shows the pipeline.
+#define CONFIG_TRACE_LEVEL 2
+#define CONFIG_TRACE_RING_LEN 256
+
+#endif // HOST_SDKCONFIG_H
@@ -0,0 +1,424 @@
+#include "device_metrics.h"
+#include "boot.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "hid_dispatcher.h"
+#include "hid_latency.h"
+#include "keyboard_input.h"
+#include "macro.h"
+#include "metrics.h"
+#include "mouse_input.h"
+#include "mouse_scheduler.h"
+#include "reconnect.h"
+#include "trajectory.h"
+#include "udp_listener.h"
+#include "webserver.h"
+#include <esp_wifi.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Every value is written by its own task and read here without a lock. Each
+// is a single aligned word, so a scrape sees either the old or the new value.
+
+static hid_control_t *hid_control = NULL;
+
+typedef struct {
+    const char *name;
+    const char *type;
+    const char *help;
+    size_t offset;
+} stat_family_t;
+
+static uint32_t stat_at(const void *stats, size_t offset) {
+    return *(const uint32_t *)((const uint8_t *)stats + offset);
+}
+
+static const stat_family_t lane_families[] = {
+    {"mouse_input_pushed_total", "counter", "Events queued on the lane.",
+     offsetof(mouse_ring_stats_t, pushed)},
+    {"mouse_input_taken_total", "counter",
+     "Events the dispatcher took from the lane.",
+     offsetof(mouse_ring_stats_t, popped)},
+    {"mouse_input_dropped_newest_total", "counter",
+     "Events refused because the lane was full.",
+     offsetof(mouse_ring_stats_t, dropped_newest)},
+    {"mouse_input_dropped_oldest_total", "counter",
+     "Queued events lost to make room for a new one.",
+     offsetof(mouse_ring_stats_t, dropped_oldest)},
+    {"mouse_input_merged_total", "counter",
+     "Events summed into the newest queued event.",
+     offsetof(mouse_ring_stats_t, merged)},
+    {"mouse_input_high_watermark", "gauge", "Most events queued at once.",
+     offsetof(mouse_ring_stats_t, high_watermark)},
+};
+
+static const stat_family_t delivery_families[] = {
+    {"hid_reports_sent_total", "counter", "Reports handed to NimBLE.",
+     offsetof(hid_delivery_stats_t, sent)},
+    {"hid_reports_completed_total", "counter",
+     "Reports the link finished with.",
+     offsetof(hid_delivery_stats_t, completed)},
+    {"hid_send_stalls_total", "counter",
+     "Send attempts while every credit was in use.",
+     offsetof(hid_delivery_stats_t, stalls)},
+    {"hid_reports_dropped_total", "counter",
+     "Reports NimBLE refused to queue.",
+     offsetof(hid_delivery_stats_t, dropped)},
+    {"hid_tx_errors_total", "counter",
+     "Queued reports that failed or were never confirmed.",
+     offsetof(hid_delivery_stats_t, tx_errors)},
+};
+
+static void write_lanes(metrics_writer_t *writer) {
+    char labels[32];
+
+    metrics_family(writer, "mouse_input_queue_depth", "gauge",
+                   "Events waiting on the lane.");
+    for (size_t i = 0; i < mouse_input_lane_count(); i++) {
+        mouse_input_lane_t *lane = mouse_input_get_lane(i);
+        snprintf(labels, sizeof labels, "lane=\"%s\"", lane->name);
+        metrics_sample(writer, "mouse_input_queue_depth", labels,
+                       mouse_ring_occupancy(&lane->ring));
+    }
+    for (size_t f = 0; f < sizeof lane_families / sizeof *lane_families;
+         f++) {
+        const stat_family_t *family = &lane_families[f];
+        metrics_family(writer, family->name, family->type, family->help);
+        for (size_t i = 0; i < mouse_input_lane_count(); i++) {
+            mouse_input_lane_t *lane = mouse_input_get_lane(i);
+            snprintf(labels, sizeof labels, "lane=\"%s\"", lane->name);
+            metrics_sample(writer, family->name, labels,
+                           stat_at(&lane->ring.stats, family->offset));
+        }
+    }
+}
+
+static void write_scheduler(metrics_writer_t *writer) {
+    const mouse_scheduler_stats_t *stats = mouse_scheduler_get_stats();
+
+    metrics_single(writer, "mouse_scheduler_pending", "gauge",
+                   "Events waiting for their time.",
+                   mouse_scheduler_pending());
+    metrics_single(writer, "mouse_scheduler_scheduled_total", "counter",
+                   "Events accepted with a time.", stats->scheduled);
+    metrics_single(writer, "mouse_scheduler_rejected_total", "counter",
+                   "Events refused because the schedule was full.",
+                   stats->rejected);
+    metrics_single(writer, "mouse_scheduler_late_total", "counter",
+                   "Events whose time had passed when submitted.",
+                   stats->late);
+    metrics_single(writer, "mouse_scheduler_lateness_max_us", "gauge",
+                   "Furthest past its time an event was released.",
+                   stats->lateness_max_us);
+}
+
+static void write_dispatcher(metrics_writer_t *writer) {
+    const hid_dispatcher_stats_t *stats = hid_dispatcher_get_stats();
+
+    metrics_family(writer, "hid_dispatcher_wakes_total", "counter",
+                   "Wake ups of the dispatcher task, by reason.");
+    metrics_sample(writer, "hid_dispatcher_wakes_total", "reason=\"input\"",
+                   stats->wakes_input);
+    metrics_sample(writer, "hid_dispatcher_wakes_total", "reason=\"credit\"",
+                   stats->wakes_credit);
+    metrics_sample(writer, "hid_dispatcher_wakes_total", "reason=\"timer\"",
+                   stats->wakes_timer);
+    metrics_single(writer, "hid_dispatcher_dropped_no_target_total",
+                   "counter", "Events whose target host was not connected.",
+                   stats->dropped_no_target);
+    metrics_single(writer, "hid_dispatcher_keys_no_target_total", "counter",
+                   "Key strokes whose target host was not connected.",
+                   stats->keys_no_target);
+    metrics_single(writer, "hid_keyboard_reports_total", "counter",
+                   "Keyboard reports sent, over every host.",
+                   stats->key_reports);
+}
+
+static void write_conn_gauge(metrics_writer_t *writer, const char *name,
+                             const char *help,
+                             int (*value)(const hid_conn_t *conn)) {
+    char labels[16];
+
+    metrics_family(writer, name, "gauge", help);
+    for (int i = 0; i < HID_MAX_CONNECTIONS; i++) {
+        const hid_conn_t *conn = &hid_control->conns[i];
+        if (!conn->in_use) {
+            continue;
+        }
+        // Numbered like the target parameter of the mouse endpoints.
+        snprintf(labels, sizeof labels, "target=\"%d\"", i + 1);
+        metrics_sample(writer, name, labels, value(conn));
+    }
+}
+
+static int conn_interval_us(const hid_conn_t *conn) {
+    return conn->conn_itvl * 1250;
+}
+
+static int conn_latency(const hid_conn_t *conn) { return conn->conn_latency; }
+
+static int conn_supervision_timeout_ms(const hid_conn_t *conn) {
+    return conn->supervision_timeout * 10;
+}
+
+static int conn_in_flight(const hid_conn_t *conn) { return conn->in_flight; }
+
+static void write_subscriptions(metrics_writer_t *writer) {
+    char labels[64];
+    static const char *const modes[] = {"notify", "indicate"};
+
+    metrics_family(writer, "hid_subscribed", "gauge",
+                   "Whether the host subscribed to a report, by mode.");
+    for (int i = 0; i < HID_MAX_CONNECTIONS; i++) {
+        const hid_conn_t *conn = &hid_control->conns[i];
+        if (!conn->in_use) {
+            continue;
+        }
+        bool mouse[] = {conn->is_notifiable, conn->is_indicatable};
+        bool absolute[] = {conn->abs_is_notifiable, conn->abs_is_indicatable};
+        bool keyboard[] = {conn->key_is_notifiable, conn->key_is_indicatable};
+        for (int m = 0; m < 2; m++) {
+            snprintf(labels, sizeof labels,
+                     "target=\"%d\",report=\"mouse\",mode=\"%s\"", i + 1,
+                     modes[m]);
+            metrics_sample(writer, "hid_subscribed", labels, mouse[m]);
+            snprintf(labels, sizeof labels,
+                     "target=\"%d\",report=\"absolute\",mode=\"%s\"", i + 1,
+                     modes[m]);
+            metrics_sample(writer, "hid_subscribed", labels, absolute[m]);
+            snprintf(labels, sizeof labels,
+                     "target=\"%d\",report=\"keyboard\",mode=\"%s\"", i + 1,
+                     modes[m]);
+            metrics_sample(writer, "hid_subscribed", labels, keyboard[m]);
+        }
+    }
+}
+
+static void write_error_codes(metrics_writer_t *writer, const char *name,
+                              const char *help, size_t offset) {
+    char labels[32];
+
+    metrics_family(writer, name, "counter", help);
+    for (int i = 0; i < HID_MAX_CONNECTIONS; i++) {
+        const hid_conn_t *conn = &hid_control->conns[i];
+        if (!conn->in_use) {
+            continue;
+        }
+        const uint32_t *by_rc =
+            (const uint32_t *)((const uint8_t *)&conn->delivery + offset);
+        for (int rc = 0; rc <= HID_DELIVERY_RC_OTHER; rc++) {
+            // Only codes that occurred, the list is long.
+            if (by_rc[rc] == 0) {
+                continue;
+            }
+            if (rc == HID_DELIVERY_RC_OTHER) {
+                snprintf(labels, sizeof labels, "target=\"%d\",rc=\"other\"",
+                         i + 1);
+            } else {
+                snprintf(labels, sizeof labels, "target=\"%d\",rc=\"%d\"",
+                         i + 1, rc);
+            }
+            metrics_sample(writer, name, labels, by_rc[rc]);
+        }
+    }
+}
+
+static void write_connections(metrics_writer_t *writer) {
+    char labels[16];
+    int connected = 0;
+
+    for (int i = 0; i < HID_MAX_CONNECTIONS; i++) {
+        connected += hid_control->conns[i].in_use;
+    }
+    metrics_single(writer, "hid_connections", "gauge", "Connected hosts.",
+                   connected);
+    write_subscriptions(writer);
+    write_conn_gauge(writer, "hid_conn_interval_us",
+                     "Connection interval granted by the host.",
+                     conn_interval_us);
+    write_conn_gauge(writer, "hid_conn_latency",
+                     "Connection events the host may skip.", conn_latency);
+    write_conn_gauge(writer, "hid_conn_supervision_timeout_ms",
+                     "Supervision timeout granted by the host.",
+                     conn_supervision_timeout_ms);
+    write_conn_gauge(writer, "hid_reports_in_flight",
+                     "Reports holding a credit: notifications for a "
+                     "connection interval, indications until confirmed.",
+                     conn_in_flight);
+
+    for (size_t f = 0;
+         f < sizeof delivery_families / sizeof *delivery_families; f++) {
+        const stat_family_t *family = &delivery_families[f];
+        metrics_family(writer, family->name, family->type, family->help);
+        for (int i = 0; i < HID_MAX_CONNECTIONS; i++) {
+            const hid_conn_t *conn = &hid_control->conns[i];
+            if (!conn->in_use) {
+                continue;
+            }
+            snprintf(labels, sizeof labels, "target=\"%d\"", i + 1);
+            metrics_sample(writer, family->name, labels,
+                           stat_at(&conn->delivery, family->offset));
+        }
+    }
+    write_error_codes(writer, "hid_reports_dropped_by_rc_total",
+                      "Reports NimBLE refused to queue, by return code.",
+                      offsetof(hid_delivery_stats_t, dropped_by_rc));
+    write_error_codes(writer, "hid_tx_errors_by_rc_total",
+                      "Failed reports, by NOTIFY_TX status.",
+                      offsetof(hid_delivery_stats_t, tx_errors_by_rc));
+}
+
+static void write_latency(metrics_writer_t *writer) {
+    static const uint32_t quantiles[] = {500, 900, 990, 999};
+    char labels[48];
+
+    metrics_family(writer, "hid_latency_us", "summary",
+                   "Input latency by stage, since the last reset.");
+    for (int i = 0; i < HID_STAGE_COUNT; i++) {
+        const latency_histogram_t *hist = hid_latency_get(i);
+        const char *stage = hid_latency_stage_name(i);
+        for (size_t q = 0; q < sizeof quantiles / sizeof *quantiles; q++) {
+            snprintf(labels, sizeof labels,
+                     "stage=\"%s\",quantile=\"0.%u\"", stage,
+                     (unsigned)quantiles[q]);
+            metrics_sample(writer, "hid_latency_us", labels,
+                           latency_histogram_percentile(hist, quantiles[q]));
+        }
+        snprintf(labels, sizeof labels, "stage=\"%s\"", stage);
+        metrics_sample(writer, "hid_latency_us_sum", labels, hist->total_us);
+        metrics_sample(writer, "hid_latency_us_count", labels, hist->count);
+    }
+}
+
+static void write_reconnect(metrics_writer_t *writer) {
+    static const uint32_t quantiles[] = {500, 900, 990};
+    const reconnect_stats_t *reconnect = reconnect_get_stats();
+    const latency_histogram_t *hist = &reconnect->time_to_reconnect;
+    char labels[32];
+
+    metrics_family(writer, "ble_advertising_started_total", "counter",
+                   "Advertising started, by reconnect phase.");
+    for (int i = 0; i < RECONNECT_PHASE_COUNT; i++) {
+        snprintf(labels, sizeof labels, "phase=\"%s\"",
+                 reconnect_phase_name(i));
+        metrics_sample(writer, "ble_advertising_started_total", labels,
+                       reconnect->advertised[i]);
+    }
+    metrics_family(writer, "ble_connections_total", "counter",
+                   "Hosts connected, by the reconnect phase advertising.");
+    for (int i = 0; i < RECONNECT_PHASE_COUNT; i++) {
+        snprintf(labels, sizeof labels, "phase=\"%s\"",
+                 reconnect_phase_name(i));
+        metrics_sample(writer, "ble_connections_total", labels,
+                       reconnect->connected[i]);
+    }
+
+    metrics_family(writer, "ble_reconnect_time_us", "summary",
+                   "From a lost link to the next host connecting.");
+    for (size_t q = 0; q < sizeof quantiles / sizeof *quantiles; q++) {
+        snprintf(labels, sizeof labels, "quantile=\"0.%u\"",
+                 (unsigned)quantiles[q]);
+        metrics_sample(writer, "ble_reconnect_time_us", labels,
+                       latency_histogram_percentile(hist, quantiles[q]));
+    }
+    metrics_sample(writer, "ble_reconnect_time_us_sum", NULL, hist->total_us);
+    metrics_sample(writer, "ble_reconnect_time_us_count", NULL, hist->count);
+    int64_t lost_us = reconnect->lost_us;
+    metrics_single(writer, "ble_reconnect_waiting_us", "gauge",
+                   "Time since a link was lost with no host back yet, 0 "
+                   "while none is.",
+                   lost_us != 0 ? esp_timer_get_time() - lost_us : 0);
+}
+
+static void write_producers(metrics_writer_t *writer) {
+    const udp_listener_stats_t *udp = udp_listener_get_stats();
+    const trajectory_stats_t *trajectory = trajectory_get_stats();
+    const macro_stats_t *macro = macro_get_stats();
+    const keyboard_input_stats_t *keyboard = keyboard_input_get_stats();
+
+    metrics_single(writer, "udp_datagrams_total", "counter",
+                   "Datagrams received.", udp->received);
+    metrics_family(writer, "udp_datagrams_rejected_total", "counter",
+                   "Datagrams not turned into input, by reason.");
+    metrics_sample(writer, "udp_datagrams_rejected_total",
+                   "reason=\"duplicate\"", udp->duplicates);
+    metrics_sample(writer, "udp_datagrams_rejected_total", "reason=\"stale\"",
+                   udp->stale);
+    metrics_sample(writer, "udp_datagrams_rejected_total",
+                   "reason=\"malformed\"", udp->malformed);
+    metrics_sample(writer, "udp_datagrams_rejected_total",
+                   "reason=\"queue_full\"", udp->queue_full);
+
+    metrics_single(writer, "trajectory_started_total", "counter",
+                   "Trajectories started.", trajectory->started);
+    metrics_single(writer, "trajectory_cancelled_total", "counter",
+                   "Trajectories cancelled before their end.",
+                   trajectory->cancelled);
+    metrics_single(writer, "trajectory_steps_dropped_total", "counter",
+                   "Trajectory steps the lane refused, sent again later.",
+                   trajectory->dropped);
+
+    metrics_single(writer, "macro_events_recorded_total", "counter",
+                   "Events written to a macro.", macro->recorded);
+    metrics_single(writer, "macro_events_played_total", "counter",
+                   "Events replayed from macros.", macro->played);
+    metrics_single(writer, "macro_flash_errors_total", "counter",
+                   "Failed macro reads and writes.", macro->flash_errors);
+
+    metrics_single(writer, "keyboard_strokes_total", "counter",
+                   "Characters queued by /keyboard/type.", keyboard->strokes);
+    metrics_family(writer, "keyboard_texts_rejected_total", "counter",
+                   "Texts not typed, by reason.");
+    metrics_sample(writer, "keyboard_texts_rejected_total",
+                   "reason=\"bad_character\"", keyboard->rejected_bad);
+    metrics_sample(writer, "keyboard_texts_rejected_total",
+                   "reason=\"queue_full\"", keyboard->rejected_full);
+}
+
+static void write_system(metrics_writer_t *writer) {
+    wifi_ap_record_t ap;
+
+    metrics_single(writer, "uptime_us", "counter", "Time since boot.",
+                   esp_timer_get_time());
+    metrics_single(writer, "heap_free_bytes", "gauge", "Free heap.",
+                   esp_get_free_heap_size());
+    metrics_single(writer, "heap_min_free_bytes", "gauge",
+                   "Lowest free heap since boot.",
+                   esp_get_minimum_free_heap_size());
+    if (esp_wifi_sta_get_ap_info(&ap) == ESP_OK) {
+        metrics_single(writer, "wifi_rssi_dbm", "gauge",
+                       "Signal strength of the access point.", ap.rssi);
+    }
+}
+
+static void write_boot(metrics_writer_t *writer) {
+    char labels[32];
+
+    metrics_family(writer, "boot_phase_us", "gauge",
+                   "Time since boot each startup phase was reached at.");
+    for (int i = 0; i < BOOT_PHASE_COUNT; i++) {
+        int64_t us = boot_phase_us(i);
+        if (us == 0) {
+            continue;
+        }
+        snprintf(labels, sizeof labels, "phase=\"%s\"", boot_phase_name(i));
+        metrics_sample(writer, "boot_phase_us", labels, us);
+    }
+}
+
+static void collect(metrics_writer_t *writer) {
+    write_lanes(writer);
+    write_scheduler(writer);
+    write_dispatcher(writer);
+    write_connections(writer);
+    write_latency(writer);
+    write_reconnect(writer);
+    write_producers(writer);
+    write_system(writer);
+    write_boot(writer);
+}
+
+void device_metrics_register(hid_control_t *control) {
+    hid_control = control;
+    register_metrics_collector(collect);
+}
@@ -0,0 +1,12 @@
+#ifndef DEVICE_METRICS_H
+#define DEVICE_METRICS_H
+
+#include "ble_hid_component.h"
+
+/**
+ * Serve the input, scheduling, BLE and system metrics of this device on
+ * GET /metrics. Call after start_webserver.
+ */
+void device_metrics_register(hid_control_t *control);
+
+#endif // DEVICE_METRICS_H
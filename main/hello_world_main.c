@@ -7,6 +7,9 @@
    CONDITIONS OF ANY KIND, either express or implied.
 */
 #include "ble_hid_component.h"
+#include "boot.h"
+#include "conn_params.h"
+#include "device_metrics.h"
 #include "driver/uart.h"
 #include "esp_eth.h"
 #include "esp_netif.h"
@@ -14,11 +17,21 @@
 #include "esp_system.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "hid_dispatcher.h"
+#include "hid_latency.h"
+#include "keyboard_input.h"
+#include "macro.h"
+#include "mouse_input.h"
+#include "mouse_scheduler.h"
 #include "sdkconfig.h"
+#include "trace.h"
+#include "trajectory.h"
+#include "udp_listener.h"
 #include "webserver.h"
 #include "wifi_initializer.h"
 #include <esp_event.h>
 #include <esp_wifi.h>
+#include <stdarg.h>
 #include <stdio.h>
 
 #define LOG_LOCAL_LEVEL ESP_LOG_DEBUG
@@ -27,20 +40,19 @@
 #define CONSOLE_UART_NUM 0
 #define UART_TAG "UART"
 #define MAIN_TAG "MAIN"
-#define SERVER_TASK_TAG "Server_task"
 
 
 hid_control_t control;
 
-static TaskHandle_t xTaskToNotify;
-static QueueHandle_t http_mouse_queue;
-
 void uart_console_task(void *pvParameters) {
     char character;
     // Install UART driver, and get the queue.
     uart_driver_install(CONSOLE_UART_NUM, UART_FIFO_LEN * 2, UART_FIFO_LEN * 2,
                         0, NULL, 0);
 
+    mouse_input_lane_t *lane =
+        mouse_input_register_lane("uart", MOUSE_RING_DROP_NEWEST);
+
     ESP_LOGI(UART_TAG, "console UART processing task started");
 
     while (1) {
@@ -53,46 +65,102 @@ void uart_console_task(void *pvParameters) {
         switch (character) {
         case 'a':
             x = -20;
-            ESP_LOGI(UART_TAG, "mouse: a");
             break;
         case 's':
             y = 20;
-            ESP_LOGI(UART_TAG, "mouse: s");
             break;
         case 'd':
             x = 20;
-            ESP_LOGI(UART_TAG, "mouse: d");
             break;
         case 'w':
             y = -20;
-            ESP_LOGI(UART_TAG, "mouse: w");
             break;
         default:
-            ESP_LOGI(UART_TAG, "received: %d, no HID action", character);
+            // Traced below with no motion.
             break;
         }
-        if (control.is_notifiable || control.is_indicatable) {
-            send_mouse_event(&control, button, x, y, wheel);
+        TRACE_I(TRACE_UART_KEY, character, x, y, 0);
+        if (x != 0 || y != 0 || wheel != 0 || button != 0) {
+            mouse_notification_t mouse_ev = {
+                .x = x, .y = y, .wheel = wheel, .button = button};
+            mouse_input_submit(lane, &mouse_ev);
         }
     }
 }
 
-void webserver_command_task(void *pvParameters) {
-    QueueHandle_t *queue = (QueueHandle_t *)pvParameters;
-    mouse_notification_t mouse_ev;
+/**
+ * Append to the text of *used characters in buf. Returns false once buf is
+ * full, keeping what fits and the terminating NUL.
+ */
+static bool append_text(char *buf, size_t buf_len, size_t *used,
+                        const char *format, ...) {
+    size_t room = buf_len - *used;
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(buf + *used, room, format, args);
+    va_end(args);
+    if (n < 0 || (size_t)n >= room) {
+        *used = buf_len - 1;
+        return false;
+    }
+    *used += n;
+    return true;
+}
 
-    while (1) {
-        if (xQueueReceive(*queue, &mouse_ev, (TickType_t)10) == pdPASS) {
-            if (control.is_notifiable || control.is_indicatable) {
-                ESP_LOGD(SERVER_TASK_TAG, "move %d, %d", mouse_ev.x, mouse_ev.y);
-                send_mouse_event(&control, mouse_ev.button, mouse_ev.x,
-                                 mouse_ev.y, 0);
-            }
+static esp_err_t conn_profile_handler(const char *profile, char *status,
+                                      size_t status_len) {
+    if (profile != NULL) {
+        esp_err_t err = conn_params_set_profile_by_name(&control, profile);
+        if (err != ESP_OK) {
+            return err;
         }
     }
+    // Granted values change on CONN_UPDATE, a switch shows up shortly after.
+    size_t len = 0;
+    bool room = append_text(status, status_len, &len, "profile=%s\n",
+                            conn_params_profile_name(control.conn_profile));
+    for (int i = 0; i < HID_MAX_CONNECTIONS && room; i++) {
+        const hid_conn_t *conn = &control.conns[i];
+        if (!conn->in_use) {
+            continue;
+        }
+        // Numbered like the target parameter of the mouse endpoints.
+        room = append_text(status, status_len, &len,
+                           "target=%d conn_itvl=%d conn_latency=%d "
+                           "supervision_timeout=%d\n",
+                           i + 1, conn->conn_itvl, conn->conn_latency,
+                           conn->supervision_timeout);
+    }
+    return ESP_OK;
+}
+
+static void latency_report_handler(bool reset, char *report,
+                                   size_t report_len) {
+    size_t len = 0;
+    bool room = true;
+    report[0] = '\0';
+    for (int i = 0; i < HID_STAGE_COUNT && room; i++) {
+        const latency_histogram_t *hist = hid_latency_get(i);
+        room = append_text(
+            report, report_len, &len,
+            "%s count=%u mean_us=%u p50_us=%u p90_us=%u p99_us=%u "
+            "p999_us=%u max_us=%u\n",
+            hid_latency_stage_name(i), (unsigned)hist->count,
+            (unsigned)latency_histogram_mean(hist),
+            (unsigned)latency_histogram_percentile(hist, 500),
+            (unsigned)latency_histogram_percentile(hist, 900),
+            (unsigned)latency_histogram_percentile(hist, 990),
+            (unsigned)latency_histogram_percentile(hist, 999),
+            (unsigned)hist->max_us);
+    }
+    if (reset) {
+        hid_latency_reset();
+    }
 }
 
 void app_main(void) {
+    boot_init();
+    boot_done(BOOT_APP_MAIN);
     printf("Hello world!\n");
     memset(&control, 0, sizeof control);
 
@@ -114,26 +182,47 @@ void app_main(void) {
 
     fflush(stdout);
 
+    // Startup is a dependency graph on the boot event group: each part waits
+    // for what it needs and nothing else, so BLE sync, WiFi association and
+    // the web server come up side by side.
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+    // Waits for the NVS init in init_ble_hid, then runs alongside the BLE
+    // controller start.
+    xTaskCreate(&init_wifi_task, "wifi_initializer", 5000, NULL, 1, NULL);
+
+    // Returns before the host syncs; advertising starts when it does.
     init_ble_hid(&control);
+    mouse_input_init();
+    keyboard_input_init();
+    trajectory_init();
+    mouse_scheduler_init();
+    // NVS is up after init_ble_hid.
+    macro_init();
+    hid_dispatcher_register_ack_handler(webserver_ack_delivery);
+    hid_dispatcher_register_input_tap(macro_record_tap);
+    start_hid_dispatcher(&control);
     xTaskCreate(&uart_console_task, "uart_console_task", 4096, NULL, 10, NULL);
+    boot_done(BOOT_DISPATCHER);
 
-    // Relies on btle side nvs init, no nvs init code here.
-    ESP_ERROR_CHECK(esp_event_loop_create_default());
-
-    xTaskToNotify = xTaskGetCurrentTaskHandle();
-    xTaskCreate(&init_wifi_task, "wifi_initializer", 5000, &xTaskToNotify, 1,
-                NULL);
-    vTaskDelay(1);
-    uint32_t ret = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(30000));
-    if (ret != 1) {
+    // Sockets bind to any address, so the servers need the TCP/IP stack but
+    // not an association; requests arrive once WiFi is up.
+    boot_wait(BOOT_BIT(BOOT_NETIF), true, portMAX_DELAY);
+    start_webserver();
+    register_conn_profile_handler(conn_profile_handler);
+    register_latency_report_handler(latency_report_handler);
+    device_metrics_register(&control);
+    start_udp_listener(CONFIG_UDP_MOUSE_PORT);
+    boot_done(BOOT_HTTPD);
+
+    // Only to report the timings; nothing waits on app_main any more.
+    EventBits_t bits =
+        boot_wait(BOOT_BIT(BOOT_WIFI_UP) | BOOT_BIT(BOOT_WIFI_FAILED), false,
+                  pdMS_TO_TICKS(30000));
+    if (!(bits & BOOT_BIT(BOOT_WIFI_UP))) {
         ESP_LOGW(MAIN_TAG, "Wifi connection failed. Abort for this time");
     } else {
         ESP_LOGD(MAIN_TAG, "Wifi Success");
     }
-
-    http_mouse_queue = xQueueCreate(10, sizeof(mouse_notification_t *));
-    start_webserver();
-    xTaskCreate(&webserver_command_task, "webserver_command", 5000,
-                &http_mouse_queue, 1, NULL);
-    register_mouse_notification_queue(http_mouse_queue);
+    boot_wait(BOOT_BIT(BOOT_BLE_SYNCED), true, pdMS_TO_TICKS(30000));
+    boot_log_timings();
 }
@@ -0,0 +1,511 @@
+#!/usr/bin/env python3
+"""Load generator for the mouse endpoints.
+
+Drives GET /mouse, POST /mouse/batch, the /mouse/ws websocket or the UDP
+port of a device, or of host/server/sim_server over loopback, and prints a
+JSON summary: requests, errors by kind, events the pipeline dropped and
+latency percentiles in microseconds.
+
+Closed loop (--arrival closed) runs --concurrency clients that each send the
+next request once the previous one was answered, after --think ms. Open loop
+(--arrival fixed or poisson) sends at --rate requests/s regardless of how
+fast they are answered, over up to --concurrency connections; a request that
+finds every connection busy waits, and its latency counts from when it was
+due, so a stalled server shows up in the percentiles instead of lowering the
+load.
+
+Drops are read from /metrics before and after the run: /mouse answers 200
+once the event is queued, whatever the lane does with it afterwards.
+"""
+
+import argparse
+import asyncio
+import base64
+import json
+import os
+import random
+import struct
+import sys
+import time
+
+# uint8 flags, uint16 frame_id, as mouse_wire_frame_header_t.
+WS_HEADER = struct.Struct('<BH')
+# uint16 frame_id, int64 delivered_us, as mouse_wire_ack_t.
+WS_ACK = struct.Struct('<Hq')
+WS_FLAG_ACK = 0x01
+# int8 dx, dy, wheel, uint8 buttons, uint16 delay_ms, as mouse_wire_event_t.
+RECORD = struct.Struct('<bbbBH')
+# uint32 seq, uint64 client_us, int8 dx, dy, wheel, uint8 buttons.
+DATAGRAM = struct.Struct('<IQbbbB')
+
+# Motion alternates direction so the pointer stays where it was.
+MOTION = [(1, 0), (0, 1), (-1, 0), (0, -1)]
+
+
+class Stats:
+    def __init__(self):
+        self.sent = 0
+        self.ok = 0
+        self.errors = {}
+        # Microseconds from when the request was due to its answer.
+        self.latency_us = []
+        # Microseconds from when the request went out to its answer.
+        self.service_us = []
+
+    def error(self, kind):
+        self.errors[kind] = self.errors.get(kind, 0) + 1
+
+
+class HttpConnection:
+    """HTTP/1.1 keep-alive connection, reopened after an error."""
+
+    def __init__(self, host, port):
+        self.host = host
+        self.port = port
+        self.reader = None
+        self.writer = None
+
+    async def request(self, method, path, body=b''):
+        if self.writer is None:
+            self.reader, self.writer = await asyncio.open_connection(
+                self.host, self.port)
+        head = '{} {} HTTP/1.1\r\nHost: {}\r\n'.format(method, path,
+                                                       self.host)
+        if body:
+            head += 'Content-Type: application/octet-stream\r\n'
+        head += 'Content-Length: {}\r\n\r\n'.format(len(body))
+        self.writer.write(head.encode() + body)
+        await self.writer.drain()
+
+        status = await self.reader.readline()
+        if not status:
+            raise ConnectionError('closed')
+        length = 0
+        while True:
+            line = await self.reader.readline()
+            if line in (b'\r\n', b''):
+                break
+            name, _, value = line.decode().partition(':')
+            if name.lower() == 'content-length':
+                length = int(value)
+        payload = await self.reader.readexactly(length)
+        return int(status.split()[1]), payload
+
+    def close(self):
+        if self.writer is not None:
+            self.writer.close()
+        self.reader = self.writer = None
+
+
+class WebSocket:
+    """Client side of the binary frames /mouse/ws speaks."""
+
+    def __init__(self, host, port, path):
+        self.host = host
+        self.port = port
+        self.path = path
+        self.reader = None
+        self.writer = None
+
+    async def open(self):
+        self.reader, self.writer = await asyncio.open_connection(
+            self.host, self.port)
+        key = base64.b64encode(os.urandom(16)).decode()
+        self.writer.write(
+            ('GET {} HTTP/1.1\r\nHost: {}\r\nUpgrade: websocket\r\n'
+             'Connection: Upgrade\r\nSec-WebSocket-Key: {}\r\n'
+             'Sec-WebSocket-Version: 13\r\n\r\n').format(
+                 self.path, self.host, key).encode())
+        await self.writer.drain()
+        status = await self.reader.readline()
+        if b' 101 ' not in status:
+            raise ConnectionError('handshake: ' + status.decode().strip())
+        while (await self.reader.readline()) not in (b'\r\n', b''):
+            pass
+
+    async def send(self, payload):
+        mask = os.urandom(4)
+        header = bytes([0x82])
+        if len(payload) < 126:
+            header += bytes([0x80 | len(payload)])
+        else:
+            header += bytes([0x80 | 126]) + struct.pack('>H', len(payload))
+        masked = bytes(b ^ mask[i % 4] for i, b in enumerate(payload))
+        self.writer.write(header + mask + masked)
+        await self.writer.drain()
+
+    async def receive(self):
+        """Payload of the next binary frame."""
+        while True:
+            opcode, length = await self.reader.readexactly(2)
+            length &= 0x7f
+            if length == 126:
+                length, = struct.unpack('>H', await self.reader.readexactly(2))
+            elif length == 127:
+                length, = struct.unpack('>Q', await self.reader.readexactly(8))
+            payload = await self.reader.readexactly(length)
+            if opcode & 0x0f == 0x8:
+                raise ConnectionError('closed by device')
+            if opcode & 0x0f == 0x2:
+                return payload
+
+    def close(self):
+        if self.writer is not None:
+            self.writer.close()
+
+
+def records(count, n):
+    return b''.join(
+        RECORD.pack(*MOTION[(n + i) % len(MOTION)], 0, 0, 0)
+        for i in range(count))
+
+
+class HttpClient:
+    """One connection sending GET /mouse or POST /mouse/batch."""
+
+    def __init__(self, args):
+        self.args = args
+        self.conn = HttpConnection(args.host, args.port)
+        self.n = 0
+        # Only websocket acks tell whether an event was delivered.
+        self.lost = 0
+
+    async def open(self):
+        pass
+
+    async def send(self, stats):
+        args = self.args
+        self.n += 1
+        if args.mode == 'mouse':
+            dx, dy = MOTION[self.n % len(MOTION)]
+            status, body = await self.conn.request(
+                'GET', '/mouse?x={}&y={}&target={}'.format(dx, dy,
+                                                           args.target))
+        else:
+            status, body = await self.conn.request(
+                'POST', '/mouse/batch?target={}'.format(args.target),
+                records(args.batch, self.n))
+        if status != 200:
+            stats.error('http_{}'.format(status))
+            return False
+        return True
+
+    def close(self):
+        self.conn.close()
+
+
+class WsClient:
+    """One websocket, each frame waiting for its ack."""
+
+    def __init__(self, args):
+        self.args = args
+        self.ws = WebSocket(args.host, args.port,
+                            '/mouse/ws?target={}'.format(args.target))
+        self.frame_id = 0
+        self.lost = 0
+
+    async def open(self):
+        await self.ws.open()
+
+    async def send(self, stats):
+        self.frame_id = (self.frame_id + 1) & 0xffff
+        await self.ws.send(
+            WS_HEADER.pack(WS_FLAG_ACK, self.frame_id) +
+            records(self.args.batch, self.frame_id))
+        while True:
+            frame_id, delivered_us = WS_ACK.unpack(await self.ws.receive())
+            if frame_id == self.frame_id:
+                break
+        if delivered_us == 0:
+            # Counted as a drop rather than an error.
+            self.lost += 1
+        return True
+
+    def close(self):
+        self.ws.close()
+
+
+def make_client(args):
+    return WsClient(args) if args.mode == 'ws' else HttpClient(args)
+
+
+async def timed_send(client, stats, due, timeout):
+    """Send one request. Returns False when the connection is unusable."""
+    start = time.perf_counter()
+    stats.sent += 1
+    try:
+        ok = await asyncio.wait_for(client.send(stats), timeout)
+    except asyncio.TimeoutError:
+        stats.error('timeout')
+        return False
+    except (OSError, ConnectionError, asyncio.IncompleteReadError,
+            ValueError, IndexError):
+        stats.error('connection')
+        return False
+    end = time.perf_counter()
+    if ok:
+        stats.ok += 1
+        stats.latency_us.append((end - due) * 1e6)
+        stats.service_us.append((end - start) * 1e6)
+    return True
+
+
+async def connect(args, stats, deadline):
+    """Open a client, retrying until deadline. None if that passed."""
+    while time.perf_counter() < deadline:
+        client = make_client(args)
+        try:
+            await asyncio.wait_for(client.open(), args.timeout)
+            return client
+        except (OSError, ConnectionError, asyncio.TimeoutError,
+                asyncio.IncompleteReadError):
+            stats.error('connect')
+            client.close()
+            await asyncio.sleep(0.1)
+    return None
+
+
+async def closed_worker(args, stats, deadline):
+    client = await connect(args, stats, deadline)
+    lost = 0
+    while client is not None and time.perf_counter() < deadline:
+        if not await timed_send(client, stats, time.perf_counter(),
+                                args.timeout):
+            lost += client.lost
+            client.close()
+            client = await connect(args, stats, deadline)
+            continue
+        if args.think > 0:
+            await asyncio.sleep(args.think / 1000)
+    if client is not None:
+        lost += client.lost
+        client.close()
+    return lost
+
+
+async def open_worker(args, stats, due_times, deadline):
+    client = await connect(args, stats, deadline)
+    lost = 0
+    while True:
+        due = await due_times.get()
+        if due is None:
+            break
+        if client is None or time.perf_counter() >= deadline:
+            # Due within the run but never sent: the server fell behind.
+            stats.error('backlog')
+            continue
+        if not await timed_send(client, stats, due, args.timeout):
+            lost += client.lost
+            client.close()
+            client = await connect(args, stats, deadline)
+    if client is not None:
+        lost += client.lost
+        client.close()
+    return lost
+
+
+async def arrivals(args, due_times, deadline):
+    due = time.perf_counter()
+    while due < deadline:
+        delay = due - time.perf_counter()
+        if delay > 0:
+            await asyncio.sleep(delay)
+        due_times.put_nowait(due)
+        if args.arrival == 'poisson':
+            due += random.expovariate(args.rate)
+        else:
+            due += 1 / args.rate
+    for _ in range(args.concurrency):
+        due_times.put_nowait(None)
+
+
+async def run_requests(args, stats):
+    deadline = time.perf_counter() + args.duration
+    if args.arrival == 'closed':
+        workers = [closed_worker(args, stats, deadline)
+                   for _ in range(args.concurrency)]
+        return await asyncio.gather(*workers)
+    due_times = asyncio.Queue()
+    workers = [open_worker(args, stats, due_times, deadline)
+               for _ in range(args.concurrency)]
+    lost, _ = await asyncio.gather(asyncio.gather(*workers),
+                                   arrivals(args, due_times, deadline))
+    return lost
+
+
+async def run_udp(args, stats):
+    """Datagrams at --rate; UDP has no answer, so there is no latency."""
+    loop = asyncio.get_running_loop()
+    transport, _ = await loop.create_datagram_endpoint(
+        asyncio.DatagramProtocol, remote_addr=(args.host, args.udp_port))
+    deadline = time.perf_counter() + args.duration
+    due = time.perf_counter()
+    seq = 0
+    while due < deadline:
+        delay = due - time.perf_counter()
+        if delay > 0:
+            await asyncio.sleep(delay)
+        seq += 1
+        dx, dy = MOTION[seq % len(MOTION)]
+        transport.sendto(
+            DATAGRAM.pack(seq, time.monotonic_ns() // 1000, dx, dy, 0, 0))
+        stats.sent += 1
+        stats.ok += 1
+        if args.arrival == 'poisson':
+            due += random.expovariate(args.rate)
+        else:
+            due += 1 / args.rate
+    transport.close()
+    return []
+
+
+def parse_metrics(text):
+    """Samples by name and label text, e.g. ('x_total', 'lane="http"')."""
+    samples = {}
+    for line in text.splitlines():
+        if not line or line.startswith('#'):
+            continue
+        name, _, value = line.rpartition(' ')
+        metric, _, labels = name.partition('{')
+        samples[(metric, labels.rstrip('}'))] = float(value)
+    return samples
+
+
+async def scrape(args):
+    conn = HttpConnection(args.host, args.port)
+    try:
+        status, body = await asyncio.wait_for(
+            conn.request('GET', '/metrics'), args.timeout)
+        return parse_metrics(body.decode()) if status == 200 else None
+    except (OSError, ConnectionError, asyncio.TimeoutError,
+            asyncio.IncompleteReadError):
+        return None
+    finally:
+        conn.close()
+
+
+def pipeline_drops(args, before, after):
+    """What the device dropped or merged during the run, from /metrics."""
+    if before is None or after is None:
+        return None
+
+    def delta(metric, labels):
+        key = (metric, labels)
+        return int(after.get(key, 0) - before.get(key, 0))
+
+    # Websocket frames share the http lane.
+    lane = 'lane="{}"'.format('udp' if args.mode == 'udp' else 'http')
+    drops = {
+        'lane_dropped_newest': delta('mouse_input_dropped_newest_total', lane),
+        'lane_dropped_oldest': delta('mouse_input_dropped_oldest_total', lane),
+        'lane_merged': delta('mouse_input_merged_total', lane),
+    }
+    if args.mode == 'udp':
+        drops['udp_received'] = delta('udp_datagrams_total', '')
+        for reason in ('duplicate', 'stale', 'malformed', 'queue_full'):
+            drops['udp_' + reason] = delta(
+                'udp_datagrams_rejected_total',
+                'reason="{}"'.format(reason))
+    return drops
+
+
+def percentile(ordered, fraction):
+    if not ordered:
+        return None
+    index = min(len(ordered) - 1, int(fraction * len(ordered)))
+    return round(ordered[index])
+
+
+def summarize(values):
+    ordered = sorted(values)
+    if not ordered:
+        return None
+    return {
+        'mean': round(sum(ordered) / len(ordered)),
+        'p50': percentile(ordered, 0.5),
+        'p90': percentile(ordered, 0.9),
+        'p99': percentile(ordered, 0.99),
+        'p99.9': percentile(ordered, 0.999),
+        'max': round(ordered[-1]),
+    }
+
+
+async def main(args):
+    stats = Stats()
+    before = await scrape(args)
+    start = time.perf_counter()
+    if args.mode == 'udp':
+        lost = await run_udp(args, stats)
+    else:
+        lost = await run_requests(args, stats)
+    elapsed = time.perf_counter() - start
+    # Let queued events reach the hosts before the drops are read.
+    await asyncio.sleep(args.settle / 1000)
+    after = await scrape(args)
+
+    drops = pipeline_drops(args, before, after)
+    if args.mode == 'ws':
+        drops = drops or {}
+        drops['frames_not_delivered'] = sum(lost)
+    summary = {
+        'mode': args.mode,
+        'arrival': args.arrival,
+        'target': '{}:{}'.format(args.host, args.udp_port if args.mode ==
+                                 'udp' else args.port),
+        'concurrency': args.concurrency,
+        'rate': args.rate if args.arrival != 'closed' else None,
+        'duration_s': round(elapsed, 3),
+        'sent': stats.sent,
+        'ok': stats.ok,
+        'throughput': round(stats.ok / elapsed, 1),
+        'errors': stats.errors,
+        'drops': drops,
+        'latency_us': summarize(stats.latency_us),
+        'service_us': summarize(stats.service_us),
+    }
+    text = json.dumps(summary, indent=2)
+    if args.json:
+        with open(args.json, 'w') as out:
+            out.write(text + '\n')
+    print(text)
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--host', default='127.0.0.1')
+    parser.add_argument('--port', type=int, default=80,
+                        help='HTTP port, 8080 for sim_server')
+    parser.add_argument('--udp-port', type=int, default=3333)
+    parser.add_argument('--mode', choices=['mouse', 'batch', 'ws', 'udp'],
+                        default='mouse')
+    parser.add_argument('--arrival', choices=['closed', 'fixed', 'poisson'],
+                        default='closed')
+    parser.add_argument('--rate', type=float, default=100,
+                        help='requests/s in open loop and UDP mode')
+    parser.add_argument('--concurrency', type=int, default=1,
+                        help='connections, the clients in closed loop')
+    parser.add_argument('--duration', type=float, default=10, help='seconds')
+    parser.add_argument('--think', type=float, default=0,
+                        help='ms between answer and next request, closed loop')
+    parser.add_argument('--timeout', type=float, default=2,
+                        help='seconds before a request counts as lost')
+    parser.add_argument('--batch', type=int, default=8,
+                        help='records per batch or websocket frame, max 32')
+    parser.add_argument('--target', default='all')
+    parser.add_argument('--settle', type=float, default=500,
+                        help='ms to wait before reading /metrics after the run')
+    parser.add_argument('--json', help='also write the summary here')
+    args = parser.parse_args()
+    if args.mode == 'udp' and args.arrival == 'closed':
+        # Nothing comes back to close the loop on.
+        args.arrival = 'fixed'
+    if not 1 <= args.batch <= 32 or args.concurrency < 1 or args.rate <= 0:
+        parser.error('out of range')
+    return args
+
+
+if __name__ == '__main__':
+    try:
+        asyncio.run(main(parse_args()))
+    except KeyboardInterrupt:
+        sys.exit(1)